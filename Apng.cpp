@@ -0,0 +1,267 @@
+#include "Apng.h"
+
+#include "lodepng.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+void put32(unsigned char* out, unsigned value)
+{
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+void put16(unsigned char* out, unsigned value)
+{
+	out[0] = (unsigned char)(value >> 8);
+	out[1] = (unsigned char)value;
+}
+
+// The bounding box of the pixels that differ between two RGB images, 0 wide if there are none.
+ImageRect changedRect(const unsigned char* a, const unsigned char* b, unsigned width, unsigned height)
+{
+	const size_t stride = size_t(width) * 3;
+	auto rowsEqual = [&](unsigned y) { return !std::memcmp(a + y * stride, b + y * stride, stride); };
+	auto pixelsEqual = [&](unsigned x, unsigned y) { return !std::memcmp(a + y * stride + x * 3, b + y * stride + x * 3, 3); };
+
+	ImageRect rect;
+	unsigned top = 0;
+	while(top < height && rowsEqual(top)) ++top;
+	if(top == height) return rect;
+
+	unsigned bottom = height;
+	while(rowsEqual(bottom - 1)) --bottom;
+
+	// each row only needs searching up to the columns already known to have changed
+	unsigned left = width, right = 0;
+	for(unsigned y = top; y < bottom; ++y)
+	{
+		unsigned x = 0;
+		while(x < left && pixelsEqual(x, y)) ++x;
+		left = std::min(left, x);
+
+		x = width;
+		while(x > right && pixelsEqual(x - 1, y)) --x;
+		right = std::max(right, x);
+	}
+
+	rect.x = left;
+	rect.y = top;
+	rect.width = right - left;
+	rect.height = bottom - top;
+	return rect;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+ApngWriter::ApngWriter(const std::string& path, unsigned width, unsigned height, unsigned fps, unsigned loops, unsigned threads)
+	: file(path, std::ios::binary), width(width), height(height), fps(std::min(std::max(fps, 1u), 65535u)), loops(loops)
+{
+	if(!file) error = 79;
+
+	unsigned numThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+	for(unsigned i = 0; i < numThreads + 2; ++i)
+	{
+		frames.emplace_back(new Frame);
+		freeFrames.push(frames.back().get());
+	}
+
+	for(unsigned t = 0; t < numThreads; ++t) encoders.emplace_back([this] { encode(); });
+	writer = std::thread([this] { write(); });
+}
+
+ApngWriter::~ApngWriter()
+{
+	finish();
+}
+
+void ApngWriter::addFrame(const unsigned char* rgb)
+{
+	Frame* frame = nullptr;
+	freeFrames.pop(frame);
+
+	const size_t stride = size_t(width) * 3;
+	ImageRect rect;
+	if(numFrames == 0)
+	{
+		rect.width = width;
+		rect.height = height;
+		previous.assign(rgb, rgb + stride * height);
+	}
+	else
+	{
+		rect = changedRect(previous.data(), rgb, width, height);
+		// nothing changed, a single pixel stands in for the frame so it still takes its time
+		if(rect.width == 0)
+		{
+			rect.width = 1;
+			rect.height = 1;
+		}
+	}
+
+	frame->index = numFrames++;
+	frame->rect = rect;
+	frame->pixels.resize(size_t(rect.width) * rect.height * 3);
+	for(unsigned y = 0; y < rect.height; ++y)
+	{
+		const unsigned char* row = rgb + (rect.y + y) * stride + rect.x * 3;
+		std::memcpy(&frame->pixels[size_t(y) * rect.width * 3], row, size_t(rect.width) * 3);
+		// everything outside the rectangle is the same already
+		std::memcpy(&previous[(rect.y + y) * stride + rect.x * 3], row, size_t(rect.width) * 3);
+	}
+	numEncodedPixels += size_t(rect.width) * rect.height;
+
+	toEncode.push(frame);
+}
+
+unsigned ApngWriter::finish()
+{
+	if(finished) return error;
+	finished = true;
+
+	toEncode.close();
+	for(auto& encoder : encoders) encoder.join();
+	encoded.close();
+	writer.join();
+
+	// an animation needs a frame
+	if(!error && numFrames == 0) error = 48;
+	if(!error) error = writeChunk("IEND", nullptr, 0);
+
+	// the number of frames is only known now, rewrite the animation control chunk with it
+	if(!error)
+	{
+		unsigned char control[8];
+		put32(control, numFrames);
+		put32(control + 4, loops);
+		file.seekp(frameCountPosition);
+		error = writeChunk("acTL", control, sizeof(control));
+	}
+
+	file.close();
+	if(!error && file.fail()) error = 79;
+	return error;
+}
+
+void ApngWriter::encode()
+{
+	lodepng::EncoderContext context;
+	// every frame has to be in the color type of the header, never let lodepng pick a palette
+	lodepng::State state;
+	state.info_raw.colortype = LCT_RGB;
+	state.info_raw.bitdepth = 8;
+	state.info_png.color.colortype = LCT_RGB;
+	state.info_png.color.bitdepth = 8;
+	state.encoder.auto_convert = 0;
+
+	double seconds = 0.;
+	Frame* frame = nullptr;
+	while(toEncode.pop(frame))
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// a PNG of the rectangle, of which only the IDAT data is kept
+		const unsigned char* png = nullptr;
+		size_t pngSize = 0;
+		frame->error = context.encode(png, pngSize, frame->pixels.data(), frame->rect.width, frame->rect.height, state);
+		frame->zlib.clear();
+		frame->header.clear();
+		if(!frame->error)
+		{
+			const unsigned char* end = png + pngSize;
+			for(const unsigned char* chunk = png + 8; chunk + 12 <= end && !lodepng_chunk_type_equals(chunk, "IEND");
+			    chunk = lodepng_chunk_next_const(chunk))
+			{
+				const unsigned char* data = lodepng_chunk_data_const(chunk);
+				if(lodepng_chunk_type_equals(chunk, "IDAT")) frame->zlib.insert(frame->zlib.end(), data, data + lodepng_chunk_length(chunk));
+				else if(frame->index == 0 && lodepng_chunk_type_equals(chunk, "IHDR")) frame->header.assign(chunk, data + lodepng_chunk_length(chunk) + 4);
+			}
+		}
+
+		seconds += secondsSince(start);
+		encoded.push(frame);
+	}
+
+	std::lock_guard<std::mutex> lock(statsMutex);
+	encodeTime += seconds;
+}
+
+void ApngWriter::write()
+{
+	// frames finish out of order, they wait here for the ones before them
+	std::map<unsigned, Frame*> waiting;
+	unsigned next = 0;
+
+	Frame* frame = nullptr;
+	while(encoded.pop(frame))
+	{
+		waiting[frame->index] = frame;
+		for(auto ready = waiting.begin(); ready != waiting.end() && ready->first == next; ready = waiting.erase(ready), ++next)
+		{
+			if(!error) error = ready->second->error ? ready->second->error : writeFrame(*ready->second);
+			freeFrames.push(ready->second);
+		}
+	}
+}
+
+unsigned ApngWriter::writeChunk(const char* type, const unsigned char* data, size_t size)
+{
+	// lodepng adds the length and CRC
+	unsigned char* chunk = nullptr;
+	size_t chunkSize = 0;
+	unsigned chunkError = lodepng_chunk_create(&chunk, &chunkSize, unsigned(size), type, data);
+	if(!chunkError && !file.write(reinterpret_cast<const char*>(chunk), chunkSize)) chunkError = 79;
+	std::free(chunk);
+	return chunkError;
+}
+
+unsigned ApngWriter::writeFrame(const Frame& frame)
+{
+	if(frame.index == 0)
+	{
+		static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+		file.write(reinterpret_cast<const char*>(frame.header.data()), frame.header.size());
+		if(!file) return 79;
+
+		// the frame count is filled in by finish
+		frameCountPosition = file.tellp();
+		unsigned char control[8];
+		put32(control, 0);
+		put32(control + 4, loops);
+		if(unsigned chunkError = writeChunk("acTL", control, sizeof(control))) return chunkError;
+	}
+
+	// the rectangle replaces what's under it and stays for the next frame to draw over
+	unsigned char control[26];
+	put32(control, sequence++);
+	put32(control + 4, frame.rect.width);
+	put32(control + 8, frame.rect.height);
+	put32(control + 12, frame.rect.x);
+	put32(control + 16, frame.rect.y);
+	put16(control + 20, 1);
+	put16(control + 22, fps);
+	control[24] = 0; // APNG_DISPOSE_OP_NONE
+	control[25] = 0; // APNG_BLEND_OP_SOURCE
+	if(unsigned chunkError = writeChunk("fcTL", control, sizeof(control))) return chunkError;
+
+	// the first frame is the default image everyone can see, the others hide in fdAT chunks
+	if(frame.index == 0) return writeChunk("IDAT", frame.zlib.data(), frame.zlib.size());
+
+	std::vector<unsigned char> data(4 + frame.zlib.size());
+	put32(data.data(), sequence++);
+	std::copy(frame.zlib.begin(), frame.zlib.end(), data.begin() + 4);
+	return writeChunk("fdAT", data.data(), data.size());
+}
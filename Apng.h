@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ImageOps.h"
+#include "WorkQueue.h"
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes an animated PNG, fed one frame at a time. Each frame is compared to the one before and
+// only the rectangle that changed is encoded, drawn over the previous frame by the viewer. The
+// rectangles are compressed on a pool of threads while the caller draws the next frame, a writer
+// thread puts them in the file in order.
+// Viewers without APNG support show the first frame.
+class ApngWriter
+{
+public:
+	// Frames are width x height top-down 8 bit RGB, shown fps times a second. loops 0 plays the
+	// animation forever. threads 0 uses all cores.
+	ApngWriter(const std::string& path, unsigned width, unsigned height, unsigned fps, unsigned loops = 0, unsigned threads = 0);
+	// finishes the file if finish wasn't called
+	~ApngWriter();
+
+	// Copies the frame and hands it to the encoders. Blocks while as many frames as there are
+	// encoders, plus two, are waiting.
+	void addFrame(const unsigned char* rgb);
+
+	// Waits for every frame to be written and completes the file. Returns a lodepng error code, the
+	// first one anything ran into.
+	unsigned finish();
+
+	// pixels encoded over all frames so far, the full size of each frame minus what was unchanged
+	size_t encodedPixels() const { return numEncodedPixels; }
+	// time the encoders spent compressing, summed over the threads
+	double encodeSeconds() const { return encodeTime; }
+
+private:
+	struct Frame
+	{
+		unsigned index = 0;
+		ImageRect rect;
+		// the pixels of rect, then the zlib stream they compressed to
+		std::vector<unsigned char> pixels, zlib;
+		// the first frame is the PNG's default image and brings the header along
+		std::vector<unsigned char> header;
+		unsigned error = 0;
+	};
+
+	void encode();
+	void write();
+	unsigned writeChunk(const char* type, const unsigned char* data, size_t size);
+	unsigned writeFrame(const Frame& frame);
+
+	std::ofstream file;
+	unsigned width, height, fps, loops;
+
+	// the last frame added, to find what changed
+	std::vector<unsigned char> previous;
+	unsigned numFrames = 0;
+	size_t numEncodedPixels = 0;
+
+	std::vector<std::unique_ptr<Frame>> frames;
+	WorkQueue<Frame*> freeFrames, toEncode, encoded;
+	std::vector<std::thread> encoders;
+	std::thread writer;
+	bool finished = false;
+
+	// only touched by the writer until it's joined
+	unsigned error = 0;
+	unsigned sequence = 0;
+	std::streampos frameCountPosition;
+
+	std::mutex statsMutex;
+	double encodeTime = 0.;
+};
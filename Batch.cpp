@@ -0,0 +1,628 @@
+#include "Batch.h"
+
+#include "Apng.h"
+#include "CameraTrack.h"
+#include "ImageOps.h"
+#include "MeshSource.h"
+#include "Palette.h"
+#include "SoftwareRenderer.h"
+#include "WorkQueue.h"
+#include "Y4m.h"
+#include "lodepng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+
+// a master render, shared by the outputs cropped and scaled from it
+struct Frame
+{
+	unsigned width = 0, height = 0;
+	std::vector<unsigned char> rgb;
+	std::atomic<unsigned> pendingVariants;
+};
+
+struct Variant
+{
+	Frame* frame = nullptr;
+	const BatchJob* job = nullptr;
+};
+
+// A picture for whichever renderer is free: the still jobs sharing one master render, or an animation.
+// The loaded meshes are shared by their tasks, and read only
+struct RenderTask
+{
+	std::shared_ptr<const Mesh> mesh;
+	// numbers the loaded meshes, so renderers know when their colors still fit
+	size_t meshId = 0;
+	std::vector<const BatchJob*> view;
+	const BatchJob* animation = nullptr;
+};
+
+struct EncodedImage
+{
+	std::string path;
+	std::vector<unsigned char> png;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool parseColor(const std::string& hex, std::array<float, 3>& color)
+{
+	if(hex.size() != 6 || hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) return false;
+
+	color = fromHex(uint32_t(std::stoul(hex, nullptr, 16)) << 8);
+	return true;
+}
+
+// what identifies the mesh of a job
+std::string meshKey(const BatchJob& job)
+{
+	std::ostringstream key;
+	key << int(job.meshKind) << ' ' << job.meshSeed << ' ' << job.meshPath;
+	return key.str();
+}
+
+// still jobs that only differ in their output size and file
+bool sameView(const BatchJob& a, const BatchJob& b)
+{
+	const Scene& sa = a.scene;
+	const Scene& sb = b.scene;
+	return sa.palette == sb.palette && sa.seed == sb.seed && sa.camera.location == sb.camera.location
+		&& sa.camera.forward == sb.camera.forward && sa.camera.up == sb.camera.up
+		&& sa.style.lineSize == sb.style.lineSize && sa.style.lineColor == sb.style.lineColor;
+}
+
+Mesh loadJobMesh(const BatchJob& job)
+{
+	switch(job.meshKind)
+	{
+	case BatchJob::MeshKind::generated:
+		{
+			MeshGenSettings settings;
+			settings.seed = job.meshSeed;
+			return generatedMesh(settings);
+		}
+	case BatchJob::MeshKind::obj:
+		{
+			std::string error;
+			Mesh mesh = objMesh(job.meshPath, error);
+			if(mesh.indices.empty()) std::cout << "Failed to load " << job.meshPath << ": " << error << std::endl;
+			return mesh;
+		}
+	default:
+		{
+			unsigned error = 0;
+			Mesh mesh = imageMesh(job.meshPath, LowPolySettings(), error);
+			if(error) std::cout << "Failed to load " << job.meshPath << ": " << lodepng_error_text(error) << std::endl;
+			return mesh;
+		}
+	}
+}
+
+// Renders an animated job frame by frame at its exact size. The APNG's encoders, or the video's
+// writer, work on each frame while the next one is drawn. Returns false if the file couldn't be written.
+bool renderAnimation(const BatchJob& job, const Mesh& mesh, Renderer& renderer, unsigned encodeThreads, BatchStats& stats,
+                     std::mutex& statsMutex)
+{
+	bool isImage = job.meshKind == BatchJob::MeshKind::image;
+	float aspect = (float)job.width / job.height;
+
+	// images stay where the first frame puts them, they don't slide along with the camera
+	glm::mat4 modelMat(1.f);
+	if(isImage) modelMat = imagePlacement(mesh, job.scene.camera.viewProjection(aspect), aspect);
+
+	// the picks of the two seeds the colors are fading between
+	std::vector<std::array<float, 3>> fadeFrom, fadeTo, colors;
+	if(isImage) colors = provokingVertexColors(mesh);
+	unsigned fadeStep = ~0u;
+
+	std::unique_ptr<ApngWriter> apng;
+	std::unique_ptr<Y4mWriter> video;
+	if(isVideoPath(job.output)) video.reset(new Y4mWriter(job.output, job.width, job.height, job.fps));
+	else apng.reset(new ApngWriter(job.output, job.width, job.height, job.fps, 0, encodeThreads));
+
+	auto start = std::chrono::steady_clock::now();
+	double renderSeconds = 0.;
+	std::vector<unsigned char> rgb(size_t(job.width) * job.height * 3);
+	for(unsigned frame = 0; frame < job.frames; ++frame)
+	{
+		auto renderStart = std::chrono::steady_clock::now();
+		float t = job.frames > 1 ? (float)frame / (job.frames - 1) : 0.f;
+
+		Camera camera = job.path.keys.empty() ? job.scene.camera : job.path.at((float)frame / job.fps);
+
+		if(!isImage)
+		{
+			float fade = t * job.fades;
+			unsigned step = job.fades ? std::min(unsigned(fade), job.fades - 1) : 0;
+			if(step != fadeStep)
+			{
+				size_t numVerts = mesh.positions.size() / 3;
+				fadeFrom = pickPaletteColors(job.scene.palette, numVerts, job.scene.seed + step);
+				fadeTo = job.fades ? pickPaletteColors(job.scene.palette, numVerts, job.scene.seed + step + 1) : fadeFrom;
+				fadeStep = step;
+			}
+
+			float blend = fade - step;
+			colors.resize(fadeFrom.size());
+			for(size_t v = 0; v < colors.size(); ++v)
+			{
+				for(int c = 0; c < 3; ++c) colors[v][c] = fadeFrom[v][c] + (fadeTo[v][c] - fadeFrom[v][c]) * blend;
+			}
+		}
+
+		glm::mat4 MVPMat = camera.viewProjection(aspect) * modelMat;
+		renderer.render(mesh, colors, &MVPMat[0][0], job.scene.style, job.width, job.height, rgb.data());
+		renderSeconds += secondsSince(renderStart);
+
+		if(video) video->addFrame(rgb.data());
+		else apng->addFrame(rgb.data());
+	}
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.renderSeconds += renderSeconds;
+		stats.renders += job.frames;
+	}
+
+	if(video)
+	{
+		bool written = video->finish();
+		{
+			std::lock_guard<std::mutex> lock(statsMutex);
+			stats.writeSeconds += video->writeSeconds();
+		}
+		if(!written)
+		{
+			std::cout << "Failed to write " << job.output << std::endl;
+			return false;
+		}
+
+		std::cout << job.output << ": " << job.frames << " frames of " << job.width << "x" << job.height << " at "
+			<< job.frames / secondsSince(start) << " frames/s" << std::endl;
+		return true;
+	}
+
+	unsigned error = apng->finish();
+	{
+		// the still images' encoders and the other renderers may still be adding theirs
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.encodeSeconds += apng->encodeSeconds();
+	}
+	if(error)
+	{
+		std::cout << "Failed to save " << job.output << ": " << lodepng_error_text(error) << std::endl;
+		return false;
+	}
+
+	std::cout << job.output << ": " << job.frames << " frames, encoded "
+		<< 100. * apng->encodedPixels() / (double(job.width) * job.height * job.frames) << "% of their pixels" << std::endl;
+	return true;
+}
+
+}
+
+bool loadBatchFile(const std::string& path, std::vector<BatchJob>& jobs)
+{
+	std::ifstream file(path);
+	if(!file)
+	{
+		std::cout << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	BatchJob current;
+	// only one job can stream its video to stdout, frames of two would interleave
+	bool streamsToStdout = false;
+	std::string line;
+	for(unsigned lineNumber = 1; std::getline(file, line); ++lineNumber)
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		std::string keyword;
+		if(!(words >> keyword)) continue;
+
+		bool valid = true;
+		if(keyword == "mesh")
+		{
+			std::string kind;
+			words >> kind;
+			if(kind == "generated")
+			{
+				current.meshKind = BatchJob::MeshKind::generated;
+				current.meshPath.clear();
+				current.meshSeed = 1;
+				std::string seed;
+				if(words >> seed) valid = bool(std::istringstream(seed) >> current.meshSeed);
+			}
+			else if(kind == "obj" || kind == "image")
+			{
+				current.meshKind = kind == "obj" ? BatchJob::MeshKind::obj : BatchJob::MeshKind::image;
+				current.meshSeed = 1;
+				valid = bool(std::getline(words >> std::ws, current.meshPath));
+			}
+			else valid = false;
+		}
+		else if(keyword == "palette")
+		{
+			current.scene.palette.clear();
+			for(std::string hex; valid && words >> hex; )
+			{
+				std::array<float, 3> color;
+				valid = parseColor(hex, color);
+				current.scene.palette.push_back(color);
+			}
+		}
+		else if(keyword == "seed")
+		{
+			valid = bool(words >> current.scene.seed);
+		}
+		else if(keyword == "camera" || keyword == "key")
+		{
+			float time = 0.f;
+			Camera camera;
+			valid = (keyword == "camera" || (words >> time && time >= 0.f))
+				&& words >> camera.location.x >> camera.location.y >> camera.location.z >> camera.forward.x
+				>> camera.forward.y >> camera.forward.z >> camera.up.x >> camera.up.y >> camera.up.z;
+			if(valid && keyword == "camera")
+			{
+				current.scene.camera = camera;
+				current.path.keys.clear();
+			}
+			else if(valid) current.path.add(time, camera);
+		}
+		else if(keyword == "animate")
+		{
+			std::string frames;
+			words >> frames;
+			if(frames == "off") current.frames = 1;
+			// worked out from the keys by the output
+			else if(frames == "path")
+			{
+				current.frames = 0;
+				valid = words >> current.fps && current.fps > 0;
+			}
+			else
+			{
+				std::istringstream number(frames);
+				valid = bool(number >> current.frames) && current.frames > 0 && bool(words >> current.fps) && current.fps > 0;
+			}
+		}
+		else if(keyword == "track")
+		{
+			std::string trackPath, speedWord;
+			float speed = 1.f;
+			CameraTrack track;
+			valid = bool(words >> trackPath);
+			// the speed is optional, but a word that isn't one fails the line
+			if(valid && words >> speedWord)
+			{
+				std::istringstream number(speedWord);
+				valid = number >> speed && number.eof() && speed > 0.f;
+			}
+			valid = valid && loadCameraTrack(trackPath, track);
+			if(valid) current.path = track.path(speed);
+		}
+		else if(keyword == "fades")
+		{
+			valid = bool(words >> current.fades);
+		}
+		else if(keyword == "lines")
+		{
+			std::string size, color;
+			words >> size;
+			if(size == "off") current.scene.style.lineSize = -1.f;
+			else
+			{
+				std::istringstream number(size);
+				valid = bool(number >> current.scene.style.lineSize) && current.scene.style.lineSize >= 0.f;
+				if(valid && words >> color) valid = parseColor(color, current.scene.style.lineColor);
+			}
+		}
+		else if(keyword == "output")
+		{
+			valid = bool(words >> current.width >> current.height) && current.width > 0 && current.height > 0
+				&& std::getline(words >> std::ws, current.output);
+			unsigned frames = current.frames == 0 ? unsigned(current.path.duration() * current.fps) + 1 : current.frames;
+			// still pictures are PNGs, which only go to files
+			if(valid && current.output == "-")
+			{
+				valid = !streamsToStdout && frames > 1;
+				streamsToStdout = true;
+			}
+			if(valid)
+			{
+				jobs.push_back(current);
+				jobs.back().frames = frames;
+			}
+		}
+		else valid = false;
+
+		if(!valid)
+		{
+			std::cout << path << ":" << lineNumber << ": can't read \"" << line << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+BatchStats runBatch(const std::vector<BatchJob>& jobs, const BatchSettings& settings)
+{
+	BatchStats stats;
+	stats.jobs = jobs.size();
+	auto batchStart = std::chrono::steady_clock::now();
+
+	// group the jobs by mesh, in the order the meshes first show up
+	std::map<std::string, size_t> groupOf;
+	std::vector<std::vector<const BatchJob*>> groups;
+	for(const BatchJob& job : jobs)
+	{
+		auto inserted = groupOf.emplace(meshKey(job), groups.size());
+		if(inserted.second) groups.emplace_back();
+		groups[inserted.first->second].push_back(&job);
+	}
+
+	// and within a mesh by what the picture looks like, every view is rendered once
+	std::vector<std::vector<RenderTask>> groupTasks(groups.size());
+	size_t numTasks = 0;
+	for(size_t g = 0; g < groups.size(); ++g)
+	{
+		std::vector<RenderTask>& tasks = groupTasks[g];
+		for(const BatchJob* job : groups[g])
+		{
+			if(job->frames > 1)
+			{
+				tasks.emplace_back();
+				tasks.back().animation = job;
+				continue;
+			}
+
+			auto view = std::find_if(tasks.begin(), tasks.end(), [job](const RenderTask& task)
+				{
+					return !task.animation && sameView(*task.view.front(), *job);
+				});
+			if(view == tasks.end())
+			{
+				tasks.emplace_back();
+				tasks.back().view.push_back(job);
+			}
+			else view->view.push_back(job);
+		}
+		numTasks += tasks.size();
+	}
+
+	// a renderer per core draws a picture on its own, unless there are too few pictures to go round.
+	// Then the spare cores draw bands of the renderers' pictures
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	unsigned numRenderers = settings.renderers ? settings.renderers : unsigned(std::max<size_t>(1, std::min<size_t>(cores, numTasks)));
+	unsigned renderThreads = settings.renderThreads ? settings.renderThreads : std::max(1u, cores / numRenderers);
+	unsigned encodeThreads = settings.encodeThreads ? settings.encodeThreads : cores;
+	// animations encode on their own threads next to the shared encoders, each renderer's APNG gets its share
+	unsigned apngEncodeThreads = std::max(1u, encodeThreads / numRenderers);
+	unsigned framesInFlight = settings.framesInFlight ? settings.framesInFlight : encodeThreads + numRenderers + 1;
+
+	std::mutex statsMutex;
+	std::atomic<size_t> failed(0);
+	// encoders with a variant in hand, a scale gets their share of the encode threads
+	std::atomic<unsigned> busyEncoders(0);
+
+	// master frames go round from the renderers to the encoders and back, encoded images on to the writer
+	std::vector<std::unique_ptr<Frame>> frames;
+	WorkQueue<Frame*> freeFrames;
+	WorkQueue<Variant> variants;
+	WorkQueue<EncodedImage> encodedImages;
+	for(unsigned i = 0; i < framesInFlight; ++i)
+	{
+		frames.emplace_back(new Frame);
+		freeFrames.push(frames.back().get());
+	}
+
+	std::vector<std::thread> encoders;
+	for(unsigned t = 0; t < encodeThreads; ++t) encoders.emplace_back([&]
+	{
+		lodepng::EncoderContext context;
+		std::vector<unsigned char> scaled;
+		double resampleSeconds = 0., encodeSeconds = 0.;
+
+		Variant variant;
+		while(variants.pop(variant))
+		{
+			Frame& frame = *variant.frame;
+			const BatchJob& job = *variant.job;
+			unsigned busy = ++busyEncoders;
+
+			// the master itself, or the crop of it with the job's aspect scaled down
+			const unsigned char* pixels = frame.rgb.data();
+			if(job.width != frame.width || job.height != frame.height)
+			{
+				auto start = std::chrono::steady_clock::now();
+				ImageRect crop = centeredCrop(frame.width, frame.height, (float)job.width / job.height);
+				scaled.resize(size_t(job.width) * job.height * 3);
+				resizeRGB(frame.rgb.data(), frame.width, crop, scaled.data(), job.width, job.height,
+				          std::max(1u, encodeThreads / busy));
+				pixels = scaled.data();
+				resampleSeconds += secondsSince(start);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			const unsigned char* png = nullptr;
+			size_t pngSize = 0;
+			unsigned error = context.encode(png, pngSize, pixels, job.width, job.height, LCT_RGB, 8);
+
+			EncodedImage image;
+			image.path = job.output;
+			if(!error) image.png.assign(png, png + pngSize);
+			encodeSeconds += secondsSince(start);
+			--busyEncoders;
+
+			// the last variant hands the master back
+			if(--frame.pendingVariants == 0) freeFrames.push(&frame);
+			if(error)
+			{
+				std::cout << "Failed to encode " << job.output << ": " << lodepng_error_text(error) << std::endl;
+				++failed;
+				continue;
+			}
+			encodedImages.push(std::move(image));
+		}
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.resampleSeconds += resampleSeconds;
+		stats.encodeSeconds += encodeSeconds;
+	});
+
+	std::thread writer([&]
+	{
+		EncodedImage image;
+		while(encodedImages.pop(image))
+		{
+			auto start = std::chrono::steady_clock::now();
+			unsigned error = lodepng::save_file(image.png, image.path);
+			if(error)
+			{
+				std::cout << "Failed to save " << image.path << ": " << lodepng_error_text(error) << std::endl;
+				++failed;
+			}
+			std::lock_guard<std::mutex> lock(statsMutex);
+			stats.writeSeconds += secondsSince(start);
+		}
+	});
+
+	WorkQueue<RenderTask> tasks;
+	std::vector<std::thread> renderers;
+	for(unsigned r = 0; r < numRenderers; ++r) renderers.emplace_back([&]
+	{
+		SoftwareRenderer renderer(renderThreads);
+		double renderSeconds = 0.;
+		size_t renders = 0;
+
+		// the colors of the last view, for the next one with the same mesh, palette and seed
+		std::vector<std::array<float, 3>> colors;
+		const BatchJob* colorsMadeFor = nullptr;
+		size_t colorsMesh = 0;
+
+		// done with a task, its mesh may go
+		for(RenderTask task; tasks.pop(task); task = RenderTask())
+		{
+			const Mesh& mesh = *task.mesh;
+			if(task.animation)
+			{
+				if(!renderAnimation(*task.animation, mesh, renderer, apngEncodeThreads, stats, statsMutex)) ++failed;
+				continue;
+			}
+
+			const BatchJob& first = *task.view.front();
+
+			// as tall as the tallest output and as wide as the widest aspect, so every output is a
+			// centered crop of it with the same vertical field of view
+			float aspect = 0.f;
+			unsigned height = 0;
+			for(const BatchJob* job : task.view)
+			{
+				aspect = std::max(aspect, (float)job->width / job->height);
+				height = std::max(height, job->height);
+			}
+			float supersample = std::max(settings.supersample, 1.f);
+			height = unsigned(std::ceil(height * supersample));
+			unsigned width = unsigned(std::ceil(height * aspect));
+			// a single output keeps its exact size
+			if(task.view.size() == 1 && supersample == 1.f) width = first.width;
+
+			Frame* frame = nullptr;
+			freeFrames.pop(frame);
+
+			auto renderStart = std::chrono::steady_clock::now();
+
+			// images keep their colors, everything else picks them per palette and seed
+			if(!colorsMadeFor || colorsMesh != task.meshId || colorsMadeFor->scene.palette != first.scene.palette
+				|| colorsMadeFor->scene.seed != first.scene.seed)
+			{
+				colors = first.scene.vertexColors(mesh);
+				colorsMadeFor = &first;
+				colorsMesh = task.meshId;
+			}
+
+			bool isImage = first.meshKind == BatchJob::MeshKind::image;
+			float masterAspect = (float)width / height;
+			glm::mat4 viewProjMat = first.scene.camera.viewProjection(masterAspect);
+			glm::mat4 MVPMat = isImage ? viewProjMat * imagePlacement(mesh, viewProjMat, masterAspect) : viewProjMat;
+
+			// lines keep their width at the size of the tallest output
+			RenderStyle style = first.scene.style;
+			if(style.lineSize > 0.f) style.lineSize *= supersample;
+
+			frame->width = width;
+			frame->height = height;
+			frame->rgb.resize(size_t(width) * height * 3);
+			renderer.render(mesh, colors, &MVPMat[0][0], style, width, height, frame->rgb.data());
+
+			renderSeconds += secondsSince(renderStart);
+			++renders;
+
+			frame->pendingVariants = unsigned(task.view.size());
+			for(const BatchJob* job : task.view) variants.push({ frame, job });
+		}
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.renderSeconds += renderSeconds;
+		stats.renders += renders;
+	});
+
+	// A mesh stays loaded until its last task is drawn. Loading runs ahead of the renderers by at
+	// most one mesh each, so a long batch doesn't keep all of its meshes in memory
+	WorkQueue<bool> meshSlots;
+	for(unsigned r = 0; r <= numRenderers; ++r) meshSlots.push(true);
+
+	for(size_t g = 0; g < groups.size(); ++g)
+	{
+		bool slot = false;
+		meshSlots.pop(slot);
+
+		auto loadStart = std::chrono::steady_clock::now();
+		std::shared_ptr<const Mesh> mesh(new Mesh(loadJobMesh(*groups[g].front())), [&meshSlots](const Mesh* mesh)
+			{
+				delete mesh;
+				meshSlots.push(true);
+			});
+		stats.loadSeconds += secondsSince(loadStart);
+
+		if(mesh->indices.empty())
+		{
+			failed += groups[g].size();
+			continue;
+		}
+
+		for(RenderTask& task : groupTasks[g])
+		{
+			task.mesh = mesh;
+			task.meshId = g + 1;
+			tasks.push(std::move(task));
+		}
+	}
+
+	tasks.close();
+	for(auto& renderer : renderers) renderer.join();
+	variants.close();
+	for(auto& encoder : encoders) encoder.join();
+	encodedImages.close();
+	writer.join();
+
+	stats.failed = failed;
+	stats.seconds = secondsSince(batchStart);
+	return stats;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Camera.h"
+#include "Scene.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+// One wallpaper to render. Jobs are read from a batch file, a line per setting:
+//
+//   # the default is "mesh generated 1"
+//   mesh generated 7            (generated patch with this seed)
+//   mesh obj thing.obj
+//   mesh image photo.png        (low-poly image, keeps its own colors)
+//   palette 1d2b53 7e2553 ff004d
+//   seed 3                      (the window starts at 1, Regenerate Random Colors adds one)
+//   camera 0 10 0  0 -1 0  0 0 1   (location, forward, up)
+//   lines 1 000000              (width in pixels and color, or "lines off")
+//   animate 90 30               (frames and frames per second, "animate path 30" for as long as the
+//                               keys go, or "animate off")
+//   key 1.5 0 12 4  0 -1 0  0 0 1   (the camera of an animation that many seconds in, a camera line
+//                               clears the keys)
+//   track flight.track 0.5      (keys from a camera track recorded in the window, at half speed)
+//   fades 2                     (reseeds the colors cross-fade through over the animation)
+//   output 3840 2160 wallpaper.png
+//
+// Settings carry over to everything after them, every output line is a job. Animations are saved
+// as APNGs, or as raw video for outputs ending in .y4m and "-" for stdout, which only one animation
+// can use.
+struct BatchJob
+{
+	enum class MeshKind { generated, obj, image };
+	MeshKind meshKind = MeshKind::generated;
+	// the file for obj and image meshes
+	std::string meshPath;
+	unsigned meshSeed = 1;
+
+	// palette, seed, camera and lines
+	Scene scene;
+
+	// animations have more than one frame. The camera flies along path, or stays at the scene's camera
+	// if it has no keys, while the colors fade from the scene's seed to seed + fades
+	unsigned frames = 1, fps = 30;
+	CameraPath path;
+	unsigned fades = 0;
+
+	std::string output;
+	unsigned width = 0, height = 0;
+};
+
+struct BatchSettings
+{
+	// renderers drawing different images at once, each with its own buffers. 0 makes one per core,
+	// or one per image if there are fewer
+	unsigned renderers = 0;
+	// threads drawing each image, and threads compressing PNGs next to them. 0 picks by the cores,
+	// the cores the renderers leave over
+	unsigned renderThreads = 0, encodeThreads = 0;
+	// master images rendered or being encoded at once, which bounds the memory used. 0 allows
+	// one more than there are renderers and encoders
+	unsigned framesInFlight = 0;
+	// masters are rendered this many times the size of the largest output, and scaled down
+	float supersample = 1.f;
+};
+
+struct BatchStats
+{
+	size_t jobs = 0, failed = 0;
+	double seconds = 0.;
+	// time spent in each stage, summed over its threads
+	double loadSeconds = 0., renderSeconds = 0., resampleSeconds = 0., encodeSeconds = 0., writeSeconds = 0.;
+	// master images and animation frames drawn, fewer than jobs when outputs share a view
+	size_t renders = 0;
+};
+
+// Returns false and prints the offending line if the file can't be read or has an error.
+bool loadBatchFile(const std::string& path, std::vector<BatchJob>& jobs);
+
+// Renders the jobs on the CPU and saves them as PNGs. Jobs sharing a mesh are rendered together,
+// so every mesh is loaded once. Jobs that only differ in size share one master render, each of
+// them is a centered crop of it scaled down with Lanczos, framed exactly like a render of its own.
+// Loading, rendering, scaling with encoding, and writing run on their own threads, each master
+// moves on to the encoders as soon as it is drawn. The renderers take the masters and animations
+// in turn, sharing the meshes. Animations are rendered on their own at their exact size, frame by
+// frame into an ApngWriter or Y4mWriter.
+BatchStats runBatch(const std::vector<BatchJob>& jobs, const BatchSettings& settings);
@@ -0,0 +1,61 @@
+#include "Cache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace
+{
+
+// like mkdir -p
+bool makeDirectories(const std::string& path)
+{
+	for(size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+	{
+		if(mkdir(path.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST) return false;
+		if(slash == std::string::npos) return true;
+	}
+}
+
+const std::string& cacheDir(const std::string& kind)
+{
+	static std::mutex mutex;
+	static std::map<std::string, std::string> dirs;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = dirs.find(kind);
+	if(found != dirs.end()) return found->second;
+
+	std::string base;
+	if(const char* cache = std::getenv("XDG_CACHE_HOME")) base = cache;
+	else if(const char* home = std::getenv("HOME")) base = std::string(home) + "/.cache";
+
+	std::string dir = base.empty() ? std::string() : base + "/wallpaper-gen/" + kind;
+	if(!dir.empty() && !makeDirectories(dir)) dir.clear();
+	return dirs.emplace(kind, dir).first->second;
+}
+
+}
+
+std::string cachePath(const std::string& kind, const std::string& tag, const std::string& extension)
+{
+	const std::string& dir = cacheDir(kind);
+	if(dir.empty()) return std::string();
+
+	// FNV-1a of the tag names the file
+	uint64_t hash = 14695981039346656037ull;
+	for(unsigned char c : tag)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+
+	std::ostringstream path;
+	path << dir << '/' << std::hex << hash << extension;
+	return path.str();
+}
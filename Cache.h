@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The file in $XDG_CACHE_HOME/wallpaper-gen/kind, or ~/.cache/wallpaper-gen/kind, that stands for
+// tag, named after its hash. The directory is made on first use. Empty if it can't be made, then
+// nothing is cached. Files should keep the tag to check it on load, hashes can collide.
+std::string cachePath(const std::string& kind, const std::string& tag, const std::string& extension);
+
+// A size and then the elements, as they are in memory
+template <typename T>
+void writeArray(std::ofstream& file, const std::vector<T>& data)
+{
+	uint64_t size = data.size();
+	file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	file.write(reinterpret_cast<const char*>(data.data()), sizeof(T) * data.size());
+}
+
+template <typename T>
+bool readArray(std::ifstream& file, std::vector<T>& data)
+{
+	uint64_t size = 0;
+	if(!file.read(reinterpret_cast<char*>(&size), sizeof(size))) return false;
+
+	// don't trust the size of a damaged file with the allocation
+	std::streampos start = file.tellg();
+	file.seekg(0, std::ios::end);
+	uint64_t left = uint64_t(file.tellg() - start);
+	file.seekg(start);
+	if(size > left / sizeof(T)) return false;
+
+	data.resize(size_t(size));
+	return bool(file.read(reinterpret_cast<char*>(data.data()), sizeof(T) * data.size()));
+}
@@ -0,0 +1,109 @@
+#include "Camera.h"
+
+#include <algorithm>
+
+#include <glm/gtx/transform.hpp>
+
+glm::mat4 Camera::viewProjection(float aspect) const
+{
+	glm::mat4 viewMat = glm::lookAt(location, location + forward, up);
+	glm::mat4 projectionMat = glm::perspective(50.f, aspect, .1f, 100.f);
+
+	return projectionMat * viewMat;
+}
+
+void CameraPath::add(float time, const Camera& camera)
+{
+	auto at = std::lower_bound(keys.begin(), keys.end(), time, [](const Key& key, float time) { return key.time < time; });
+	if(at != keys.end() && at->time == time) at->camera = camera;
+	else
+	{
+		Key key;
+		key.time = time;
+		key.camera = camera;
+		keys.insert(at, key);
+	}
+}
+
+Camera CameraPath::at(float time) const
+{
+	if(keys.empty()) return Camera();
+	if(time <= keys.front().time) return keys.front().camera;
+	if(time >= keys.back().time) return keys.back().camera;
+
+	size_t next = std::upper_bound(keys.begin(), keys.end(), time, [](float time, const Key& key) { return time < key.time; }) - keys.begin();
+	size_t prev = next - 1;
+
+	// cubic Hermite between the two keys, the tangents from the keys around them, zero at the ends
+	float span = keys[next].time - keys[prev].time;
+	float s = (time - keys[prev].time) / span;
+	float h00 = (1.f + 2.f * s) * (1.f - s) * (1.f - s), h10 = s * (1.f - s) * (1.f - s);
+	float h01 = s * s * (3.f - 2.f * s), h11 = s * s * (s - 1.f);
+
+	auto tangent = [this](size_t i, glm::vec3 Camera::* member)
+	{
+		if(i == 0 || i + 1 == keys.size()) return glm::vec3(0.f);
+		return (keys[i + 1].camera.*member - keys[i - 1].camera.*member) / (keys[i + 1].time - keys[i - 1].time);
+	};
+	auto interpolate = [&](glm::vec3 Camera::* member)
+	{
+		return keys[prev].camera.*member * h00 + tangent(prev, member) * (h10 * span)
+			+ keys[next].camera.*member * h01 + tangent(next, member) * (h11 * span);
+	};
+
+	Camera camera;
+	camera.location = interpolate(&Camera::location);
+	camera.forward = glm::normalize(interpolate(&Camera::forward));
+	camera.up = glm::normalize(interpolate(&Camera::up));
+	return camera;
+}
+
+glm::mat4 imagePlacement(const Mesh& mesh, const glm::mat4& viewProjection, float aspect)
+{
+	if(mesh.positions.empty()) return glm::mat4(1.f);
+
+	// the points include the image's corners
+	glm::vec2 minCorner(mesh.positions[0], mesh.positions[2]), maxCorner = minCorner;
+	for(size_t i = 0; i < mesh.positions.size(); i += 3)
+	{
+		minCorner = glm::min(minCorner, glm::vec2(mesh.positions[i], mesh.positions[i + 2]));
+		maxCorner = glm::max(maxCorner, glm::vec2(mesh.positions[i], mesh.positions[i + 2]));
+	}
+	glm::vec2 imageSize = glm::max(maxCorner - minCorner, glm::vec2(1.f));
+
+	// unproject the corners of the largest centered rectangle with the image's aspect onto the y = 0 plane
+	float imageAspect = imageSize.x / imageSize.y;
+	float extentX = imageAspect > aspect ? 1.f : imageAspect / aspect;
+	float extentY = imageAspect > aspect ? aspect / imageAspect : 1.f;
+
+	glm::mat4 inverseMVP = glm::inverse(viewProjection);
+	bool onPlane = true;
+	auto unproject = [&](float x, float y)
+	{
+		glm::vec4 nearPoint = inverseMVP * glm::vec4(x, y, -1.f, 1.f);
+		glm::vec4 farPoint = inverseMVP * glm::vec4(x, y, 1.f, 1.f);
+		glm::vec3 nearPos = glm::vec3(nearPoint) / nearPoint.w, farPos = glm::vec3(farPoint) / farPoint.w;
+
+		float t = nearPos.y / (nearPos.y - farPos.y);
+		if(!(t >= 0.f && t <= 1.f)) onPlane = false;
+		return nearPos + (farPos - nearPos) * t;
+	};
+	glm::vec3 topLeft = unproject(-extentX, extentY);
+	glm::vec3 right = unproject(extentX, extentY) - topLeft;
+	glm::vec3 down = unproject(-extentX, -extentY) - topLeft;
+
+	if(!onPlane)
+	{
+		float scale = 16.f / std::max(imageSize.x, imageSize.y);
+		right = { -scale * imageSize.x, 0.f, 0.f };
+		down = { 0.f, 0.f, -scale * imageSize.y };
+		topLeft = -(right + down) / 2.f;
+	}
+
+	// pixel x goes along right and pixel y, on z, along down
+	glm::mat4 placement(1.f);
+	placement[0] = glm::vec4(right / imageSize.x, 0.f);
+	placement[2] = glm::vec4(down / imageSize.y, 0.f);
+	placement[3] = glm::vec4(topLeft - right * (minCorner.x / imageSize.x) - down * (minCorner.y / imageSize.y), 1.f);
+	return placement;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Where the wallpaper is seen from. The window starts out looking straight down on the x/z plane.
+struct Camera
+{
+	glm::vec3 location = { 0.f, 10.f, 0.f };
+	glm::vec3 forward = { 0.f, -1.f, 0.f };
+	glm::vec3 up = { 0.f, 0.f, 1.f };
+
+	glm::mat4 viewProjection(float aspect) const;
+};
+
+// A flight through cameras given at points in time. Location, forward and up each follow a Catmull-Rom
+// spline through the keys, starting and stopping at rest, so the camera doesn't jolt as it passes one.
+// Before the first key and after the last the camera holds still.
+struct CameraPath
+{
+	struct Key
+	{
+		float time = 0.f;
+		Camera camera;
+	};
+
+	// sorted by time
+	std::vector<Key> keys;
+
+	// keeps the keys sorted, a key at the same time as another replaces it
+	void add(float time, const Camera& camera);
+	// the default camera if there are no keys
+	Camera at(float time) const;
+	// the time of the last key
+	float duration() const { return keys.empty() ? 0.f : keys.back().time; }
+};
+
+// Model matrix that lays a mesh made in pixels on the x/z plane, like imageMesh's, over what
+// viewProjection sees: the largest centered rectangle with the image's aspect, on the y = 0 plane.
+// If the camera doesn't look at the plane, it covers the generated patch's 16 units at the origin.
+glm::mat4 imagePlacement(const Mesh& mesh, const glm::mat4& viewProjection, float aspect);
@@ -0,0 +1,179 @@
+#include "CameraTrack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+
+const char trackMagic[7] = { 'W', 'G', 'T', 'R', 'A', 'C', 'K' };
+// 2 widened the inputs' values to 32 bits, Qt's key codes for anything but printable keys don't fit 16
+const unsigned char trackVersion = 2;
+
+void putU32(std::vector<unsigned char>& out, uint32_t value)
+{
+	for(int i = 0; i < 4; ++i) out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+void putFloat(std::vector<unsigned char>& out, float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, 4);
+	putU32(out, bits);
+}
+
+// reads from a buffer, every read past the end fails and leaves ok false
+struct Reader
+{
+	const unsigned char* data;
+	size_t size, position = 0;
+	bool ok = true;
+
+	const unsigned char* take(size_t count)
+	{
+		if(!ok || size - position < count)
+		{
+			ok = false;
+			return nullptr;
+		}
+		position += count;
+		return data + position - count;
+	}
+
+	uint32_t u32()
+	{
+		const unsigned char* bytes = take(4);
+		return bytes ? uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24 : 0;
+	}
+
+	uint16_t u16()
+	{
+		const unsigned char* bytes = take(2);
+		return bytes ? uint16_t(bytes[0] | bytes[1] << 8) : 0;
+	}
+
+	unsigned char u8()
+	{
+		const unsigned char* bytes = take(1);
+		return bytes ? bytes[0] : 0;
+	}
+
+	float f32()
+	{
+		uint32_t bits = u32();
+		float value;
+		std::memcpy(&value, &bits, 4);
+		return value;
+	}
+};
+
+}
+
+CameraPath CameraTrack::path(float speed) const
+{
+	CameraPath path;
+	path.keys.reserve(frames.size());
+	for(const Frame& frame : frames) path.add(frame.time / speed, frame.camera);
+	return path;
+}
+
+bool saveCameraTrack(const std::string& path, const CameraTrack& track)
+{
+	std::vector<unsigned char> data(trackMagic, trackMagic + sizeof(trackMagic));
+	data.push_back(trackVersion);
+	putU32(data, uint32_t(track.frames.size()));
+	for(const CameraTrack::Frame& frame : track.frames)
+	{
+		putFloat(data, frame.time);
+		for(const glm::vec3* vector : { &frame.camera.location, &frame.camera.forward, &frame.camera.up })
+		{
+			for(int i = 0; i < 3; ++i) putFloat(data, (*vector)[i]);
+		}
+
+		// a frame holds at most 255 inputs, nobody presses keys that fast
+		size_t numInputs = std::min<size_t>(frame.inputs.size(), 255);
+		data.push_back((unsigned char)numInputs);
+		for(size_t i = 0; i < numInputs; ++i)
+		{
+			const CameraTrack::Input& input = frame.inputs[i];
+			data.push_back(input.type);
+			putU32(data, uint32_t(input.x));
+			putU32(data, uint32_t(input.y));
+		}
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if(!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+	{
+		std::cout << "Failed to save " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool loadCameraTrack(const std::string& path, CameraTrack& track)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if(!file.good() && !file.eof())
+	{
+		std::cout << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	Reader reader{ data.data(), data.size() };
+	const unsigned char* magic = reader.take(sizeof(trackMagic));
+	if(!magic || std::memcmp(magic, trackMagic, sizeof(trackMagic)))
+	{
+		std::cout << path << " isn't a camera track" << std::endl;
+		return false;
+	}
+	unsigned version = reader.u8();
+	if(version < 1 || version > trackVersion)
+	{
+		std::cout << path << " is a camera track of unknown version " << version << std::endl;
+		return false;
+	}
+
+	track.frames.clear();
+	uint32_t numFrames = reader.u32();
+	for(uint32_t f = 0; f < numFrames && reader.ok; ++f)
+	{
+		CameraTrack::Frame frame;
+		frame.time = reader.f32();
+		for(glm::vec3* vector : { &frame.camera.location, &frame.camera.forward, &frame.camera.up })
+		{
+			for(int i = 0; i < 3; ++i) (*vector)[i] = reader.f32();
+		}
+
+		unsigned numInputs = reader.u8();
+		for(unsigned i = 0; i < numInputs && reader.ok; ++i)
+		{
+			CameraTrack::Input input;
+			input.type = CameraTrack::Input::Type(reader.u8());
+			if(version == 1)
+			{
+				input.x = int16_t(reader.u16());
+				input.y = int16_t(reader.u16());
+			}
+			else
+			{
+				input.x = int32_t(reader.u32());
+				input.y = int32_t(reader.u32());
+			}
+			frame.inputs.push_back(input);
+		}
+		track.frames.push_back(std::move(frame));
+	}
+
+	if(!reader.ok)
+	{
+		std::cout << path << " is cut short" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Camera.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A recording of the window's camera, a frame per paint: when it was drawn, where the camera was, and
+// the input that moved it there. Replaying the cameras at a fixed timestep gives the same flight
+// whatever the frame rate was while recording, the input is kept to see what the user did.
+struct CameraTrack
+{
+	struct Input
+	{
+		enum Type : uint8_t { keyPress, keyRelease, drag };
+		Type type = keyPress;
+		// the Qt key for presses and releases, the mouse movement in pixels for drags
+		int32_t x = 0, y = 0;
+	};
+
+	struct Frame
+	{
+		// seconds since the recording started
+		float time = 0.f;
+		Camera camera;
+		std::vector<Input> inputs;
+	};
+
+	std::vector<Frame> frames;
+
+	float duration() const { return frames.empty() ? 0.f : frames.back().time; }
+
+	// The recorded cameras as keys of a path, speed times as fast as they were recorded. Each
+	// recorded frame is exactly on the path.
+	CameraPath path(float speed = 1.f) const;
+};
+
+// The file starts with "WGTRACK" and a version byte, then the number of frames. Every frame is its
+// time and camera as 10 floats, the number of inputs in a byte and 9 bytes per input, the type and
+// two 32 bit values (version 1 tracks, with 16 bit values, still load). Everything is little endian.
+// Both return false and print why if the file can't be read or written.
+bool saveCameraTrack(const std::string& path, const CameraTrack& track);
+bool loadCameraTrack(const std::string& path, CameraTrack& track);
@@ -0,0 +1,154 @@
+#include "ClusterBvh.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+const unsigned noChild = std::numeric_limits<unsigned>::max();
+
+}
+
+void ClusterBvh::build(const Mesh& mesh)
+{
+	nodes.clear();
+	clusterFirst.clear();
+	clusterCount.clear();
+	clusterBounds.clear();
+	numTriangles = mesh.indices.size() / 3;
+	if(numTriangles == 0) return;
+
+	std::vector<unsigned int> starts = mesh.clusters;
+	if(starts.empty()) starts.push_back(0);
+
+	for(size_t cluster = 0; cluster < starts.size(); ++cluster)
+	{
+		unsigned first = starts[cluster] * 3;
+		unsigned end = cluster + 1 < starts.size() ? starts[cluster + 1] * 3 : unsigned(mesh.indices.size());
+		clusterFirst.push_back(first);
+		clusterCount.push_back(end - first);
+
+		float bounds[6] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+			std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(),
+			std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+		for(unsigned i = first; i < end; ++i)
+		{
+			const float* position = &mesh.positions[mesh.indices[i] * 3];
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				bounds[axis] = std::min(bounds[axis], position[axis]);
+				bounds[3 + axis] = std::max(bounds[3 + axis], position[axis]);
+			}
+		}
+		clusterBounds.insert(clusterBounds.end(), bounds, bounds + 6);
+	}
+
+	nodes.reserve(starts.size() * 2);
+	buildNode(0, unsigned(starts.size()));
+}
+
+unsigned ClusterBvh::buildNode(unsigned firstCluster, unsigned numClusters)
+{
+	unsigned index = unsigned(nodes.size());
+	nodes.emplace_back();
+
+	Node node;
+	if(numClusters == 1)
+	{
+		node.cluster = firstCluster;
+		node.children[0] = node.children[1] = noChild;
+		std::copy_n(&clusterBounds[firstCluster * 6], 3, node.min);
+		std::copy_n(&clusterBounds[firstCluster * 6 + 3], 3, node.max);
+	}
+	else
+	{
+		unsigned half = numClusters / 2;
+		node.cluster = noChild;
+		node.children[0] = buildNode(firstCluster, half);
+		node.children[1] = buildNode(firstCluster + half, numClusters - half);
+
+		const Node& left = nodes[node.children[0]];
+		const Node& right = nodes[node.children[1]];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			node.min[axis] = std::min(left.min[axis], right.min[axis]);
+			node.max[axis] = std::max(left.max[axis], right.max[axis]);
+		}
+	}
+
+	nodes[index] = node;
+	return index;
+}
+
+void ClusterBvh::cull(const float* viewProjection, DrawRanges& out) const
+{
+	out.firstIndices.clear();
+	out.indexCounts.clear();
+	out.stats = CullStats();
+	if(nodes.empty()) return;
+
+	// the frustum planes are sums and differences of the matrix rows (Gribb and Hartmann),
+	// a point is inside when it's on the positive side of all six
+	auto row = [&](int r, int c) { return viewProjection[c * 4 + r]; };
+	float planes[6][4];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		for(int c = 0; c < 4; ++c)
+		{
+			planes[axis * 2][c] = row(3, c) + row(axis, c);
+			planes[axis * 2 + 1][c] = row(3, c) - row(axis, c);
+		}
+	}
+
+	cullNode(0, planes, false, out);
+
+	out.stats.culledClusters = unsigned(clusterFirst.size()) - out.stats.visibleClusters;
+	out.stats.culledTriangles = numTriangles - out.stats.visibleTriangles;
+}
+
+void ClusterBvh::cullNode(unsigned index, const float (*planes)[4], bool inside, DrawRanges& out) const
+{
+	const Node& node = nodes[index];
+
+	// the box corner furthest along each plane's normal decides if the box is outside,
+	// the nearest one if it's completely inside and its children don't need testing
+	if(!inside)
+	{
+		inside = true;
+		for(int plane = 0; plane < 6; ++plane)
+		{
+			const float* p = planes[plane];
+			float farthest = p[3], nearest = p[3];
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				farthest += p[axis] * (p[axis] > 0.f ? node.max[axis] : node.min[axis]);
+				nearest += p[axis] * (p[axis] > 0.f ? node.min[axis] : node.max[axis]);
+			}
+			if(farthest < 0.f) return;
+			if(nearest < 0.f) inside = false;
+		}
+	}
+
+	if(node.cluster == noChild)
+	{
+		cullNode(node.children[0], planes, inside, out);
+		cullNode(node.children[1], planes, inside, out);
+		return;
+	}
+
+	unsigned first = clusterFirst[node.cluster], count = clusterCount[node.cluster];
+	++out.stats.visibleClusters;
+	out.stats.visibleTriangles += count / 3;
+
+	// leaves are visited in cluster order, so a visible neighbour ends right where this one starts
+	if(!out.firstIndices.empty() && out.firstIndices.back() + out.indexCounts.back() == first)
+	{
+		out.indexCounts.back() += count;
+	}
+	else
+	{
+		out.firstIndices.push_back(first);
+		out.indexCounts.push_back(count);
+	}
+}
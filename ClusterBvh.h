@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+struct CullStats
+{
+	unsigned visibleClusters = 0, culledClusters = 0;
+	size_t visibleTriangles = 0, culledTriangles = 0;
+};
+
+// Ranges of the index buffer to draw, neighbouring visible clusters merged into one range.
+struct DrawRanges
+{
+	std::vector<unsigned> firstIndices, indexCounts;
+	CullStats stats;
+};
+
+// Bounding volume hierarchy over the clusters of a mesh. The clusters follow a Morton curve, so
+// halving the list of them gives compact boxes without any sorting.
+class ClusterBvh
+{
+public:
+	// a mesh without clusters is a single one
+	void build(const Mesh& mesh);
+
+	// Collects the clusters whose bounding boxes reach into the view frustum of viewProjection,
+	// a column major matrix as glm stores it. Safe to call from several threads at once.
+	void cull(const float* viewProjection, DrawRanges& out) const;
+
+private:
+	struct Node
+	{
+		float min[3], max[3];
+		// leaves hold one cluster, inner nodes have two children
+		unsigned cluster;
+		unsigned children[2];
+	};
+
+	unsigned buildNode(unsigned firstCluster, unsigned numClusters);
+	void cullNode(unsigned node, const float (*planes)[4], bool inside, DrawRanges& out) const;
+
+	std::vector<Node> nodes;
+	// per cluster, in indices
+	std::vector<unsigned> clusterFirst, clusterCount;
+	std::vector<float> clusterBounds;
+	size_t numTriangles = 0;
+};
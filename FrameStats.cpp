@@ -0,0 +1,70 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+FrameStats::FrameStats(size_t window)
+	: window(std::max<size_t>(window, 1))
+{
+	times.reserve(this->window);
+}
+
+void FrameStats::add(double seconds)
+{
+	if(times.size() < window) times.push_back(seconds);
+	else times[next] = seconds;
+	next = (next + 1) % window;
+}
+
+FrameStats::Summary FrameStats::summary() const
+{
+	Summary summary;
+	summary.frames = times.size();
+	if(times.empty()) return summary;
+
+	std::vector<double> sorted = times;
+	auto percentile = [&](double fraction)
+	{
+		size_t rank = std::min(sorted.size() - 1, size_t(std::ceil(fraction * sorted.size())) - 1);
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+		return sorted[rank] * 1000.;
+	};
+	summary.p50 = percentile(.5);
+	summary.p95 = percentile(.95);
+	summary.p99 = percentile(.99);
+	summary.max = *std::max_element(sorted.begin(), sorted.end()) * 1000.;
+	return summary;
+}
+
+std::vector<size_t> FrameStats::histogram(double binMilliseconds, size_t bins) const
+{
+	std::vector<size_t> counts(bins);
+	if(bins == 0) return counts;
+
+	for(double seconds : times)
+	{
+		size_t bin = size_t(std::max(seconds * 1000. / binMilliseconds, 0.));
+		++counts[std::min(bin, bins - 1)];
+	}
+	return counts;
+}
+
+bool FrameStats::writeCsv(const std::string& path, double binMilliseconds) const
+{
+	double slowest = times.empty() ? 0. : *std::max_element(times.begin(), times.end()) * 1000.;
+	std::vector<size_t> counts = histogram(binMilliseconds, size_t(slowest / binMilliseconds) + 1);
+
+	std::ofstream file(path);
+	file << "from_ms,to_ms,frames\n";
+	for(size_t bin = 0; bin < counts.size(); ++bin)
+		file << bin * binMilliseconds << "," << (bin + 1) * binMilliseconds << "," << counts[bin] << "\n";
+
+	if(!file)
+	{
+		std::cout << "Failed to save " << path << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The times of the last frames drawn, to tell how smoothly the window runs. Percentiles say more
+// than an average: a steady 16 ms and a 10 ms that stutters to 50 every second look alike in fps.
+class FrameStats
+{
+public:
+	// how many of the latest frames count
+	explicit FrameStats(size_t window = 600);
+
+	void add(double seconds);
+
+	// in milliseconds, nearest rank percentiles over the window
+	struct Summary
+	{
+		size_t frames = 0;
+		double p50 = 0., p95 = 0., p99 = 0., max = 0.;
+	};
+	Summary summary() const;
+
+	// frames per bin of binMilliseconds, starting at 0. The last bin also holds every slower frame
+	std::vector<size_t> histogram(double binMilliseconds, size_t bins) const;
+
+	// Writes the histogram as "from_ms,to_ms,frames" rows, up to the slowest frame. Returns false and
+	// prints why if the file can't be written.
+	bool writeCsv(const std::string& path, double binMilliseconds = 1.) const;
+
+private:
+	// seconds, a ring once it's full
+	std::vector<double> times;
+	size_t window, next = 0;
+};
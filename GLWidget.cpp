@@ -1,16 +1,41 @@
 #include "GLWidget.h"
 
-#include "tiny_obj_loader.h"
+#include "Camera.h"
+#include "MeshOps.h"
+#include "MeshSource.h"
+#include "Palette.h"
+#include "ProgramCache.h"
+#include "Shaders.h"
+#include "Simplify.h"
 #include "lodepng.h"
+#include "ImageOps.h"
 
 #include "Window.h"
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <future>
 
 #include <glm/gtx/transform.hpp>
 #include <QApplication>
+#include <QOpenGLExtraFunctions>
+#include <QPainter>
+#include <QStatusBar>
 
+namespace
+{
+
+// compiler and linker messages, a successful build has none to show
+void printInfoLog(const std::string& log)
+{
+	std::cout << log;
+	if(!log.empty() && log.back() != '\n') std::cout << '\n';
+	std::cout << std::flush;
+}
+
+}
 
 GLWidget::GLWidget ( Window* parent, Qt::WindowFlags f ) : QOpenGLWidget ( nullptr, f ), owningWindow(parent)
 {
@@ -33,6 +58,12 @@ GLWidget::GLWidget ( Window* parent, Qt::WindowFlags f ) : QOpenGLWidget ( nullp
 	
 }
 
+GLWidget::~GLWidget()
+{
+	// don't keep the window waiting on levels of detail nobody will see
+	if(cancelLevels) *cancelLevels = true;
+}
+
 bool GLWidget::event (QEvent* event)
 {
 
@@ -67,12 +98,13 @@ bool GLWidget::event (QEvent* event)
 				glm::ivec2 currentMouse = { mousePressEvent->x(), mousePressEvent->y() };
 				
 				glm::ivec2 deltaMouse = currentMouse - lastMousePos;
+				recordInput(CameraTrack::Input::drag, deltaMouse.x, deltaMouse.y);
 				
-				auto forVecIntX = glm::rotate((float)deltaMouse.x / 1000.f, glm::vec3{0.f, 0.f, 1.f}) * glm::vec4(forwardVector, 0.f);
-				forwardVector = {forVecIntX.x, forVecIntX.y, forVecIntX.z};
+				auto forVecIntX = glm::rotate((float)deltaMouse.x / 1000.f, glm::vec3{0.f, 0.f, 1.f}) * glm::vec4(scene.camera.forward, 0.f);
+				scene.camera.forward = {forVecIntX.x, forVecIntX.y, forVecIntX.z};
 				
-				auto forVecIntY = glm::rotate(-(float)deltaMouse.y / 1000.f, glm::vec3{1.f, 0.f, 0.f}) * glm::vec4(forwardVector, 0.f);
-				forwardVector = {forVecIntY.x, forVecIntY.y, forVecIntY.z};
+				auto forVecIntY = glm::rotate(-(float)deltaMouse.y / 1000.f, glm::vec3{1.f, 0.f, 0.f}) * glm::vec4(scene.camera.forward, 0.f);
+				scene.camera.forward = {forVecIntY.x, forVecIntY.y, forVecIntY.z};
 				
 				lastMousePos = currentMouse;
 				
@@ -87,11 +119,6 @@ bool GLWidget::event (QEvent* event)
 }
 
 
-std::array<float, 3> fromRGB(unsigned char r, unsigned char g, unsigned char b)
-{
-	return{ (float)r / 255.f, (float)g / 255.f, (float)b / 255.f };
-}
-
 void GLWidget::markForRegeneration()
 {
 	needsRegenerate = true;
@@ -108,20 +135,199 @@ void GLWidget::markForColorRefresh()
 	needsColorRefresh = true;
 }
 
+void GLWidget::markForImageLoad(const QString& imagePath)
+{
+	needsImageLoad = true;
+	this->imagePath = imagePath;
+}
+
+void GLWidget::markForGeneratedMesh()
+{
+	needsGeneratedMesh = true;
+}
+
+void GLWidget::startRecording()
+{
+	recording = true;
+	track.frames.clear();
+	pendingInputs.clear();
+}
+
+void GLWidget::stopRecording()
+{
+	recording = false;
+}
+
+void GLWidget::saveRecording(const QString& trackPath)
+{
+	if(saveCameraTrack(trackPath.toStdString(), track))
+		std::cout << "Saved " << track.frames.size() << " frames, " << track.duration() << "s of camera track" << std::endl;
+}
+
+void GLWidget::markForReplay(const QString& trackPath)
+{
+	needsReplay = true;
+	replayPath = trackPath;
+}
+
+void GLWidget::saveFrameStats(const QString& csvPath)
+{
+	frameStats.writeCsv(csvPath.toStdString());
+}
+
+void GLWidget::drawFrameStats()
+{
+	FrameStats::Summary summary = frameStats.summary();
+	std::vector<size_t> counts = frameStats.histogram(1., 50);
+	size_t tallest = std::max<size_t>(*std::max_element(counts.begin(), counts.end()), 1);
+	
+	const int margin = 8, barWidth = 4, graphHeight = 60, textHeight = 48;
+	int graphWidth = barWidth * (int)counts.size();
+	
+	QPainter painter(this);
+	painter.fillRect(margin, margin, graphWidth + 2 * margin, textHeight + graphHeight + 3 * margin, QColor(0, 0, 0, 160));
+	
+	painter.setPen(Qt::white);
+	painter.drawText(QRect(2 * margin, 2 * margin, graphWidth, textHeight), Qt::AlignLeft | Qt::AlignTop,
+		QString("p50 %1 ms   p95 %2 ms\np99 %3 ms   max %4 ms\nlast %5 frames, 1 ms a bar")
+			.arg(summary.p50, 0, 'f', 1).arg(summary.p95, 0, 'f', 1).arg(summary.p99, 0, 'f', 1)
+			.arg(summary.max, 0, 'f', 1).arg(summary.frames));
+	
+	// green bars make 60 fps, yellow 30, the last one holds everything slower
+	int graphBottom = 3 * margin + textHeight + graphHeight;
+	for(size_t bin = 0; bin < counts.size(); ++bin)
+	{
+		int barHeight = (int)(counts[bin] * graphHeight / tallest);
+		QColor color = bin < 17 ? QColor(80, 220, 80) : bin < 33 ? QColor(230, 210, 60) : QColor(230, 70, 60);
+		painter.fillRect(2 * margin + (int)bin * barWidth, graphBottom - barHeight, barWidth - 1, barHeight, color);
+	}
+}
+
+void GLWidget::startTrace()
+{
+	profiler.startTrace();
+}
+
+void GLWidget::stopTrace()
+{
+	profiler.stopTrace();
+}
+
+void GLWidget::saveTrace(const QString& jsonPath)
+{
+	profiler.writeTrace(jsonPath.toStdString());
+}
+
+void GLWidget::drawProfile()
+{
+	std::vector<Profiler::Phase> phases = profiler.phases();
+	
+	const int margin = 8, lineHeight = 16, panelWidth = 200;
+	int panelHeight = lineHeight * ((int)phases.size() + 1) + 2 * margin;
+	int left = width() - panelWidth - margin;
+	
+	QPainter painter(this);
+	painter.fillRect(left, margin, panelWidth, panelHeight, QColor(0, 0, 0, 160));
+	painter.setPen(Qt::white);
+	painter.drawText(left + margin, margin + lineHeight, QString("ms per frame, %1 frames").arg(profiler.framesPerAverage));
+	
+	// the CPU's phases first, then what the GPU spent on them
+	int line = 2;
+	for(bool gpu : { false, true })
+	{
+		for(const Profiler::Phase& phase : phases)
+		{
+			if(phase.gpu != gpu) continue;
+			int y = margin + lineHeight * line++;
+			painter.drawText(left + margin, y, QString("%1 %2").arg(gpu ? "gpu" : "cpu").arg(phase.name));
+			painter.drawText(QRect(left, y - lineHeight, panelWidth - margin, lineHeight + 4), Qt::AlignRight | Qt::AlignBottom,
+				QString::number(phase.milliseconds, 'f', 2));
+		}
+	}
+}
+
+void GLWidget::beginGpuPhase(const char* name)
+{
+	if(!gpuTiming) return;
+	
+	GpuFrame& frame = gpuFrames[gpuFrame];
+	size_t phase = frame.names.size();
+	if(frame.queries.size() < 2 * (phase + 1))
+	{
+		GLuint pair[2];
+		glGenQueries(2, pair);
+		frame.queries.insert(frame.queries.end(), pair, pair + 2);
+	}
+	
+	frame.names.push_back(name);
+	glQueryCounter(frame.queries[2 * phase], GL_TIMESTAMP);
+	openGpuPhases.push_back(phase);
+}
+
+void GLWidget::endGpuPhase()
+{
+	if(openGpuPhases.empty()) return;
+	
+	glQueryCounter(gpuFrames[gpuFrame].queries[2 * openGpuPhases.back() + 1], GL_TIMESTAMP);
+	openGpuPhases.pop_back();
+}
 
+void GLWidget::collectGpuTimes()
+{
+	// the oldest frame, done on the GPU by now
+	openGpuPhases.clear();
+	gpuFrame = (gpuFrame + 1) % gpuFrames.size();
+	GpuFrame& frame = gpuFrames[gpuFrame];
+	for(size_t phase = 0; phase < frame.names.size(); ++phase)
+	{
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[2 * phase], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[2 * phase + 1], GL_QUERY_RESULT, &end);
+		profiler.add(frame.names[phase], true, frame.cpuTime + ((double)begin - (double)frame.gpuTime) / 1000., (double)(end - begin) / 1000.);
+	}
+	frame.names.clear();
+	
+	// timer queries only run while someone looks at them
+	gpuTiming = showProfile || profiler.tracing();
+	if(!gpuTiming) return;
+	
+	glGetInteger64v(GL_TIMESTAMP, &frame.gpuTime);
+	frame.cpuTime = Profiler::now();
+}
 
+void GLWidget::recordInput(CameraTrack::Input::Type type, int x, int y)
+{
+	if(!recording) return;
+	
+	CameraTrack::Input input;
+	input.type = type;
+	input.x = x;
+	input.y = y;
+	pendingInputs.push_back(input);
+}
 
-std::array<float, 3> fromHex(uint32_t color)
+void GLWidget::loadReplay()
 {
- return fromRGB(color >> 24, color << 8 >> 24, color << 16 >> 24);
+	CameraTrack replayTrack;
+	if(!loadCameraTrack(replayPath.toStdString(), replayTrack) || replayTrack.frames.empty()) return;
+	
+	replay = replayTrack.path();
+	replayTime = 0.f;
+	replaying = true;
 }
 
 
 
 
+
+
+
+
 void GLWidget::keyPressEvent ( QKeyEvent* event )
 {
 	QWidget::keyPressEvent ( event );
+	
+	recordInput(CameraTrack::Input::keyPress, event->key(), 0);
 		
 	switch(event->key())
 	{
@@ -139,6 +345,10 @@ void GLWidget::keyPressEvent ( QKeyEvent* event )
 		velocity.y -= speed; break;
 	case Qt::Key_F:
 		owningWindow->setFixedSize(4096, 2304); break;
+	case Qt::Key_H:
+		showFrameStats = !showFrameStats; break;
+	case Qt::Key_P:
+		showProfile = !showProfile; break;
 	}
 	
 	
@@ -146,6 +356,8 @@ void GLWidget::keyPressEvent ( QKeyEvent* event )
 
 void GLWidget::keyReleaseEvent ( QKeyEvent* event )
 {
+	recordInput(CameraTrack::Input::keyRelease, event->key(), 0);
+	
 	switch(event->key())
 	{
 	case Qt::Key_Q:
@@ -171,78 +383,80 @@ void GLWidget::initializeGL()
 	initializeOpenGLFunctions();
 	
 	
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> mats;
-
-	std::string error;
-
-	// load model
-	tinyobj::LoadObj(shapes, mats, error, "thing.obj");
-
-	if (!shapes.size())
-	{
-		std::cout << error << std::endl;
-
-        std::cin.get();
-	}
-
-
-
-	tinyobj::mesh_t& mesh = shapes[0].mesh;
-
-	numElements = mesh.indices.size();
-	numVerts = mesh.positions.size() / 3;
-
 	//setup buffer
 	glGenVertexArrays(1, &vertArray);
 	glBindVertexArray(vertArray);
 
+	// generate model
+	loadGeneratedMesh();
+	
+	glProvokingVertex(GL_LAST_VERTEX_CONVENTION);
+	
+	// the first frame moves from here, not from whenever the clock started
+	lastTickTime = std::chrono::steady_clock::now();
+}
 
-	glGenBuffers(1, &vertLocs);
-	glBindBuffer(GL_ARRAY_BUFFER, vertLocs);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * mesh.positions.size(), mesh.positions.data(), GL_STATIC_DRAW);
-
-	glGenBuffers(1, &indicies);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicies);
-
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
-
-
-
-	glGenBuffers(1, &colors);
-	glBindBuffer(GL_ARRAY_BUFFER, colors);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * mesh.positions.size(), 0, GL_STATIC_DRAW);
-	regenerate();
+const GLWidget::ShaderProgram& GLWidget::shaderProgram(unsigned features)
+{
+	auto found = shaderPrograms.find(features);
+	if(found != shaderPrograms.end()) return found->second;
+	
+	ShaderSources sources = shaderSources(features);
+	ShaderProgram variant;
+	variant.program = loadProgram(sources.vertex.c_str(), sources.fragment.c_str());
+	variant.MVP = glGetUniformLocation(variant.program, "MVP");
+	variant.lineColor = glGetUniformLocation(variant.program, "lineColor");
+	return shaderPrograms.emplace(features, variant).first->second;
+}
 
-	// load shader
-	auto vertShader =
-		"#version 330 core\n"
-		"layout(location = 0) in vec3 vertLocationIn;\n"
-		"layout(location = 1) in vec3 vertColors;\n"
-		"uniform mat4 MVP;\n"
-		"\n"
-		"out vec3 color;\n"
-		"\n"
-		"void main()\n"
-		"{\n"
-		"	gl_Position = MVP * vec4(vertLocationIn, 1.f);\n"
-		"	\n"
-		"	color = vertColors;\n"
-		"}\n";
-
-	auto fragShader =
-		"#version 330 core\n"
-		"in vec3 color;\n"
-		"uniform int isRender = 0;\n"
-		"out vec3 fragColor;\n"
-		"uniform vec3 lineColor;"
-		"void main()\n"
-		"{\n"
-		"	fragColor = isRender != 0 ? lineColor : color;\n"
-		"}\n";
+GLuint GLWidget::loadProgram(const char* vertSource, const char* fragSource)
+{
+	ProfileScope scope(profiler, "load program");
+	
+	// binaries come with GL 4.1 or the extension, and only some drivers offer any format
+	GLint numFormats = 0;
+	QOpenGLContext* glContext = context();
+	if(glContext->format().version() >= qMakePair(4, 1) || glContext->hasExtension("GL_ARB_get_program_binary"))
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	if(numFormats <= 0) return compileProgram(vertSource, fragSource, false);
+	
+	QOpenGLExtraFunctions* extra = glContext->extraFunctions();
+	std::string tag = programCacheTag({ vertSource, fragSource }, reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+		reinterpret_cast<const char*>(glGetString(GL_RENDERER)), reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+	
+	ProgramBinary binary;
+	if(loadProgramBinary(tag, binary))
+	{
+		GLuint program = glCreateProgram();
+		extra->glProgramBinary(program, binary.format, binary.data.data(), (GLsizei)binary.data.size());
+		
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if(linked) return program;
+		
+		// a driver update may refuse what the old one wrote, compiling writes a new one
+		glDeleteProgram(program);
+		std::cout << "The driver rejected the cached shader program, compiling it" << std::endl;
+	}
+	
+	GLuint program = compileProgram(vertSource, fragSource, true);
+	
+	GLint linked = GL_FALSE, length = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(!linked || length <= 0) return program;
+	
+	GLenum format = 0;
+	binary.data.resize(length);
+	extra->glGetProgramBinary(program, length, nullptr, &format, binary.data.data());
+	binary.format = format;
+	if(!saveProgramBinary(tag, binary)) std::cout << "Failed to cache the shader program" << std::endl;
+	
+	return program;
+}
 
+GLuint GLWidget::compileProgram(const char* vertSource, const char* fragSource, bool retrievable)
+{
 	// Create the shaders
 	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
 	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -250,7 +464,7 @@ void GLWidget::initializeGL()
 	int32_t Result = GL_FALSE;
 	int InfoLogLength;
 
-	glShaderSource(vertexShader, 1, &vertShader, nullptr);
+	glShaderSource(vertexShader, 1, &vertSource, nullptr);
 	glCompileShader(vertexShader);
 
 	// Check Vertex Shader
@@ -259,15 +473,11 @@ void GLWidget::initializeGL()
 	if (InfoLogLength > 1) {
 		auto VertexShaderErrorMessage = std::vector<char>(InfoLogLength + 1);
 		glGetShaderInfoLog(vertexShader, InfoLogLength, nullptr, VertexShaderErrorMessage.data());
-		std::cout << VertexShaderErrorMessage.data();
-	}
-	else
-	{
-		std::cout << "\tShader Successfully Compiled";
+		printInfoLog(VertexShaderErrorMessage.data());
 	}
 
 	// Compile Fragment Shader
-	glShaderSource(fragmentShader, 1, &fragShader, nullptr);
+	glShaderSource(fragmentShader, 1, &fragSource, nullptr);
 	glCompileShader(fragmentShader);
 
 	// Check Fragment Shader
@@ -276,16 +486,12 @@ void GLWidget::initializeGL()
 	if (InfoLogLength > 1) {
 		auto FragmentShaderErrorMessage = std::vector<char>(InfoLogLength + 1);
 		glGetShaderInfoLog(fragmentShader, InfoLogLength, nullptr, FragmentShaderErrorMessage.data());
-		std::cout << FragmentShaderErrorMessage.data();
-	}
-	else
-	{
-		std::cout << "\tShader Successfully Compiled";
+		printInfoLog(FragmentShaderErrorMessage.data());
 	}
 
 	// Link the program
-	std::cout << "\tLinking program ";
-	program = glCreateProgram();
+	GLuint program = glCreateProgram();
+	if(retrievable) context()->extraFunctions()->glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(program, vertexShader);
 	glAttachShader(program, fragmentShader);
 	glLinkProgram(program);
@@ -296,160 +502,449 @@ void GLWidget::initializeGL()
 	if (InfoLogLength > 1) {
 		auto ProgramErrorMessage = std::vector<char>(InfoLogLength + 1);
 		glGetProgramInfoLog(program, InfoLogLength, nullptr, ProgramErrorMessage.data());
-		std::cout << ProgramErrorMessage.data();
+		printInfoLog(ProgramErrorMessage.data());
 	}
 
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
-
-	std::cout << "\tSuccessfully Linked Program.";
-
 	
-	glEnable(GL_DEPTH_TEST);
+	return program;
 }
 
 void GLWidget::paintGL()
 {
 	QOpenGLWidget::paintGL();
+	
+	double frameStart = Profiler::now();
+	collectGpuTimes();
 
-	std::chrono::time_point<std::chrono::system_clock> currentTickTime = std::chrono::system_clock::now();
+	std::chrono::steady_clock::time_point currentTickTime = std::chrono::steady_clock::now();
 	
-	std::chrono::duration<double> deltaDuration = currentTickTime - lastTickTime;
+	std::chrono::duration<float> deltaDuration = currentTickTime - lastTickTime;
 	float deltaTime = deltaDuration.count();
 	lastTickTime = currentTickTime;
+	frameStats.add(deltaTime);
 	
+	// apply velocity in fixed steps. After a stall the camera only catches up on a quarter second
+	simulationLag += std::min(deltaTime, .25f);
+	while(simulationLag >= simulationStep)
+	{
+		previousStepLocation = stepLocation;
+		stepLocation += velocity.y * simulationStep * scene.camera.forward;
+		stepLocation += velocity.x * simulationStep * glm::cross(scene.camera.forward, scene.camera.up);
+		simulationLag -= simulationStep;
+	}
+	float stepBlend = simulationLag / simulationStep;
+	scene.camera.location = previousStepLocation + (stepLocation - previousStepLocation) * stepBlend;
 	
-	deltaTime = fabs(deltaTime);
+	if(needsReplay) loadReplay();
+	needsReplay = false;
 	
-	// apply velocity
-	location += velocity.y * deltaTime * forwardVector;
-	location += velocity.x * deltaTime * glm::cross(forwardVector, upVector);
+	// a replay takes the camera over, at the same step however long this frame took
+	if(replaying)
+	{
+		scene.camera = replay.at(replayTime);
+		previousStepLocation = stepLocation = scene.camera.location;
+		
+		replaying = replayTime < replay.duration();
+		replayTime += replayStep;
+	}
+	
+	if(recording)
+	{
+		CameraTrack::Frame frame;
+		frame.time = track.frames.empty() ? 0.f : track.frames.back().time + deltaTime;
+		frame.camera = scene.camera;
+		frame.inputs.swap(pendingInputs);
+		track.frames.push_back(std::move(frame));
+	}
 	
+	// the frame stats overlay paints with QPainter, which leaves its own state behind
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	
+	beginGpuPhase("frame");
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
-	if(needsRegenerate) regenerate();
-	needsRegenerate = false;
+	receiveLevels();
 	
-	if(needsColorRefresh)
-	{
-		lastSeed--;
-		regenerate();
-		needsColorRefresh = false;
-	}
+	// new picks, or the same picks out of a changed palette
+	if(needsRegenerate) ++scene.seed;
+	if(needsRegenerate || needsColorRefresh) regenerate();
+	needsRegenerate = needsColorRefresh = false;
+	
+	if(needsImageLoad) loadLowPolyImage();
+	needsImageLoad = false;
+	
+	if(needsGeneratedMesh) loadGeneratedMesh();
+	needsGeneratedMesh = false;
 	
 	glBindVertexArray(vertArray);
+	
+	// while moving, the finest level of detail within the budget. Saves always get full detail
+	bool moving = velocity != glm::vec3(0.f) || isMouseDown || replaying;
+	drawnLevel = 0;
+	if(moving && !needsSave)
+	{
+		while(drawnLevel + 1 < levels.size() && levels[drawnLevel].numElements / 3 > movingTriangleBudget) ++drawnLevel;
+	}
+	const MeshBuffers& level = levels[drawnLevel];
 
 	
 	// render!
-	glm::mat4 viewMat = glm::lookAt(location, location + forwardVector, upVector);
-	glm::mat4 projectionMat = glm::perspective(50.f, (float)width() / height(), .1f, 100.f);
-
-	glm::mat4 MVPMat = projectionMat * viewMat;
-
-	glm::vec4 a = MVPMat * glm::vec4(-62.8301315, 0.548247993, 51.5535278, 1);
-
+	glm::mat4 viewProjMat = viewProjection();
+	glm::mat4 MVPMat = viewProjMat * level.modelMat;
+	
+	// culling takes microseconds, a thread to overlap it with the setup would cost more than it saves
+	{
+		ProfileScope scope(profiler, "cull");
+		level.bvh.cull(&viewProjMat[0][0], drawRanges);
+	}
+	showCullStats();
 
-    glUseProgram(program);
 
-    auto MVPUni = glGetUniformLocation(program, "MVP");
-    glUniformMatrix4fv(MVPUni, 1, GL_FALSE, &MVPMat[0][0]);
+	// the faces in their own colors, then the edges in the line color, each with the shader variant made for it
+	const ShaderProgram& faceProgram = shaderProgram(0);
+	glUseProgram(faceProgram.program);
+	glUniformMatrix4fv(faceProgram.MVP, 1, GL_FALSE, &MVPMat[0][0]);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vertLocs);
+	glBindBuffer(GL_ARRAY_BUFFER, level.positions);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+	if(level.positionsQuantized)
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(uint16_t) * 4, nullptr);
+	else
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
 
 
-	glBindBuffer(GL_ARRAY_BUFFER, colors);
+	glBindBuffer(GL_ARRAY_BUFFER, level.colors);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
 
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-	glUniform1i(glGetUniformLocation(program, "isRender"), GL_FALSE);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicies);
-	glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.indices);
+	
+	GLenum indexType = level.indexType;
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+	drawCounts.clear();
+	drawOffsets.clear();
+	for(size_t range = 0; range < drawRanges.firstIndices.size(); ++range)
+	{
+		drawCounts.push_back(drawRanges.indexCounts[range]);
+		drawOffsets.push_back(reinterpret_cast<const GLvoid*>(drawRanges.firstIndices[range] * indexSize));
+	}
+	
+	if(!drawCounts.empty())
+	{
+		ProfileScope scope(profiler, "faces");
+		beginGpuPhase("faces");
+		glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), drawCounts.size());
+		endGpuPhase();
+	}
 
-	glLineWidth(lineSize);
+	glLineWidth(scene.style.lineSize);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glUniform1i(glGetUniformLocation(program, "isRender"), GL_TRUE);
-	glm::vec3 lineColorVec3 = {(float)lineColor.red() / 255.f, (float)lineColor.green() / 255.f, (float)lineColor.blue() / 255.f};
-	glUniform3fv(glGetUniformLocation(program, "lineColor"), 1, &lineColorVec3.x);
 
-	if(lineSize != -1.f)	
-		glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, nullptr);
+	if(scene.style.lineSize != -1.f && !drawCounts.empty())
+	{
+		const ShaderProgram& edgeProgram = shaderProgram(shaderLineColor);
+		glUseProgram(edgeProgram.program);
+		glUniformMatrix4fv(edgeProgram.MVP, 1, GL_FALSE, &MVPMat[0][0]);
+		glUniform3fv(edgeProgram.lineColor, 1, scene.style.lineColor.data());
+		
+		ProfileScope scope(profiler, "edges");
+		beginGpuPhase("edges");
+		glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), drawCounts.size());
+		endGpuPhase();
+	}
 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
+	endGpuPhase();
 
 	if(needsSave) saveImageOut();
 	needsSave = false;
 	
+	profiler.add("frame", false, frameStart, Profiler::now() - frameStart);
+	profiler.endFrame();
+	
+	if(showFrameStats) drawFrameStats();
+	if(showProfile) drawProfile();
 }
 
 void GLWidget::regenerate()
 {
-	// get colors
-	auto& list = owningWindow->allColors;
+	ProfileScope scope(profiler, "regenerate");
 	
-	std::vector<std::array<float, 3>> colorsToChooseFrom;
+	if(levels.empty()) return;
 	
-	for(size_t itemID = 0; itemID < list.count(); ++itemID)
+	// a low-poly image keeps the colors of its photo
+	if(!levels[0].fixedColors.empty())
 	{
-		auto listItem = list.item(itemID);
-		auto color = listItem->backgroundColor();
+		for(MeshBuffers& level : levels) uploadColors(level);
+		return;
+	}
+	
+	// one pick per vertex. Every vertex provokes at most one face, so each face gets its own pick
+	paletteColors = scene.paletteColors(levels[0].numVerts);
+
+	for(MeshBuffers& level : levels) uploadColors(level);
+}
+
+void GLWidget::saveImageOut()
+{
+	ProfileScope scope(profiler, "save");
+	
+	const unsigned imageWidth = width(), imageHeight = height();
+	
+	// read back in bands so neither the readback nor the encoder ever holds the whole image
+	const unsigned bandRows = 64;
+	
+	std::vector<GLubyte> bandData(imageWidth * bandRows * 4);
+	std::vector<unsigned char> rowData(imageWidth * 3);
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
+	
+	
+    glReadBuffer(GL_FRONT);
+	
+	lodepng::StreamEncoder encoder;
+	unsigned error = encoder.begin(savePath.toStdString(), imageWidth, imageHeight, LCT_RGB, 8);
+	
+	// GL rows are bottom-up: walk the bands from the top of the image down and feed
+	// each band's rows to the encoder in reverse, dropping the opaque alpha on the way
+	for(unsigned bandTop = imageHeight; bandTop > 0 && !error; )
+	{
+		unsigned rows = std::min(bandRows, bandTop);
+		unsigned bandBottom = bandTop - rows;
+		
+		{
+			ProfileScope readbackScope(profiler, "readback");
+			glReadPixels(0, bandBottom, imageWidth, rows, GL_RGBA, GL_UNSIGNED_BYTE, bandData.data());
+		}
+		
+		ProfileScope encodeScope(profiler, "encode");
+		for(unsigned row = rows; row > 0 && !error; --row)
+		{
+			rowRGBAToRGB(rowData.data(), bandData.data() + (row - 1) * imageWidth * 4, imageWidth);
+			error = encoder.writeRows(rowData.data(), 1);
+		}
 		
-		colorsToChooseFrom.emplace_back(fromRGB(color.red(), color.green(), color.blue()));
+		bandTop = bandBottom;
 	}
 	
-	if(colorsToChooseFrom.size() == 0)
+	if(!error) error = encoder.finish();
+	
+	if(error)
 	{
-		colorsToChooseFrom.push_back({1.f, 1.f, 1.f});
+		std::cout << "Failed to save " << savePath.toStdString() << ": " << lodepng_error_text(error) << std::endl;
 	}
+}
 
-	// generate colors
-	std::vector<std::array<float, 3>>  colorsData(numVerts);
-
-	std::random_device rd;
-	std::mt19937 gen(rd());
+void GLWidget::setMesh(const Mesh& mesh)
+{
+	// whatever was being built for the old mesh is of no use anymore
+	if(cancelLevels) *cancelLevels = true;
+	if(pendingLevels.valid()) staleLevels.push_back(std::move(pendingLevels));
 	
-	gen.seed(++lastSeed);
-
-	std::uniform_int_distribution<> distr(0, colorsToChooseFrom.size() - 1);
+	releaseLevels(1);
+	levels.resize(1);
+	uploadMesh(levels[0], mesh);
+	
+	if(movingTriangleBudget == 0 || mesh.indices.size() / 3 <= movingTriangleBudget) return;
+	
+	// the chain stops at the first level within the budget
+	cancelLevels = std::make_shared<std::atomic<bool>>(false);
+	std::shared_ptr<std::atomic<bool>> cancel = cancelLevels;
+	size_t minTriangles = movingTriangleBudget / 4;
+	pendingLevels = std::async(std::launch::async, [mesh, cancel, minTriangles]
+		{
+			std::vector<Mesh> chain = buildLodChain(mesh, minTriangles, *cancel);
+			for(Mesh& level : chain)
+			{
+				if(*cancel) break;
+				optimizeForDrawing(level);
+			}
+			return chain;
+		});
+}
 
-	for (std::array<float, 3>& color : colorsData)
+void GLWidget::receiveLevels()
+{
+	staleLevels.erase(std::remove_if(staleLevels.begin(), staleLevels.end(),
+		[](const std::future<std::vector<Mesh>>& stale) { return stale.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }),
+		staleLevels.end());
+	
+	if(!pendingLevels.valid() || pendingLevels.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+	
+	std::vector<Mesh> chain = pendingLevels.get();
+	if(*cancelLevels) return;
+	
+	std::cout << "Built " << chain.size() << " levels of detail:";
+	for(const Mesh& mesh : chain)
 	{
+		levels.emplace_back();
+		uploadMesh(levels.back(), mesh);
+		uploadColors(levels.back());
+		std::cout << " " << mesh.indices.size() / 3;
+	}
+	std::cout << " triangles" << std::endl;
+}
 
-		color = colorsToChooseFrom[distr(gen)];
+void GLWidget::releaseLevels(size_t keep)
+{
+	for(size_t i = keep; i < levels.size(); ++i)
+	{
+		GLuint buffers[3] = { levels[i].positions, levels[i].indices, levels[i].colors };
+		glDeleteBuffers(3, buffers);
 	}
+	if(levels.size() > keep) levels.resize(keep);
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, colors);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * numVerts, colorsData.data());
+void GLWidget::uploadMesh(MeshBuffers& level, const Mesh& mesh)
+{
+	ProfileScope scope(profiler, "upload mesh");
 	
+	if(level.positions == 0)
+	{
+		glGenBuffers(1, &level.positions);
+		glGenBuffers(1, &level.indices);
+		glGenBuffers(1, &level.colors);
+	}
 	
+	level.numElements = mesh.indices.size();
+	level.numVerts = mesh.positions.size() / 3;
 	
-}
-
-void GLWidget::saveImageOut()
-{
+	level.bvh.build(mesh);
 	
+	glBindVertexArray(vertArray);
 	
-	std::vector<GLubyte> imageData;
-	imageData.resize(width() * height() * 4);
+	// 16 bit positions over the bounding box, scaled back into place by the model matrix
+	glBindBuffer(GL_ARRAY_BUFFER, level.positions);
+	if(quantizePositionBuffer)
+	{
+		QuantizedPositions quantized = quantizePositions(mesh.positions);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(uint16_t) * quantized.values.size(), quantized.values.data(), GL_STATIC_DRAW);
+		
+		level.modelMat = glm::translate(glm::vec3(quantized.offset[0], quantized.offset[1], quantized.offset[2]))
+			* glm::scale(glm::vec3(quantized.scale[0], quantized.scale[1], quantized.scale[2]));
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * mesh.positions.size(), mesh.positions.data(), GL_STATIC_DRAW);
+		level.modelMat = glm::mat4(1.f);
+	}
+	level.positionsQuantized = quantizePositionBuffer;
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.indices);
+	std::vector<uint16_t> narrow = shortIndices(mesh.indices, level.numVerts);
+	if(!narrow.empty())
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * narrow.size(), narrow.data(), GL_STATIC_DRAW);
+		level.indexType = GL_UNSIGNED_SHORT;
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
+		level.indexType = GL_UNSIGNED_INT;
+	}
 	
+	glBindBuffer(GL_ARRAY_BUFFER, level.colors);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * level.numVerts, nullptr, GL_STATIC_DRAW);
 	
-    glReadBuffer(GL_FRONT);
+	level.provokingVertices.resize(mesh.indices.size() / 3);
+	for(size_t t = 0; t < level.provokingVertices.size(); ++t) level.provokingVertices[t] = mesh.indices[t * 3 + 2];
+	level.faceIds = mesh.faceIds;
 	
+	level.fixedColors = provokingVertexColors(mesh);
+}
+
+void GLWidget::uploadColors(MeshBuffers& level)
+{
+	ProfileScope scope(profiler, "upload colors");
 	
-    glReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, imageData.data());
+	glBindBuffer(GL_ARRAY_BUFFER, level.colors);
 	
-	std::cout << (int)imageData[23] << " HEHEHE" << std::endl;
+	if(!level.fixedColors.empty())
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * level.numVerts, level.fixedColors.data());
+		return;
+	}
 	
-    lodepng::encode(savePath.toStdString(), imageData, width(), height(), LCT_RGBA, 8);
+	if(level.faceIds.empty())
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * level.numVerts, paletteColors.data());
+		return;
+	}
 	
+	// a coarser face takes the pick of the full detail face it stands for, so colors stay put when the level changes
+	std::vector<std::array<float, 3>> colorsData(level.numVerts, {{ 0.f, 0.f, 0.f }});
+	const std::vector<unsigned int>& fullProvoking = levels[0].provokingVertices;
+	for(size_t t = 0; t < level.provokingVertices.size(); ++t)
+	{
+		colorsData[level.provokingVertices[t]] = paletteColors[fullProvoking[level.faceIds[t]]];
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * level.numVerts, colorsData.data());
+}
+
+void GLWidget::loadLowPolyImage()
+{
+	ProfileScope scope(profiler, "load image");
 	
+	// the mesh is made in pixels on the x/z plane and placed in view afterwards, so the cached
+	// copy doesn't depend on the camera
+	std::string path = imagePath.toStdString();
+	unsigned error = 0;
+	Mesh mesh = imageMesh(path, LowPolySettings(), error);
 	
+	if(error)
+	{
+		std::cout << "Failed to load " << path << ": " << lodepng_error_text(error) << std::endl;
+		return;
+	}
+	if(mesh.positions.empty()) return;
+	
+	// lay the image over what the camera currently sees
+	glm::mat4 placement = imagePlacement(mesh, viewProjection(), (float)width() / height());
+	for(size_t i = 0; i < mesh.positions.size(); i += 3)
+	{
+		glm::vec4 position = placement * glm::vec4(mesh.positions[i], mesh.positions[i + 1], mesh.positions[i + 2], 1.f);
+		
+		mesh.positions[i] = position.x;
+		mesh.positions[i + 1] = position.y;
+		mesh.positions[i + 2] = position.z;
+	}
+	
+	setMesh(mesh);
+	regenerate();
+}
+
+void GLWidget::loadGeneratedMesh()
+{
+	// setMesh leaves no fixed colors behind, so the palette colors it again
+	setMesh(generatedMesh(MeshGenSettings()));
+	regenerate();
 }
 
+void GLWidget::showCullStats()
+{
+	const CullStats& stats = drawRanges.stats;
+	QString message = QString("Detail level %1 of %2. Visible: %3 clusters, %4 triangles. Culled: %5 clusters, %6 triangles")
+		.arg(drawnLevel).arg(levels.size()).arg(stats.visibleClusters).arg(stats.visibleTriangles)
+		.arg(stats.culledClusters).arg(stats.culledTriangles);
+	
+	// only touch the status bar when something changed, not on every frame
+	if(message != cullMessage)
+	{
+		cullMessage = message;
+		owningWindow->statusBar()->showMessage(message);
+	}
+}
+
+glm::mat4 GLWidget::viewProjection() const
+{
+	return scene.camera.viewProjection((float)width() / height());
+}
@@ -8,7 +8,20 @@
 
 #include <glm/glm.hpp>
 
+#include "CameraTrack.h"
+#include "ClusterBvh.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "Mesh.h"
+
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <vector>
 
 class Window;
 
@@ -16,6 +29,7 @@ class GLWidget : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core
 {
 public:
 	explicit GLWidget(Window* parent = 0, Qt::WindowFlags f = 0);
+	~GLWidget();
 	
 	virtual void initializeGL() override;
 	virtual void paintGL() override;
@@ -25,12 +39,53 @@ public:
 	void markForRegeneration();
 	void markForColorRefresh();
 	void markForSave(const QString& saveDest);
+	void markForImageLoad(const QString& imagePath);
+	// back from a low-poly image to a generated mesh in the palette's colors
+	void markForGeneratedMesh();
+	
+	// Records the camera every frame until stopRecording, which keeps the track for saveRecording.
+	void startRecording();
+	void stopRecording();
+	bool isRecording() const { return recording; }
+	void saveRecording(const QString& trackPath);
+	// Flies the camera along a saved track, a fixed step further every frame however long the frames
+	// take, so every replay draws the same frames
+	void markForReplay(const QString& trackPath);
+	
+	// what the last frame drew after frustum culling
+	const CullStats& cullStats() const { return drawRanges.stats; }
+	
 	
+	// the palette, seed, camera and lines drawn. Palette changes show after markForColorRefresh,
+	// markForRegeneration moves on to the next seed
+	Scene scene;
 	
 	float speed = 30.f;
-	float lineSize = 1.f;
 	
-	QColor lineColor = QColor(0, 0, 0);
+	// upload positions as 16 bit integers, precise to 1/65535 of the mesh's size. Applies from the next upload
+	bool quantizePositionBuffer = true;
+	
+	// time the camera moves on along a replayed track every frame
+	float replayStep = 1.f / 60.f;
+	
+	// the camera moves in steps this long whatever the frame rate, frames draw it between the last two
+	float simulationStep = 1.f / 120.f;
+	
+	// percentiles and a histogram of the last frame times over the picture, H toggles it
+	bool showFrameStats = false;
+	void saveFrameStats(const QString& csvPath);
+	
+	// milliseconds per frame of each phase of drawing, on the CPU and from GPU timer queries. P toggles it
+	bool showProfile = false;
+	// keeps every phase of every frame until stopTrace, saveTrace writes them as a Chrome trace
+	void startTrace();
+	void stopTrace();
+	bool isTracing() const { return profiler.tracing(); }
+	void saveTrace(const QString& jsonPath);
+	
+	// most triangles drawn while the camera moves, bigger meshes get coarser levels of detail built in
+	// the background. Still frames and saved images always use full detail. Applies from the next mesh
+	size_t movingTriangleBudget = 500000;
 	
 private:
 	
@@ -39,33 +94,136 @@ private:
 	
 	
 	
+	// one level of detail on the GPU
+	struct MeshBuffers
+	{
+		GLuint positions = 0, indices = 0, colors = 0;
+		GLuint numElements = 0, numVerts = 0;
+		GLenum indexType = GL_UNSIGNED_INT;
+		bool positionsQuantized = false;
+		// maps the uploaded positions to world space
+		glm::mat4 modelMat = glm::mat4(1.f);
+		
+		// clusters in world space
+		ClusterBvh bvh;
+		
+		// per triangle: the vertex its flat color comes from, and the full detail triangle it stands
+		// for (empty at full detail)
+		std::vector<unsigned int> provokingVertices, faceIds;
+		
+		// per vertex colors from the mesh's face colors, used instead of the palette when set
+		std::vector<std::array<float, 3>> fixedColors;
+	};
+	
 	void regenerate();
 	void saveImageOut();
+	void setMesh(const Mesh& mesh);
+	void uploadMesh(MeshBuffers& level, const Mesh& mesh);
+	void uploadColors(MeshBuffers& level);
+	void releaseLevels(size_t keep);
+	void receiveLevels();
+	void loadLowPolyImage();
+	void loadGeneratedMesh();
+	void showCullStats();
+	void recordInput(CameraTrack::Input::Type type, int x, int y);
+	void loadReplay();
+	void drawFrameStats();
+	void drawProfile();
+	void beginGpuPhase(const char* name);
+	void endGpuPhase();
+	void collectGpuTimes();
+	
+	// a linked variant of the shaders and where its uniforms are, -1 for those it doesn't have
+	struct ShaderProgram
+	{
+		GLuint program = 0;
+		GLint MVP = -1, lineColor = -1;
+	};
+	
+	// the variant with these ShaderFeatures, built the first time it's asked for
+	const ShaderProgram& shaderProgram(unsigned features);
+	// The program from the binary cache, built from source and added to the cache if it's not there
+	// or the driver rejects it. Without binary support it's always built from source
+	GLuint loadProgram(const char* vertSource, const char* fragSource);
+	// retrievable asks the driver to keep the binary for glGetProgramBinary
+	GLuint compileProgram(const char* vertSource, const char* fragSource, bool retrievable);
+	
+	glm::mat4 viewProjection() const;
+	
+	
+	
+	GLuint vertArray;
+	
+	// the variants built so far, by their features
+	std::map<unsigned, ShaderProgram> shaderPrograms;
+	
+	// full detail first, then ever coarser
+	std::vector<MeshBuffers> levels;
+	size_t drawnLevel = 0;
+	
+	// the full detail mesh's palette picks, per vertex
+	std::vector<std::array<float, 3>> paletteColors;
+	
+	// levels of detail being built for the current mesh, already optimized for drawing
+	std::future<std::vector<Mesh>> pendingLevels;
+	std::shared_ptr<std::atomic<bool>> cancelLevels;
+	
+	// chains cancelled by a newer mesh, kept until they wind down so dropping them never blocks
+	std::vector<std::future<std::vector<Mesh>>> staleLevels;
+	
+	// the ranges of the drawn level the last frame's culling kept
+	DrawRanges drawRanges;
+	std::vector<GLsizei> drawCounts;
+	std::vector<const GLvoid*> drawOffsets;
+	QString cullMessage;
+
+	glm::vec3 velocity;
 	
+	// the camera is drawn between these, the last two simulation steps, by how far simulationLag is into the next
+	glm::vec3 previousStepLocation = scene.camera.location, stepLocation = scene.camera.location;
+	float simulationLag = 0.f;
 	
 	
-	GLuint program, vertLocs, vertArray, indicies, colors, numElements, numVerts;
-
-	glm::vec3 location = { 0.f, 10.f, 0.f };
-	glm::vec3 forwardVector = { 0.f, -1.f, 0.f };
-	glm::vec3 upVector = { 0.f, 0.f, 1.f};
-
-	glm::vec3 velocity;
 	
+	bool needsRegenerate = false, needsSave = false, needsColorRefresh = false, needsImageLoad = false, needsGeneratedMesh = false,
+		needsReplay = false;
+	QString savePath, imagePath, replayPath;
 	
+	// the track being recorded, and the input since its last frame
+	bool recording = false;
+	CameraTrack track;
+	std::vector<CameraTrack::Input> pendingInputs;
 	
-	bool needsRegenerate = false, needsSave = false, needsColorRefresh = false;
-	QString savePath;
+	// the track being replayed, and how far along it is
+	bool replaying = false;
+	CameraPath replay;
+	float replayTime = 0.f;
 	
 	QTimer time;
-	std::chrono::time_point<std::chrono::system_clock> lastTickTime;
+	std::chrono::steady_clock::time_point lastTickTime;
+	FrameStats frameStats;
+	
+	Profiler profiler;
+	
+	// GPU timestamps around the phases of the last frames, read back a few frames later so that
+	// waiting for them doesn't stall. A begin and end query per phase
+	struct GpuFrame
+	{
+		std::vector<GLuint> queries;
+		std::vector<const char*> names;
+		// the clocks of the GPU and CPU as the frame started, to put its phases in the trace
+		GLint64 gpuTime = 0;
+		double cpuTime = 0.;
+	};
+	std::array<GpuFrame, 4> gpuFrames;
+	size_t gpuFrame = 0;
+	std::vector<size_t> openGpuPhases;
+	bool gpuTiming = false;
 	
 	bool isMouseDown = false;
 	glm::ivec2 lastMousePos;
 	
 	Window* owningWindow;
 	
-	int lastSeed = 0;
-	
 	
 };
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "ImageOps.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGEOPS_HAS_SSSE3_PATH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+void rowRGBAToRGBScalar(unsigned char* out, const unsigned char* in, unsigned width)
+{
+	for(unsigned x = 0; x < width; ++x)
+	{
+		out[x * 3 + 0] = in[x * 4 + 0];
+		out[x * 3 + 1] = in[x * 4 + 1];
+		out[x * 3 + 2] = in[x * 4 + 2];
+	}
+}
+
+#ifdef IMAGEOPS_HAS_SSSE3_PATH
+
+__attribute__((target("ssse3")))
+void rowRGBAToRGBSSSE3(unsigned char* out, const unsigned char* in, unsigned width)
+{
+	// packs the 4 pixels of a 16 byte load into the low 12 bytes
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	unsigned x = 0;
+
+	// every store writes 16 bytes but only advances 12, so keep two pixels of
+	// headroom in the row for the overhang (it gets overwritten by the next store)
+	for(; x + 6 <= width; x += 4)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 3), _mm_shuffle_epi8(pixels, shuffle));
+	}
+
+	rowRGBAToRGBScalar(out + x * 3, in + x * 4, width - x);
+}
+
+bool cpuHasSSSE3()
+{
+	static const bool has = __builtin_cpu_supports("ssse3");
+	return has;
+}
+
+#endif
+
+// SSE2 is part of x86-64 itself, no need to ask the cpu. -O2 leaves the plain loop scalar
+void accumulateRow(float* sum, const float* row, float weight, size_t count)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128 weights = _mm_set1_ps(weight);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 value = _mm_mul_ps(_mm_loadu_ps(row + i), weights);
+		_mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), value));
+	}
+#endif
+	for(; i < count; ++i) sum[i] += row[i] * weight;
+}
+
+float lanczos3(float x)
+{
+	x = std::abs(x);
+	if(x < 1e-6f) return 1.f;
+	if(x >= 3.f) return 0.f;
+
+	const float pi = 3.14159265358979f;
+	float px = pi * x;
+	return 3.f * std::sin(px) * std::sin(px / 3.f) / (px * px);
+}
+
+// For every destination pixel along one axis, the first source pixel it reads and the weights of
+// taps pixels from there on, zero padded so every pixel has the same number
+struct FilterTaps
+{
+	std::vector<unsigned> first;
+	std::vector<float> weights;
+	unsigned taps = 0;
+};
+
+FilterTaps filterTaps(unsigned srcSize, unsigned dstSize)
+{
+	float scale = float(srcSize) / dstSize;
+	float filterScale = std::max(scale, 1.f);
+	float support = 3.f * filterScale;
+
+	FilterTaps filter;
+	filter.taps = std::min(unsigned(std::ceil(support * 2.f)) + 1, srcSize);
+	filter.first.resize(dstSize);
+	filter.weights.assign(size_t(dstSize) * filter.taps, 0.f);
+
+	for(unsigned i = 0; i < dstSize; ++i)
+	{
+		float center = (i + .5f) * scale;
+		int begin = std::max(int(std::ceil(center - support - .5f)), 0);
+		int end = std::min(int(std::floor(center + support - .5f)) + 1, int(srcSize));
+		// taps is enough for any window, only the image's far edge can push it back
+		begin = std::max(std::min(begin, int(srcSize) - int(filter.taps)), 0);
+		end = std::min(end, begin + int(filter.taps));
+
+		float* weights = &filter.weights[size_t(i) * filter.taps];
+		float total = 0.f;
+		for(int j = begin; j < end; ++j)
+		{
+			weights[j - begin] = lanczos3((j + .5f - center) / filterScale);
+			total += weights[j - begin];
+		}
+		for(unsigned k = 0; k < filter.taps; ++k) weights[k] /= total;
+
+		filter.first[i] = begin;
+	}
+
+	return filter;
+}
+
+unsigned char clampToByte(float value)
+{
+	return (unsigned char)std::min(std::max(value + .5f, 0.f), 255.f);
+}
+
+}
+
+void rowRGBAToRGB(unsigned char* out, const unsigned char* in, unsigned width)
+{
+#ifdef IMAGEOPS_HAS_SSSE3_PATH
+	if(cpuHasSSSE3())
+	{
+		rowRGBAToRGBSSSE3(out, in, width);
+		return;
+	}
+#endif
+	rowRGBAToRGBScalar(out, in, width);
+}
+
+ImageRect centeredCrop(unsigned width, unsigned height, float aspect)
+{
+	ImageRect crop;
+	crop.width = width;
+	crop.height = height;
+	if(width > height * aspect) crop.width = std::max(1u, std::min(width, unsigned(std::lround(height * aspect))));
+	else crop.height = std::max(1u, std::min(height, unsigned(std::lround(width / aspect))));
+
+	crop.x = (width - crop.width) / 2;
+	crop.y = (height - crop.height) / 2;
+	return crop;
+}
+
+void resizeRGB(const unsigned char* src, unsigned srcWidth, const ImageRect& region,
+               unsigned char* dst, unsigned dstWidth, unsigned dstHeight, unsigned threads)
+{
+	if(dstWidth == 0 || dstHeight == 0 || region.width == 0 || region.height == 0) return;
+
+	FilterTaps horizontal = filterTaps(region.width, dstWidth);
+	FilterTaps vertical = filterTaps(region.height, dstHeight);
+
+	const size_t stride = size_t(dstWidth) * 3;
+	const unsigned chunkRows = 32;
+	std::atomic<unsigned> nextChunk(0);
+
+	auto run = [&]
+	{
+		// source rows filtered horizontally, and the sum of one destination row
+		std::vector<float> filtered, sum(stride);
+
+		for(unsigned begin = nextChunk.fetch_add(chunkRows); begin < dstHeight; begin = nextChunk.fetch_add(chunkRows))
+		{
+			unsigned end = std::min(begin + chunkRows, dstHeight);
+			unsigned srcBegin = vertical.first[begin];
+			unsigned srcEnd = vertical.first[end - 1] + vertical.taps;
+
+			filtered.resize((srcEnd - srcBegin) * stride);
+			for(unsigned sy = srcBegin; sy < srcEnd; ++sy)
+			{
+				const unsigned char* row = src + (size_t(region.y + sy) * srcWidth + region.x) * 3;
+				float* out = &filtered[(sy - srcBegin) * stride];
+				for(unsigned dx = 0; dx < dstWidth; ++dx)
+				{
+					const unsigned char* pixel = row + size_t(horizontal.first[dx]) * 3;
+					const float* weights = &horizontal.weights[size_t(dx) * horizontal.taps];
+					float r = 0.f, g = 0.f, b = 0.f;
+					for(unsigned k = 0; k < horizontal.taps; ++k, pixel += 3)
+					{
+						r += pixel[0] * weights[k];
+						g += pixel[1] * weights[k];
+						b += pixel[2] * weights[k];
+					}
+					out[dx * 3 + 0] = r;
+					out[dx * 3 + 1] = g;
+					out[dx * 3 + 2] = b;
+				}
+			}
+
+			for(unsigned dy = begin; dy < end; ++dy)
+			{
+				std::fill(sum.begin(), sum.end(), 0.f);
+				const float* weights = &vertical.weights[size_t(dy) * vertical.taps];
+				for(unsigned k = 0; k < vertical.taps; ++k)
+				{
+					if(weights[k] == 0.f) continue;
+					accumulateRow(sum.data(), &filtered[(vertical.first[dy] + k - srcBegin) * stride], weights[k], stride);
+				}
+
+				unsigned char* out = dst + dy * stride;
+				for(size_t i = 0; i < stride; ++i) out[i] = clampToByte(sum[i]);
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	unsigned chunks = (dstHeight + chunkRows - 1) / chunkRows;
+	for(unsigned t = 1; t < std::min(std::max(threads, 1u), chunks); ++t) workers.emplace_back(run);
+	run();
+	for(auto& worker : workers) worker.join();
+}
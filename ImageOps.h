@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+// Converts a single row of RGBA pixels to RGB, dropping alpha. Saves convert their framebuffer
+// readback a row at a time with it.
+void rowRGBAToRGB(unsigned char* out, const unsigned char* in, unsigned width);
+
+// A rectangle of pixels within an image.
+struct ImageRect
+{
+	unsigned x = 0, y = 0, width = 0, height = 0;
+};
+
+// The largest rectangle with the given aspect (width / height) centered in a width x height image.
+ImageRect centeredCrop(unsigned width, unsigned height, float aspect);
+
+// Scales region of the tightly packed RGB image src, srcWidth pixels wide, to dstWidth x dstHeight
+// with a separable Lanczos 3 filter. Downscaling widens the filter so every source pixel counts.
+// The rows of dst are split between threads, each only keeps the horizontally filtered source rows
+// its own rows need.
+void resizeRGB(const unsigned char* src, unsigned srcWidth, const ImageRect& region,
+               unsigned char* dst, unsigned dstWidth, unsigned dstHeight, unsigned threads = 1);
@@ -0,0 +1,241 @@
+#include "LowPoly.h"
+
+#include "MeshGen.h"
+#include "PoissonDisk.h"
+#include "lodepng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+namespace
+{
+
+// runs work(begin, end) over [0, count) in chunks on all threads
+template <typename Work>
+void parallelChunks(size_t count, size_t chunk, unsigned numThreads, const Work& work)
+{
+	std::atomic<size_t> next(0);
+	auto run = [&]
+	{
+		for(size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk))
+		{
+			work(begin, std::min(begin + chunk, count));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	size_t chunks = (count + chunk - 1) / chunk;
+	for(unsigned t = 1; t < std::min<size_t>(numThreads, chunks); ++t) threads.emplace_back(run);
+	run();
+	for(auto& thread : threads) thread.join();
+}
+
+float luminance(const unsigned char* pixel)
+{
+	return (.2126f * pixel[0] + .7152f * pixel[1] + .0722f * pixel[2]) / 255.f;
+}
+
+// Sobel gradient magnitude averaged over block x block pixel cells. The sampler only looks at the
+// map at the scale of the point spacing, so there's no need to keep it at full resolution.
+void edgeMap(const unsigned char* rgb, unsigned width, unsigned height, unsigned block, unsigned numThreads,
+             ImportanceMap& map)
+{
+	map.width = (width + block - 1) / block;
+	map.height = (height + block - 1) / block;
+	map.values.assign(size_t(map.width) * map.height, 0.f);
+
+	parallelChunks(map.height, 1, numThreads, [&](size_t begin, size_t end)
+	{
+		// luminance of the rows above, at and below the current one
+		std::vector<float> rows[3];
+		for(auto& row : rows) row.resize(width);
+		auto fillRow = [&](std::vector<float>& row, unsigned y)
+		{
+			const unsigned char* pixel = rgb + size_t(y) * width * 3;
+			for(unsigned x = 0; x < width; ++x) row[x] = luminance(pixel + x * 3);
+		};
+
+		for(size_t cellY = begin; cellY < end; ++cellY)
+		{
+			unsigned y0 = unsigned(cellY) * block, y1 = std::min(y0 + block, height);
+			float* cells = &map.values[cellY * map.width];
+
+			fillRow(rows[0], y0 ? y0 - 1 : 0);
+			fillRow(rows[1], y0);
+			for(unsigned y = y0; y < y1; ++y)
+			{
+				fillRow(rows[(y - y0 + 2) % 3], std::min(y + 1, height - 1));
+				const float* up = rows[(y - y0) % 3].data();
+				const float* mid = rows[(y - y0 + 1) % 3].data();
+				const float* down = rows[(y - y0 + 2) % 3].data();
+
+				for(unsigned x = 0; x < width; ++x)
+				{
+					unsigned l = x ? x - 1 : 0, r = std::min(x + 1, width - 1);
+					float gx = (up[r] + 2.f * mid[r] + down[r]) - (up[l] + 2.f * mid[l] + down[l]);
+					float gy = (down[l] + 2.f * down[x] + down[r]) - (up[l] + 2.f * up[x] + up[r]);
+					cells[x / block] += std::sqrt(gx * gx + gy * gy);
+				}
+			}
+
+			for(unsigned cellX = 0; cellX < map.width; ++cellX)
+			{
+				unsigned cellWidth = std::min(block, width - cellX * block);
+				cells[cellX] /= float(cellWidth * (y1 - y0));
+			}
+		}
+	});
+}
+
+// 3x3 box blur, spreads the edges over about one point spacing
+void blur(ImportanceMap& map)
+{
+	std::vector<float> blurred(map.values.size());
+	for(unsigned y = 0; y < map.height; ++y)
+	{
+		for(unsigned x = 0; x < map.width; ++x)
+		{
+			float sum = 0.f;
+			unsigned count = 0;
+			for(unsigned ny = y ? y - 1 : 0; ny <= std::min(y + 1, map.height - 1); ++ny)
+			{
+				for(unsigned nx = x ? x - 1 : 0; nx <= std::min(x + 1, map.width - 1); ++nx)
+				{
+					sum += map.values[size_t(ny) * map.width + nx];
+					++count;
+				}
+			}
+			blurred[size_t(y) * map.width + x] = sum / count;
+		}
+	}
+	map.values.swap(blurred);
+}
+
+// Sums the pixels whose centers lie inside the triangle, one horizontal span per row.
+// Triangles too small to cover a pixel center take the pixel under their centroid.
+void averageColor(const unsigned char* rgb, unsigned width, unsigned height, const float* a, const float* b,
+                  const float* c, float* color)
+{
+	// sort the corners top to bottom
+	if(a[1] > b[1]) std::swap(a, b);
+	if(b[1] > c[1]) std::swap(b, c);
+	if(a[1] > b[1]) std::swap(a, b);
+
+	uint64_t sum[3] = {0, 0, 0};
+	uint64_t count = 0;
+
+	int yBegin = std::max(int(std::ceil(a[1] - .5f)), 0);
+	int yEnd = std::min(int(std::ceil(c[1] - .5f)), int(height));
+	for(int y = yBegin; y < yEnd; ++y)
+	{
+		float center = y + .5f;
+		// the long edge a-c and whichever short edge spans this row
+		float xLong = a[0] + (c[0] - a[0]) * (center - a[1]) / (c[1] - a[1]);
+		float xShort = center < b[1]
+		                   ? a[0] + (b[0] - a[0]) * (center - a[1]) / (b[1] - a[1])
+		                   : b[0] + (c[0] - b[0]) * (center - b[1]) / (c[1] - b[1]);
+
+		int xBegin = std::max(int(std::ceil(std::min(xLong, xShort) - .5f)), 0);
+		int xEnd = std::min(int(std::ceil(std::max(xLong, xShort) - .5f)), int(width));
+		if(xBegin >= xEnd) continue;
+
+		const unsigned char* pixel = rgb + (size_t(y) * width + xBegin) * 3;
+		unsigned rowSum[3] = {0, 0, 0};
+		for(int x = xBegin; x < xEnd; ++x, pixel += 3)
+		{
+			rowSum[0] += pixel[0];
+			rowSum[1] += pixel[1];
+			rowSum[2] += pixel[2];
+		}
+		for(int i = 0; i < 3; ++i) sum[i] += rowSum[i];
+		count += xEnd - xBegin;
+	}
+
+	if(count == 0)
+	{
+		float cx = (a[0] + b[0] + c[0]) / 3.f, cy = (a[1] + b[1] + c[1]) / 3.f;
+		unsigned x = std::min(unsigned(std::max(cx, 0.f)), width - 1);
+		unsigned y = std::min(unsigned(std::max(cy, 0.f)), height - 1);
+		const unsigned char* pixel = rgb + (size_t(y) * width + x) * 3;
+		for(int i = 0; i < 3; ++i) color[i] = pixel[i] / 255.f;
+		return;
+	}
+
+	for(int i = 0; i < 3; ++i) color[i] = float(double(sum[i]) / double(count) / 255.0);
+}
+
+}
+
+unsigned lowPolyFromImage(const std::string& path, const LowPolySettings& settings, LowPolyImage& out)
+{
+	std::vector<unsigned char> image;
+	unsigned width, height;
+	unsigned error = lodepng::decode(image, width, height, path, LCT_RGB, 8);
+	if(error) return error;
+
+	lowPolyFromPixels(image.data(), width, height, settings, out);
+	return 0;
+}
+
+void lowPolyFromPixels(const unsigned char* rgb, unsigned width, unsigned height,
+                       const LowPolySettings& settings, LowPolyImage& out)
+{
+	out.width = width;
+	out.height = height;
+	out.points.clear();
+	out.triangles.clear();
+	out.triangleColors.clear();
+	if(width == 0 || height == 0) return;
+
+	unsigned numThreads = settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+
+	float longSide = float(std::max(width, height));
+	float edgeSpacing = std::max(settings.edgeSpacing * longSide, 1.f);
+	float flatSpacing = std::max(settings.flatSpacing * longSide, edgeSpacing);
+
+	ImportanceMap importance;
+	edgeMap(rgb, width, height, std::max(unsigned(edgeSpacing / 2.f), 1u), numThreads, importance);
+	blur(importance);
+
+	// scale so a gradient edgeThreshold times the image's average counts as a full edge
+	double total = 0.0;
+	for(float value : importance.values) total += value;
+	float full = float(total / importance.values.size()) * settings.edgeThreshold;
+	for(float& value : importance.values) value = full > 0.f ? std::min(value / full, 1.f) : 0.f;
+
+	PoissonDiskSettings poisson;
+	poisson.width = float(width);
+	poisson.depth = float(height);
+	poisson.minDistance = edgeSpacing;
+	poisson.maxDistance = flatSpacing;
+	poisson.importance = &importance;
+	poisson.threads = numThreads;
+	poisson.seed = settings.seed;
+	out.points = poissonDiskPoints(poisson);
+
+	// the sampler centers its patch on the origin and reads the map mirrored, as seen from the camera
+	for(size_t i = 0; i < out.points.size(); i += 2)
+	{
+		out.points[i] = width / 2.f - out.points[i];
+		out.points[i + 1] = height / 2.f - out.points[i + 1];
+	}
+
+	out.triangles = delaunayTriangulate(out.points);
+
+	// every pixel lies in exactly one triangle, so summing the spans directly is a single pass over
+	// the image, the same work building a summed-area table would take
+	size_t numTriangles = out.triangles.size() / 3;
+	out.triangleColors.resize(numTriangles * 3);
+	parallelChunks(numTriangles, 1024, numThreads, [&](size_t begin, size_t end)
+	{
+		for(size_t t = begin; t < end; ++t)
+		{
+			averageColor(rgb, width, height, &out.points[out.triangles[t * 3] * 2],
+			             &out.points[out.triangles[t * 3 + 1] * 2], &out.points[out.triangles[t * 3 + 2] * 2],
+			             &out.triangleColors[t * 3]);
+		}
+	});
+}
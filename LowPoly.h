@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct LowPolySettings
+{
+	// distance between points along edges of the image and in flat areas,
+	// as a fraction of the longer side of the image
+	float edgeSpacing = .006f;
+	float flatSpacing = .04f;
+
+	// a gradient this many times the image's average counts as a full edge
+	float edgeThreshold = 3.f;
+
+	unsigned seed = 1;
+	// 0 uses all cores
+	unsigned threads = 0;
+};
+
+// A triangulated image in pixel coordinates, with the average image color of each triangle.
+struct LowPolyImage
+{
+	unsigned width = 0, height = 0;
+
+	// x, y pairs in pixels, from the top left corner of the image
+	std::vector<float> points;
+	std::vector<unsigned int> triangles;
+	// r, g, b in [0, 1] per triangle
+	std::vector<float> triangleColors;
+};
+
+// Decodes a PNG, puts points densely along its edges (Sobel gradient) and sparsely elsewhere,
+// triangulates them and colors every triangle with the average of the pixels it covers.
+// Returns a lodepng error code.
+unsigned lowPolyFromImage(const std::string& path, const LowPolySettings& settings, LowPolyImage& out);
+
+// Same, from 8 bit RGB pixels.
+void lowPolyFromPixels(const unsigned char* rgb, unsigned width, unsigned height,
+                       const LowPolySettings& settings, LowPolyImage& out);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+// Triangle mesh in the layout initializeGL uploads: x, y, z floats per vertex and
+// three indices per triangle. y is up, the camera looks down on the x/z plane.
+struct Mesh
+{
+	std::vector<float> positions;
+	std::vector<unsigned int> indices;
+
+	// optional r, g, b per triangle, without them the palette colors the mesh
+	std::vector<float> faceColors;
+
+	// optional, for simplified meshes: the triangle of the full detail mesh each triangle stands for
+	std::vector<unsigned int> faceIds;
+
+	// first triangle of each cluster of neighbouring triangles, empty if the mesh isn't clustered
+	std::vector<unsigned int> clusters;
+};
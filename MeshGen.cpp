@@ -0,0 +1,522 @@
+#include "MeshGen.h"
+
+#include "PoissonDisk.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace
+{
+
+const unsigned invalidIndex = std::numeric_limits<unsigned>::max();
+
+// true if r lies to the right of the line from p to q
+bool orient(double px, double py, double qx, double qy, double rx, double ry)
+{
+	return (qy - py) * (rx - qx) - (qx - px) * (ry - qy) < 0.0;
+}
+
+// squared radius of the circle through a, b and c (infinite or NaN if they are collinear)
+double circumradius(double ax, double ay, double bx, double by, double cx, double cy)
+{
+	double dx = bx - ax, dy = by - ay;
+	double ex = cx - ax, ey = cy - ay;
+	double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey;
+	double d = .5 / (dx * ey - dy * ex);
+
+	double x = (ey * bl - dy * cl) * d;
+	double y = (dx * cl - ex * bl) * d;
+	return x * x + y * y;
+}
+
+void circumcenter(double ax, double ay, double bx, double by, double cx, double cy, double& x, double& y)
+{
+	double dx = bx - ax, dy = by - ay;
+	double ex = cx - ax, ey = cy - ay;
+	double bl = dx * dx + dy * dy, cl = ex * ex + ey * ey;
+	double d = .5 / (dx * ey - dy * ex);
+
+	x = ax + (ey * bl - dy * cl) * d;
+	y = ay + (dx * cl - ex * bl) * d;
+}
+
+// true if p lies inside the circle through a, b and c
+bool inCircle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+{
+	double dx = ax - px, dy = ay - py;
+	double ex = bx - px, ey = by - py;
+	double fx = cx - px, fy = cy - py;
+
+	double ap = dx * dx + dy * dy;
+	double bp = ex * ex + ey * ey;
+	double cp = fx * fx + fy * fy;
+
+	return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) < 0.0;
+}
+
+// monotonic in the angle of (dx, dy), in [0, 1)
+double pseudoAngle(double dx, double dy)
+{
+	double p = dx / (std::abs(dx) + std::abs(dy));
+	return (dy > 0.0 ? 3.0 - p : 1.0 + p) / 4.0;
+}
+
+// Sweep hull triangulation: the points are added in order of distance from a seed triangle,
+// each one connects to the part of the convex hull it can see, and edges that violate the
+// Delaunay condition are flipped right away. Triangles and their neighbours are kept as half
+// edges: halfedges[e] is the opposite half edge of e in the adjacent triangle.
+class Triangulator
+{
+public:
+	explicit Triangulator(const std::vector<float>& points)
+		: coords(points.begin(), points.end()), numPoints(points.size() / 2)
+	{
+	}
+
+	std::vector<unsigned int> run();
+
+private:
+	double x(unsigned i) const { return coords[2 * i]; }
+	double y(unsigned i) const { return coords[2 * i + 1]; }
+
+	size_t hashKey(double px, double py) const
+	{
+		return size_t(std::floor(pseudoAngle(px - centerX, py - centerY) * hashSize)) % hashSize;
+	}
+
+	void link(unsigned a, unsigned b)
+	{
+		halfedges[a] = b;
+		if(b != invalidIndex) halfedges[b] = a;
+	}
+
+	unsigned addTriangle(unsigned i0, unsigned i1, unsigned i2, unsigned a, unsigned b, unsigned c)
+	{
+		unsigned t = triangles.size();
+		triangles.push_back(i0);
+		triangles.push_back(i1);
+		triangles.push_back(i2);
+		halfedges.resize(t + 3);
+		link(t, a);
+		link(t + 1, b);
+		link(t + 2, c);
+		return t;
+	}
+
+	unsigned legalize(unsigned a);
+
+	std::vector<double> coords;
+	size_t numPoints;
+
+	double centerX = 0.0, centerY = 0.0;
+
+	std::vector<unsigned int> triangles;
+	std::vector<unsigned int> halfedges;
+
+	// the convex hull as a linked list of points, with the half edge of the triangle on its outside
+	std::vector<unsigned> hullPrev, hullNext, hullTri;
+	std::vector<unsigned> hullHash;
+	size_t hashSize = 0;
+	unsigned hullStart = 0;
+
+	std::vector<unsigned> edgeStack;
+};
+
+unsigned Triangulator::legalize(unsigned a)
+{
+	size_t stackSize = 0;
+	unsigned ar = 0;
+
+	// recursion eliminated with a stack of edges still to check
+	while(true)
+	{
+		unsigned b = halfedges[a];
+
+		/* if the pair of triangles doesn't satisfy the Delaunay condition
+		 * (p1 is inside the circumcircle of [p0, pl, pr]), flip them,
+		 * then do the same check/flip recursively for the new pair of triangles
+		 *
+		 *           pl                    pl
+		 *          /||\                  /  \
+		 *       al/ || \bl            al/    \a
+		 *        /  ||  \              /      \
+		 *       /  a||b  \    flip    /___ar___\
+		 *     p0\   ||   /p1   =>   p0\---bl---/p1
+		 *        \  ||  /              \      /
+		 *       ar\ || /br             b\    /br
+		 *          \||/                  \  /
+		 *           pr                    pr
+		 */
+		unsigned a0 = a - a % 3;
+		ar = a0 + (a + 2) % 3;
+
+		if(b == invalidIndex) // convex hull edge
+		{
+			if(stackSize == 0) break;
+			a = edgeStack[--stackSize];
+			continue;
+		}
+
+		unsigned b0 = b - b % 3;
+		unsigned al = a0 + (a + 1) % 3;
+		unsigned bl = b0 + (b + 2) % 3;
+
+		unsigned p0 = triangles[ar];
+		unsigned pr = triangles[a];
+		unsigned pl = triangles[al];
+		unsigned p1 = triangles[bl];
+
+		if(inCircle(x(p0), y(p0), x(pr), y(pr), x(pl), y(pl), x(p1), y(p1)))
+		{
+			triangles[a] = p1;
+			triangles[b] = p0;
+
+			unsigned hbl = halfedges[bl];
+
+			// edge swapped on the other side of the hull (rare), fix the half edge reference
+			if(hbl == invalidIndex)
+			{
+				unsigned e = hullStart;
+				do
+				{
+					if(hullTri[e] == bl)
+					{
+						hullTri[e] = a;
+						break;
+					}
+					e = hullPrev[e];
+				} while(e != hullStart);
+			}
+			link(a, hbl);
+			link(b, halfedges[ar]);
+			link(ar, bl);
+
+			unsigned br = b0 + (b + 1) % 3;
+
+			if(stackSize == edgeStack.size()) edgeStack.push_back(br);
+			else edgeStack[stackSize] = br;
+			++stackSize;
+		}
+		else
+		{
+			if(stackSize == 0) break;
+			a = edgeStack[--stackSize];
+		}
+	}
+
+	return ar;
+}
+
+std::vector<unsigned int> Triangulator::run()
+{
+	if(numPoints < 3) return {};
+
+	// seed triangle: the point closest to the center of the bounding box, its nearest
+	// neighbour, and the point that forms the smallest circumcircle with those two
+	double minX = std::numeric_limits<double>::infinity(), minY = minX;
+	double maxX = -minX, maxY = -minX;
+	for(unsigned i = 0; i < numPoints; ++i)
+	{
+		minX = std::min(minX, x(i));
+		minY = std::min(minY, y(i));
+		maxX = std::max(maxX, x(i));
+		maxY = std::max(maxY, y(i));
+	}
+	double boxCenterX = (minX + maxX) / 2.0, boxCenterY = (minY + maxY) / 2.0;
+
+	unsigned i0 = invalidIndex, i1 = invalidIndex, i2 = invalidIndex;
+	double minDist = std::numeric_limits<double>::infinity();
+	for(unsigned i = 0; i < numPoints; ++i)
+	{
+		double dx = x(i) - boxCenterX, dy = y(i) - boxCenterY;
+		double d = dx * dx + dy * dy;
+		if(d < minDist)
+		{
+			i0 = i;
+			minDist = d;
+		}
+	}
+
+	minDist = std::numeric_limits<double>::infinity();
+	for(unsigned i = 0; i < numPoints; ++i)
+	{
+		if(i == i0) continue;
+		double dx = x(i) - x(i0), dy = y(i) - y(i0);
+		double d = dx * dx + dy * dy;
+		if(d < minDist && d > 0.0)
+		{
+			i1 = i;
+			minDist = d;
+		}
+	}
+	if(i1 == invalidIndex) return {}; // all points are the same
+
+	double minRadius = std::numeric_limits<double>::infinity();
+	for(unsigned i = 0; i < numPoints; ++i)
+	{
+		if(i == i0 || i == i1) continue;
+		double r = circumradius(x(i0), y(i0), x(i1), y(i1), x(i), y(i));
+		if(r < minRadius)
+		{
+			i2 = i;
+			minRadius = r;
+		}
+	}
+	if(i2 == invalidIndex) return {}; // all points are collinear
+
+	if(orient(x(i0), y(i0), x(i1), y(i1), x(i2), y(i2))) std::swap(i1, i2);
+
+	circumcenter(x(i0), y(i0), x(i1), y(i1), x(i2), y(i2), centerX, centerY);
+
+	// sweep the points in order of distance from the seed circumcenter
+	std::vector<double> dists(numPoints);
+	for(unsigned i = 0; i < numPoints; ++i)
+	{
+		double dx = x(i) - centerX, dy = y(i) - centerY;
+		dists[i] = dx * dx + dy * dy;
+	}
+	std::vector<unsigned> ids(numPoints);
+	std::iota(ids.begin(), ids.end(), 0u);
+	std::sort(ids.begin(), ids.end(), [&dists](unsigned a, unsigned b)
+		{
+			return dists[a] < dists[b];
+		});
+
+	hashSize = std::max<size_t>(1, size_t(std::ceil(std::sqrt(double(numPoints)))));
+	hullPrev.assign(numPoints, 0);
+	hullNext.assign(numPoints, 0);
+	hullTri.assign(numPoints, 0);
+	hullHash.assign(hashSize, invalidIndex);
+
+	hullStart = i0;
+
+	hullNext[i0] = hullPrev[i2] = i1;
+	hullNext[i1] = hullPrev[i0] = i2;
+	hullNext[i2] = hullPrev[i1] = i0;
+
+	hullTri[i0] = 0;
+	hullTri[i1] = 1;
+	hullTri[i2] = 2;
+
+	hullHash[hashKey(x(i0), y(i0))] = i0;
+	hullHash[hashKey(x(i1), y(i1))] = i1;
+	hullHash[hashKey(x(i2), y(i2))] = i2;
+
+	// a planar triangulation of n points has at most 2n - 5 triangles
+	size_t maxTriangles = numPoints < 3 ? 1 : 2 * numPoints - 5;
+	triangles.reserve(maxTriangles * 3);
+	halfedges.reserve(maxTriangles * 3);
+
+	addTriangle(i0, i1, i2, invalidIndex, invalidIndex, invalidIndex);
+
+	double prevX = std::numeric_limits<double>::quiet_NaN(), prevY = prevX;
+
+	for(size_t k = 0; k < numPoints; ++k)
+	{
+		unsigned i = ids[k];
+		double px = x(i), py = y(i);
+
+		// skip near-duplicate points
+		if(k > 0 && std::abs(px - prevX) <= std::numeric_limits<double>::epsilon()
+			&& std::abs(py - prevY) <= std::numeric_limits<double>::epsilon()) continue;
+		prevX = px;
+		prevY = py;
+
+		// skip seed triangle points
+		if(i == i0 || i == i1 || i == i2) continue;
+
+		// find a visible edge on the convex hull using the edge hash
+		unsigned start = 0;
+		size_t key = hashKey(px, py);
+		for(size_t j = 0; j < hashSize; ++j)
+		{
+			start = hullHash[(key + j) % hashSize];
+			if(start != invalidIndex && start != hullNext[start]) break;
+		}
+
+		start = hullPrev[start];
+		unsigned e = start, q;
+		while(q = hullNext[e], !orient(px, py, x(e), y(e), x(q), y(q)))
+		{
+			e = q;
+			if(e == start)
+			{
+				e = invalidIndex;
+				break;
+			}
+		}
+		if(e == invalidIndex) continue; // likely a near-duplicate point, skip it
+
+		// add the first triangle from the point
+		unsigned t = addTriangle(e, i, hullNext[e], invalidIndex, invalidIndex, hullTri[e]);
+
+		// recursively flip triangles from the point until they satisfy the Delaunay condition
+		hullTri[i] = legalize(t + 2);
+		hullTri[e] = t; // keep track of boundary triangles on the hull
+
+		// walk forward through the hull, adding more triangles and flipping recursively
+		unsigned next = hullNext[e];
+		while(q = hullNext[next], orient(px, py, x(next), y(next), x(q), y(q)))
+		{
+			t = addTriangle(next, i, q, hullTri[i], invalidIndex, hullTri[next]);
+			hullTri[i] = legalize(t + 2);
+			hullNext[next] = next; // mark as removed
+			next = q;
+		}
+
+		// walk backward from the other side, adding more triangles and flipping
+		if(e == start)
+		{
+			while(q = hullPrev[e], orient(px, py, x(q), y(q), x(e), y(e)))
+			{
+				t = addTriangle(q, i, e, invalidIndex, hullTri[e], hullTri[q]);
+				legalize(t + 2);
+				hullTri[q] = t;
+				hullNext[e] = e; // mark as removed
+				e = q;
+			}
+		}
+
+		// update the hull indices
+		hullStart = hullPrev[i] = e;
+		hullNext[e] = hullPrev[next] = i;
+		hullNext[i] = next;
+
+		// save the two new edges in the hash table
+		hullHash[hashKey(px, py)] = i;
+		hullHash[hashKey(x(e), y(e))] = e;
+	}
+
+	return std::move(triangles);
+}
+
+// hash of a lattice point to [0, 1)
+float latticeValue(int32_t x, int32_t y, unsigned seed)
+{
+	uint32_t h = uint32_t(x) * 0x8da6b343u ^ uint32_t(y) * 0xd8163841u ^ seed * 0xcb1ab31fu;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return float(h >> 8) / float(1u << 24);
+}
+
+// smoothly interpolated value noise, in [0, 1)
+float valueNoise(float x, float y, unsigned seed)
+{
+	float fx = std::floor(x), fy = std::floor(y);
+	int32_t ix = int32_t(fx), iy = int32_t(fy);
+	float tx = x - fx, ty = y - fy;
+	tx = tx * tx * (3.f - 2.f * tx);
+	ty = ty * ty * (3.f - 2.f * ty);
+
+	float a = latticeValue(ix, iy, seed), b = latticeValue(ix + 1, iy, seed);
+	float c = latticeValue(ix, iy + 1, seed), d = latticeValue(ix + 1, iy + 1, seed);
+	return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * ty;
+}
+
+}
+
+std::vector<float> jitteredPoints(float width, float depth, float spacing, float jitter, unsigned seed)
+{
+	std::vector<float> points;
+	if(spacing <= 0.f || width <= 0.f || depth <= 0.f) return points;
+
+	unsigned cellsX = std::max(1u, unsigned(std::ceil(width / spacing)));
+	unsigned cellsY = std::max(1u, unsigned(std::ceil(depth / spacing)));
+	float cellW = width / cellsX, cellH = depth / cellsY;
+
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<float> distr(-.5f, .5f);
+
+	points.reserve(2 * ((cellsX + 1) * (cellsY + 1)));
+
+	// the border, jittered only along its own direction so it stays straight
+	for(unsigned i = 0; i <= cellsX; ++i)
+	{
+		float offset = (i == 0 || i == cellsX) ? 0.f : distr(gen) * jitter * cellW;
+		float px = -width / 2.f + i * cellW + offset;
+		points.insert(points.end(), { px, -depth / 2.f, px, depth / 2.f });
+	}
+	for(unsigned i = 1; i < cellsY; ++i)
+	{
+		float py = -depth / 2.f + i * cellH + distr(gen) * jitter * cellH;
+		points.insert(points.end(), { -width / 2.f, py, width / 2.f, py });
+	}
+
+	// the inside, one point per cell not touching the border
+	for(unsigned cy = 1; cy < cellsY; ++cy)
+	{
+		for(unsigned cx = 1; cx < cellsX; ++cx)
+		{
+			float px = -width / 2.f + cx * cellW + distr(gen) * jitter * cellW;
+			float py = -depth / 2.f + cy * cellH + distr(gen) * jitter * cellH;
+			points.push_back(px);
+			points.push_back(py);
+		}
+	}
+
+	return points;
+}
+
+std::vector<unsigned int> delaunayTriangulate(const std::vector<float>& points)
+{
+	return Triangulator(points).run();
+}
+
+Mesh meshFromPoints(const std::vector<float>& points, const std::vector<unsigned int>& triangles,
+                    float heightScale, float heightFrequency, unsigned seed)
+{
+	Mesh mesh;
+	size_t numPoints = points.size() / 2;
+
+	mesh.positions.resize(numPoints * 3);
+	for(size_t i = 0; i < numPoints; ++i)
+	{
+		float px = points[2 * i], pz = points[2 * i + 1];
+
+		// two octaves of value noise, centered around 0
+		float height = 0.f;
+		if(heightScale != 0.f)
+		{
+			height = valueNoise(px * heightFrequency, pz * heightFrequency, seed) - .5f;
+			height += .5f * (valueNoise(px * heightFrequency * 2.f, pz * heightFrequency * 2.f, seed + 1) - .5f);
+			height *= heightScale;
+		}
+
+		mesh.positions[3 * i + 0] = px;
+		mesh.positions[3 * i + 1] = height;
+		mesh.positions[3 * i + 2] = pz;
+	}
+
+	mesh.indices = triangles;
+	return mesh;
+}
+
+Mesh generateLowPolyMesh(const MeshGenSettings& settings)
+{
+	std::vector<float> points;
+	if(settings.poissonDisk)
+	{
+		PoissonDiskSettings poissonSettings;
+		poissonSettings.width = settings.width;
+		poissonSettings.depth = settings.depth;
+		poissonSettings.minDistance = settings.spacing;
+		poissonSettings.maxDistance = settings.sparseSpacing;
+		poissonSettings.importance = settings.importance;
+		poissonSettings.seed = settings.seed;
+		points = poissonDiskPoints(poissonSettings);
+	}
+	else
+	{
+		points = jitteredPoints(settings.width, settings.depth, settings.spacing, settings.jitter, settings.seed);
+	}
+	std::vector<unsigned int> triangles = delaunayTriangulate(points);
+
+	return meshFromPoints(points, triangles, settings.heightScale, settings.heightFrequency, settings.seed);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+class ImportanceMap;
+
+struct MeshGenSettings
+{
+	// size of the generated patch on the x/z plane, centered on the origin
+	float width = 16.f;
+	float depth = 16.f;
+
+	// spread the points as Poisson disk blue noise, otherwise on a jittered grid
+	bool poissonDisk = true;
+
+	// distance between neighbouring points: the grid size, or the smallest distance for the Poisson disk
+	float spacing = .25f;
+	// 0 keeps the points on a regular grid, 1 lets them move anywhere in their grid cell
+	float jitter = .8f;
+
+	// optional with the Poisson disk: points are spacing apart where the map is white,
+	// and sparseSpacing apart where it is black
+	const ImportanceMap* importance = nullptr;
+	float sparseSpacing = 1.f;
+
+	// height displacement along y, 0 for a flat mesh
+	float heightScale = .3f;
+	// features of the displacement per unit
+	float heightFrequency = .4f;
+
+	unsigned seed = 1;
+};
+
+// One point per grid cell of size spacing, moved around randomly by jitter. The border
+// of the rectangle gets points of its own so the triangulation fills it completely.
+// Returns x, y pairs.
+std::vector<float> jitteredPoints(float width, float depth, float spacing, float jitter, unsigned seed);
+
+// Delaunay triangulation of x, y pairs, returns three point indices per triangle.
+// Runs in O(n log n) with a sweep hull, a few million points take a few seconds.
+// Duplicate points are skipped, if all points are collinear there are no triangles.
+std::vector<unsigned int> delaunayTriangulate(const std::vector<float>& points);
+
+// Lays x, y pairs out on the x/z plane and displaces them along y with value noise.
+Mesh meshFromPoints(const std::vector<float>& points, const std::vector<unsigned int>& triangles,
+                    float heightScale, float heightFrequency, unsigned seed);
+
+Mesh generateLowPolyMesh(const MeshGenSettings& settings);
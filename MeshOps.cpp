@@ -0,0 +1,378 @@
+#include "MeshOps.h"
+
+#include "Cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+const unsigned invalidIndex = std::numeric_limits<unsigned>::max();
+
+// bump when the file layout or what the preparation does to a mesh changes
+const uint32_t meshCacheVersion = 3;
+const char meshCacheMagic[8] = { 'W', 'G', 'M', 'E', 'S', 'H', '\r', '\n' };
+
+// triangles around each vertex: triangles[offsets[v]] to triangles[offsets[v + 1]]
+struct Adjacency
+{
+	Adjacency(const std::vector<unsigned int>& indices, size_t numVerts)
+		: offsets(numVerts + 1, 0), triangles(indices.size())
+	{
+		for(unsigned index : indices) ++offsets[index + 1];
+		for(size_t v = 0; v < numVerts; ++v) offsets[v + 1] += offsets[v];
+
+		std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+		for(size_t i = 0; i < indices.size(); ++i) triangles[fill[indices[i]]++] = unsigned(i / 3);
+	}
+
+	std::vector<unsigned> offsets, triangles;
+};
+
+// puts triangle order[t] at t, along with its face color and id
+void reorderTriangles(Mesh& mesh, const std::vector<unsigned>& order)
+{
+	std::vector<unsigned int> indices(mesh.indices.size());
+	for(size_t t = 0; t < order.size(); ++t) std::copy_n(&mesh.indices[order[t] * 3], 3, &indices[t * 3]);
+	mesh.indices.swap(indices);
+
+	if(mesh.faceColors.size() == order.size() * 3)
+	{
+		std::vector<float> faceColors(mesh.faceColors.size());
+		for(size_t t = 0; t < order.size(); ++t) std::copy_n(&mesh.faceColors[order[t] * 3], 3, &faceColors[t * 3]);
+		mesh.faceColors.swap(faceColors);
+	}
+
+	if(mesh.faceIds.size() == order.size())
+	{
+		std::vector<unsigned int> faceIds(order.size());
+		for(size_t t = 0; t < order.size(); ++t) faceIds[t] = mesh.faceIds[order[t]];
+		mesh.faceIds.swap(faceIds);
+	}
+}
+
+}
+
+MeshStats analyzeMesh(const Mesh& mesh, unsigned cacheSize)
+{
+	MeshStats stats;
+	const size_t numVerts = mesh.positions.size() / 3;
+	if(mesh.indices.empty() || numVerts == 0) return stats;
+
+	// FIFO caches: an entry is still cached while fewer than cacheSize misses happened since it was loaded
+	const unsigned lineBytes = 64, lineCacheSize = 16;
+	const size_t vertexBytes = sizeof(float) * 3;
+	std::vector<size_t> loadedAt(numVerts, 0), lineLoadedAt(numVerts * vertexBytes / lineBytes + 2, 0);
+	size_t misses = 0, lineMisses = 0;
+
+	for(unsigned index : mesh.indices)
+	{
+		if(loadedAt[index] && misses - loadedAt[index] < cacheSize) continue;
+		loadedAt[index] = ++misses;
+
+		size_t first = index * vertexBytes / lineBytes, last = (index * vertexBytes + vertexBytes - 1) / lineBytes;
+		for(size_t line = first; line <= last; ++line)
+		{
+			if(lineLoadedAt[line] && lineMisses - lineLoadedAt[line] < lineCacheSize) continue;
+			lineLoadedAt[line] = ++lineMisses;
+		}
+	}
+
+	stats.acmr = float(misses) / (mesh.indices.size() / 3);
+	stats.atvr = float(misses) / numVerts;
+	stats.overfetch = float(lineMisses * lineBytes) / (numVerts * vertexBytes);
+	return stats;
+}
+
+void clusterTriangles(Mesh& mesh, unsigned trianglesPerCluster)
+{
+	const size_t numTriangles = mesh.indices.size() / 3;
+	mesh.clusters.clear();
+	if(numTriangles == 0) return;
+
+	float low[3], high[3];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		low[axis] = std::numeric_limits<float>::max();
+		high[axis] = std::numeric_limits<float>::lowest();
+	}
+	for(unsigned index : mesh.indices)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			low[axis] = std::min(low[axis], mesh.positions[index * 3 + axis]);
+			high[axis] = std::max(high[axis], mesh.positions[index * 3 + axis]);
+		}
+	}
+
+	// 10 bits of the centroid per axis, interleaved
+	std::vector<std::pair<uint32_t, unsigned>> codes(numTriangles);
+	for(size_t t = 0; t < numTriangles; ++t)
+	{
+		uint32_t code = 0;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float centroid = 0.f;
+			for(int c = 0; c < 3; ++c) centroid += mesh.positions[mesh.indices[t * 3 + c] * 3 + axis];
+			float extent = high[axis] > low[axis] ? high[axis] - low[axis] : 1.f;
+			uint32_t cell = uint32_t(std::min(std::max((centroid / 3.f - low[axis]) / extent, 0.f), 1.f) * 1023.f);
+			for(int bit = 0; bit < 10; ++bit) code |= ((cell >> bit) & 1u) << (bit * 3 + axis);
+		}
+		codes[t] = { code, unsigned(t) };
+	}
+	std::sort(codes.begin(), codes.end());
+
+	std::vector<unsigned> order(numTriangles);
+	for(size_t t = 0; t < numTriangles; ++t) order[t] = codes[t].second;
+	reorderTriangles(mesh, order);
+
+	trianglesPerCluster = std::max(trianglesPerCluster, 1u);
+	for(size_t t = 0; t < numTriangles; t += trianglesPerCluster) mesh.clusters.push_back(unsigned(t));
+}
+
+void optimizeTriangleOrder(Mesh& mesh, unsigned cacheSize)
+{
+	const size_t numVerts = mesh.positions.size() / 3;
+	const size_t numTriangles = mesh.indices.size() / 3;
+	if(numTriangles == 0) return;
+
+	Adjacency adjacency(mesh.indices, numVerts);
+
+	// cache time stamps start far enough back that every vertex misses
+	std::vector<size_t> cachedAt(numVerts, 0);
+	size_t time = cacheSize + 1;
+
+	// triangles left to emit around each vertex, counting only the current cluster's
+	std::vector<unsigned> live(numVerts, 0);
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<unsigned> order;
+	order.reserve(numTriangles);
+
+	// vertices of recent triangles, to continue from when the fan runs dry
+	std::vector<unsigned> deadEnd;
+	std::vector<unsigned> candidates;
+
+	// triangles stay in their cluster, without clusters the whole mesh is one
+	std::vector<unsigned> starts = mesh.clusters;
+	if(starts.empty()) starts.push_back(0);
+	starts.push_back(unsigned(numTriangles));
+
+	for(size_t cluster = 0; cluster + 1 < starts.size(); ++cluster)
+	{
+		const unsigned begin = starts[cluster], end = starts[cluster + 1];
+		for(size_t i = begin * size_t(3); i < end * size_t(3); ++i) ++live[mesh.indices[i]];
+
+		deadEnd.clear();
+		unsigned cursor = begin;
+
+		// fan around one vertex at a time
+		for(unsigned fanning = mesh.indices[begin * 3]; fanning != invalidIndex; )
+		{
+			candidates.clear();
+			for(unsigned i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; ++i)
+			{
+				unsigned triangle = adjacency.triangles[i];
+				if(triangle < begin || triangle >= end || emitted[triangle]) continue;
+				emitted[triangle] = true;
+				order.push_back(triangle);
+
+				for(int c = 0; c < 3; ++c)
+				{
+					unsigned v = mesh.indices[triangle * 3 + c];
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					if(time - cachedAt[v] > cacheSize) cachedAt[v] = time++;
+				}
+			}
+
+			// the candidate that is furthest back in the cache but will still be in it after
+			// its remaining triangles are emitted
+			unsigned next = invalidIndex;
+			size_t bestPriority = 0;
+			for(unsigned v : candidates)
+			{
+				if(live[v] == 0) continue;
+
+				size_t priority = 1;
+				if(time - cachedAt[v] + 2 * live[v] <= cacheSize) priority = time - cachedAt[v] + 1;
+				if(priority > bestPriority)
+				{
+					bestPriority = priority;
+					next = v;
+				}
+			}
+
+			// no candidate left: back up through the recent vertices, then scan for any unfinished triangle
+			while(next == invalidIndex && !deadEnd.empty())
+			{
+				if(live[deadEnd.back()] > 0) next = deadEnd.back();
+				deadEnd.pop_back();
+			}
+			while(next == invalidIndex && cursor < end)
+			{
+				if(!emitted[cursor]) next = mesh.indices[cursor * 3];
+				++cursor;
+			}
+
+			fanning = next;
+		}
+	}
+
+	reorderTriangles(mesh, order);
+}
+
+void optimizeVertexOrder(Mesh& mesh)
+{
+	std::vector<unsigned> remap(mesh.positions.size() / 3, invalidIndex);
+	std::vector<float> positions;
+	positions.reserve(mesh.positions.size());
+
+	for(unsigned& index : mesh.indices)
+	{
+		if(remap[index] == invalidIndex)
+		{
+			remap[index] = unsigned(positions.size() / 3);
+			positions.insert(positions.end(), &mesh.positions[index * 3], &mesh.positions[index * 3] + 3);
+		}
+		index = remap[index];
+	}
+
+	mesh.positions.swap(positions);
+}
+
+unsigned provokingVertexLayout(Mesh& mesh)
+{
+	const size_t numVerts = mesh.positions.size() / 3;
+	const size_t numTriangles = mesh.indices.size() / 3;
+
+	// triangles not yet assigned around each vertex. Taking the corner with the fewest of them
+	// leaves the busier vertices free for their other triangles.
+	std::vector<unsigned> pending(numVerts, 0);
+	for(unsigned index : mesh.indices) ++pending[index];
+
+	std::vector<bool> provoking(numVerts, false);
+	unsigned added = 0;
+
+	for(size_t t = 0; t < numTriangles; ++t)
+	{
+		unsigned* corners = &mesh.indices[t * 3];
+
+		int chosen = -1;
+		for(int c = 0; c < 3; ++c)
+		{
+			if(!provoking[corners[c]] && (chosen < 0 || pending[corners[c]] < pending[corners[chosen]])) chosen = c;
+		}
+		for(int c = 0; c < 3; ++c) --pending[corners[c]];
+
+		if(chosen < 0)
+		{
+			chosen = 2;
+			const float* position = &mesh.positions[corners[2] * 3];
+			float copy[3] = { position[0], position[1], position[2] };
+			mesh.positions.insert(mesh.positions.end(), copy, copy + 3);
+			corners[2] = unsigned(mesh.positions.size() / 3 - 1);
+			provoking.push_back(true);
+			pending.push_back(0);
+			++added;
+		}
+		provoking[corners[chosen]] = true;
+
+		// rotating keeps the winding
+		std::rotate(corners, corners + (chosen + 1) % 3, corners + 3);
+	}
+
+	return added;
+}
+
+QuantizedPositions quantizePositions(const std::vector<float>& positions)
+{
+	QuantizedPositions quantized;
+	const size_t numVerts = positions.size() / 3;
+	if(numVerts == 0) return quantized;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		float low = positions[axis], high = positions[axis];
+		for(size_t v = 1; v < numVerts; ++v)
+		{
+			low = std::min(low, positions[v * 3 + axis]);
+			high = std::max(high, positions[v * 3 + axis]);
+		}
+		quantized.offset[axis] = low;
+		// a flat axis still needs a scale to divide by, any value maps back to low
+		quantized.scale[axis] = high > low ? high - low : 1.f;
+	}
+
+	quantized.values.resize(numVerts * 4, 0);
+	for(size_t v = 0; v < numVerts; ++v)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float normalized = (positions[v * 3 + axis] - quantized.offset[axis]) / quantized.scale[axis];
+			quantized.values[v * 4 + axis] = uint16_t(std::min(std::max(normalized, 0.f), 1.f) * 65535.f + .5f);
+		}
+	}
+	return quantized;
+}
+
+std::vector<uint16_t> shortIndices(const std::vector<unsigned int>& indices, size_t numVerts)
+{
+	if(numVerts > 65536) return std::vector<uint16_t>();
+	return std::vector<uint16_t>(indices.begin(), indices.end());
+}
+
+bool saveMesh(const std::string& path, const Mesh& mesh, const std::string& tag)
+{
+	std::ofstream file(path, std::ios::binary);
+	if(!file) return false;
+
+	file.write(meshCacheMagic, sizeof(meshCacheMagic));
+	file.write(reinterpret_cast<const char*>(&meshCacheVersion), sizeof(meshCacheVersion));
+	writeArray(file, std::vector<char>(tag.begin(), tag.end()));
+	writeArray(file, mesh.positions);
+	writeArray(file, mesh.indices);
+	writeArray(file, mesh.faceColors);
+	writeArray(file, mesh.faceIds);
+	writeArray(file, mesh.clusters);
+
+	return bool(file);
+}
+
+bool loadMesh(const std::string& path, Mesh& mesh, const std::string& tag)
+{
+	std::ifstream file(path, std::ios::binary);
+	if(!file) return false;
+
+	char magic[sizeof(meshCacheMagic)];
+	uint32_t version = 0;
+	std::vector<char> fileTag;
+	if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, meshCacheMagic, sizeof(magic)) != 0) return false;
+	if(!file.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != meshCacheVersion) return false;
+	if(!readArray(file, fileTag) || std::string(fileTag.begin(), fileTag.end()) != tag) return false;
+
+	Mesh loaded;
+	if(!readArray(file, loaded.positions) || !readArray(file, loaded.indices) || !readArray(file, loaded.faceColors)
+		|| !readArray(file, loaded.faceIds) || !readArray(file, loaded.clusters))
+	{
+		return false;
+	}
+
+	size_t numVerts = loaded.positions.size() / 3;
+	for(unsigned index : loaded.indices)
+	{
+		if(index >= numVerts) return false;
+	}
+	for(size_t i = 0; i < loaded.clusters.size(); ++i)
+	{
+		if(loaded.clusters[i] >= loaded.indices.size() / 3 || (i && loaded.clusters[i] <= loaded.clusters[i - 1])) return false;
+	}
+
+	mesh = std::move(loaded);
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <cstdint>
+#include <string>
+
+struct MeshStats
+{
+	// average cache misses per triangle with a FIFO post-transform cache, 0.5 is about the best a
+	// regular grid can do and 3 means every corner is transformed again
+	float acmr = 0.f;
+	// cache misses per vertex, 1 is ideal
+	float atvr = 0.f;
+	// bytes read from the position buffer in 64 byte lines per byte of positions, 1 is ideal
+	float overfetch = 0.f;
+};
+
+// Simulates the vertex cache and fetch of drawing the mesh in index order.
+MeshStats analyzeMesh(const Mesh& mesh, unsigned cacheSize = 16);
+
+// Sorts the triangles along a Morton curve through their centroids and cuts them into clusters of
+// trianglesPerCluster neighbours, for culling. Face colors and ids move along with their triangles.
+void clusterTriangles(Mesh& mesh, unsigned trianglesPerCluster = 512);
+
+// Tipsify (Sander et al. 2007): reorders triangles so they reuse the vertices still in a post-transform
+// cache of cacheSize. Runs in linear time. Triangles stay within their cluster, face colors and ids move along.
+void optimizeTriangleOrder(Mesh& mesh, unsigned cacheSize = 16);
+
+// Renumbers the vertices in the order the indices first use them, so fetches walk the position
+// buffer forward. Drops unused vertices.
+void optimizeVertexOrder(Mesh& mesh);
+
+// Rotates the corners of every triangle so that its last vertex, the one flat interpolation takes
+// its value from (GL_LAST_VERTEX_CONVENTION, the default), provokes no other triangle. A per
+// vertex attribute then works as a per face one. Where all three corners of a triangle already
+// provoke others, one of them is duplicated. Returns the number of vertices added.
+// A mesh has about twice as many triangles as vertices, so about half of the triangles need one.
+unsigned provokingVertexLayout(Mesh& mesh);
+
+// Positions as 16 bit normalized integers over their bounding box: position = offset + scale * value / 65535.
+// Four values per vertex, the last one is padding so every vertex starts 4 byte aligned for the GPU.
+struct QuantizedPositions
+{
+	std::vector<uint16_t> values;
+	float offset[3] = { 0.f, 0.f, 0.f };
+	float scale[3] = { 1.f, 1.f, 1.f };
+};
+
+QuantizedPositions quantizePositions(const std::vector<float>& positions);
+
+// The indices as 16 bit if every vertex can be addressed with them, otherwise empty.
+std::vector<uint16_t> shortIndices(const std::vector<unsigned int>& indices, size_t numVerts);
+
+// Binary cache of a prepared mesh. tag identifies what it was made from, loading fails if the file
+// was written for another tag or by another version.
+bool saveMesh(const std::string& path, const Mesh& mesh, const std::string& tag);
+bool loadMesh(const std::string& path, Mesh& mesh, const std::string& tag);
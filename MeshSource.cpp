@@ -0,0 +1,127 @@
+#include "MeshSource.h"
+
+#include "Cache.h"
+#include "MeshOps.h"
+#include "tiny_obj_loader.h"
+
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+namespace
+{
+
+// the file's size and modification time stand in for its contents
+std::string fileTag(const std::string& kind, const std::string& path)
+{
+	struct stat info = {};
+	stat(path.c_str(), &info);
+	std::ostringstream tag;
+	tag << kind << ' ' << path << ' ' << info.st_size << ' ' << info.st_mtime;
+	return tag.str();
+}
+
+}
+
+unsigned optimizeForDrawing(Mesh& mesh)
+{
+	clusterTriangles(mesh);
+	optimizeTriangleOrder(mesh);
+	unsigned duplicated = provokingVertexLayout(mesh);
+	optimizeVertexOrder(mesh);
+	return duplicated;
+}
+
+Mesh prepareMesh(const std::string& tag, const std::function<Mesh()>& build)
+{
+	Mesh mesh;
+	std::string cacheFile = tag.empty() ? std::string() : cachePath("meshes", tag, ".mesh");
+	if(!cacheFile.empty() && loadMesh(cacheFile, mesh, tag))
+	{
+		std::cout << "Loaded prepared mesh from " << cacheFile << std::endl;
+		return mesh;
+	}
+
+	mesh = build();
+	if(mesh.indices.empty()) return mesh;
+
+	MeshStats before = analyzeMesh(mesh);
+	unsigned duplicated = optimizeForDrawing(mesh);
+	MeshStats after = analyzeMesh(mesh);
+
+	std::cout << "Duplicated " << duplicated << " vertices for flat colors" << std::endl;
+	std::cout << "Vertex cache ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+		<< ", fetch overfetch " << before.overfetch << " -> " << after.overfetch << std::endl;
+
+	if(!cacheFile.empty() && !saveMesh(cacheFile, mesh, tag))
+	{
+		std::cout << "Failed to cache mesh at " << cacheFile << std::endl;
+	}
+
+	return mesh;
+}
+
+Mesh generatedMesh(const MeshGenSettings& settings)
+{
+	std::ostringstream tag;
+	tag << "generated " << settings.width << ' ' << settings.depth << ' ' << settings.poissonDisk << ' ' << settings.spacing
+		<< ' ' << settings.jitter << ' ' << settings.sparseSpacing << ' ' << settings.heightScale << ' '
+		<< settings.heightFrequency << ' ' << settings.seed;
+
+	return prepareMesh(settings.importance ? std::string() : tag.str(), [&]
+		{
+			Mesh generated = generateLowPolyMesh(settings);
+			std::cout << "Generated mesh with " << generated.positions.size() / 3 << " vertices and " << generated.indices.size() / 3 << " triangles" << std::endl;
+			return generated;
+		});
+}
+
+Mesh imageMesh(const std::string& path, const LowPolySettings& settings, unsigned& error)
+{
+	std::ostringstream tag;
+	tag << fileTag("image", path) << ' ' << settings.edgeSpacing << ' ' << settings.flatSpacing << ' '
+		<< settings.edgeThreshold << ' ' << settings.seed;
+
+	error = 0;
+	return prepareMesh(tag.str(), [&]
+		{
+			Mesh image;
+			LowPolyImage lowPoly;
+			error = lowPolyFromImage(path, settings, lowPoly);
+			if(error) return image;
+
+			std::cout << "Triangulated " << path << " into " << lowPoly.triangles.size() / 3 << " triangles" << std::endl;
+
+			image.positions.reserve(lowPoly.points.size() / 2 * 3);
+			for(size_t i = 0; i < lowPoly.points.size(); i += 2)
+			{
+				image.positions.insert(image.positions.end(), { lowPoly.points[i], 0.f, lowPoly.points[i + 1] });
+			}
+			image.indices = std::move(lowPoly.triangles);
+			image.faceColors = std::move(lowPoly.triangleColors);
+			return image;
+		});
+}
+
+Mesh objMesh(const std::string& path, std::string& error)
+{
+	return prepareMesh(fileTag("obj", path), [&]
+		{
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> mats;
+
+			Mesh mesh;
+			if(!tinyobj::LoadObj(shapes, mats, error, path.c_str())) return mesh;
+
+			for(const tinyobj::shape_t& shape : shapes)
+			{
+				unsigned int base = mesh.positions.size() / 3;
+				mesh.positions.insert(mesh.positions.end(), shape.mesh.positions.begin(), shape.mesh.positions.end());
+				for(unsigned int index : shape.mesh.indices) mesh.indices.push_back(base + index);
+			}
+
+			std::cout << "Loaded " << path << " with " << mesh.positions.size() / 3 << " vertices and " << mesh.indices.size() / 3 << " triangles" << std::endl;
+			return mesh;
+		});
+}
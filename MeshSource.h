@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MeshGen.h"
+#include "LowPoly.h"
+
+#include <functional>
+#include <string>
+
+// Clusters for culling, triangle and vertex order for the caches, and a provoking vertex per face
+// for flat colors. Returns the number of vertices that had to be duplicated for that.
+unsigned optimizeForDrawing(Mesh& mesh);
+
+// Loads the mesh made from tag out of the cache, or builds it, optimizes it for drawing and caches
+// the result. An empty tag skips the cache.
+Mesh prepareMesh(const std::string& tag, const std::function<Mesh()>& build);
+
+// The prepared meshes the app draws. They are empty if loading failed, error says why.
+
+// A generated patch. Meshes over an importance map aren't cached, the map isn't part of the tag.
+Mesh generatedMesh(const MeshGenSettings& settings);
+
+// A low-poly image in pixels on the x/z plane, with its face colors. error is a lodepng error code.
+Mesh imageMesh(const std::string& path, const LowPolySettings& settings, unsigned& error);
+
+// All shapes of an OBJ file in one mesh.
+Mesh objMesh(const std::string& path, std::string& error);
@@ -0,0 +1,43 @@
+#include "Palette.h"
+
+#include <random>
+
+std::array<float, 3> fromRGB(unsigned char r, unsigned char g, unsigned char b)
+{
+	return{ (float)r / 255.f, (float)g / 255.f, (float)b / 255.f };
+}
+
+std::array<float, 3> fromHex(uint32_t color)
+{
+	return fromRGB(color >> 24, color << 8 >> 24, color << 16 >> 24);
+}
+
+std::vector<std::array<float, 3>> pickPaletteColors(const std::vector<std::array<float, 3>>& palette, size_t count, unsigned seed)
+{
+	std::vector<std::array<float, 3>> colors(count, {{ 1.f, 1.f, 1.f }});
+	if(palette.empty()) return colors;
+
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<> distr(0, palette.size() - 1);
+
+	for(std::array<float, 3>& color : colors)
+	{
+		color = palette[distr(gen)];
+	}
+
+	return colors;
+}
+
+std::vector<std::array<float, 3>> provokingVertexColors(const Mesh& mesh)
+{
+	std::vector<std::array<float, 3>> colors;
+	if(mesh.faceColors.size() != mesh.indices.size()) return colors;
+
+	colors.assign(mesh.positions.size() / 3, {{ 0.f, 0.f, 0.f }});
+	for(size_t t = 0; t < mesh.indices.size() / 3; ++t)
+	{
+		const float* color = &mesh.faceColors[t * 3];
+		colors[mesh.indices[t * 3 + 2]] = {{ color[0], color[1], color[2] }};
+	}
+	return colors;
+}
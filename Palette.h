@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+std::array<float, 3> fromRGB(unsigned char r, unsigned char g, unsigned char b);
+
+// 0xRRGGBBxx, the low byte is ignored
+std::array<float, 3> fromHex(uint32_t color);
+
+// One random pick out of palette per vertex, the same picks for the same seed and count.
+// An empty palette colors everything white.
+std::vector<std::array<float, 3>> pickPaletteColors(const std::vector<std::array<float, 3>>& palette, size_t count, unsigned seed);
+
+// The mesh's face colors moved onto the vertex each face takes its flat color from, the last one
+// of the triangle. Empty if the mesh has no face colors.
+std::vector<std::array<float, 3>> provokingVertexColors(const Mesh& mesh);
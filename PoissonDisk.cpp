@@ -0,0 +1,343 @@
+#include "PoissonDisk.h"
+
+#include "lodepng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+
+unsigned ImportanceMap::load(const std::string& path)
+{
+	std::vector<unsigned char> image;
+	unsigned error = lodepng::decode(image, width, height, path, LCT_RGB, 8);
+	if(error)
+	{
+		width = height = 0;
+		values.clear();
+		return error;
+	}
+
+	values.resize(size_t(width) * height);
+	for(size_t i = 0; i < values.size(); ++i)
+	{
+		values[i] = (.2126f * image[i * 3] + .7152f * image[i * 3 + 1] + .0722f * image[i * 3 + 2]) / 255.f;
+	}
+	return 0;
+}
+
+float ImportanceMap::at(float u, float v) const
+{
+	if(values.empty()) return 1.f;
+
+	float x = std::min(std::max(u * width - .5f, 0.f), float(width - 1));
+	float y = std::min(std::max(v * height - .5f, 0.f), float(height - 1));
+	unsigned x0 = unsigned(x), y0 = unsigned(y);
+	unsigned x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+	float tx = x - x0, ty = y - y0;
+
+	float top = values[y0 * width + x0] + (values[y0 * width + x1] - values[y0 * width + x0]) * tx;
+	float bottom = values[y1 * width + x0] + (values[y1 * width + x1] - values[y1 * width + x0]) * tx;
+	return top + (bottom - top) * ty;
+}
+
+namespace
+{
+
+// The patch is covered by a background grid with cells small enough to hold at most one point,
+// so checking a candidate only looks at the few cells around it. The grid is split into tiles
+// that are sampled independently, in four phases by the parity of their tile coordinates: tiles
+// of the same phase are a whole tile apart, further than any point's reach, so they can run in
+// parallel and only see the finished tiles of earlier phases across their borders.
+class Sampler
+{
+public:
+	explicit Sampler(const PoissonDiskSettings& settings);
+
+	std::vector<float> run();
+
+private:
+	float radiusAt(float x, float y) const
+	{
+		if(!settings.importance || settings.importance->empty()) return settings.minDistance;
+		float importance = settings.importance->at(1.f - x / settings.width, 1.f - y / settings.depth);
+		return settings.maxDistance + (settings.minDistance - settings.maxDistance) * importance;
+	}
+
+	int cellX(float x) const { return std::min(int(x / cellSize), gridW - 1); }
+	int cellY(float y) const { return std::min(int(y / cellSize), gridH - 1); }
+
+	bool fits(float x, float y, float radius) const;
+	bool fitsUniform(float x, float y) const;
+	bool fitsHere(float x, float y) const { return uniform ? fitsUniform(x, y) : fits(x, y, radiusAt(x, y)); }
+	void insert(float x, float y, std::vector<float>& out);
+
+	void sampleBorder(std::vector<float>& out);
+	void sampleTile(int tileX, int tileY, std::vector<float>& out);
+
+	PoissonDiskSettings settings;
+	float cellSize;
+	int gridW, gridH;
+	// x, y of the point in each cell, NaN for empty cells
+	std::vector<float> grid;
+
+	// without an importance map every check has the same reach: the cell offsets that can hold a
+	// point closer than minDistance, nearest first so that rejections are found early
+	bool uniform;
+	std::vector<int> neighbourOffsets;
+
+	// directions of the candidates around an active point
+	std::vector<float> directions;
+
+	int tileCells, tilesX, tilesY;
+};
+
+Sampler::Sampler(const PoissonDiskSettings& settings) : settings(settings)
+{
+	if(!this->settings.importance || this->settings.importance->empty())
+	{
+		this->settings.maxDistance = this->settings.minDistance;
+	}
+	this->settings.maxDistance = std::max(this->settings.maxDistance, this->settings.minDistance);
+
+	// the diagonal of a cell is the smallest distance, so no cell can hold two points
+	cellSize = this->settings.minDistance / std::sqrt(2.f);
+	gridW = std::max(1, int(std::ceil(settings.width / cellSize)));
+	gridH = std::max(1, int(std::ceil(settings.depth / cellSize)));
+	grid.assign(size_t(gridW) * gridH * 2, std::numeric_limits<float>::quiet_NaN());
+
+	// a point never looks further than maxDistance, which has to stay within the neighbouring tile
+	tileCells = std::max(32, int(std::ceil(this->settings.maxDistance / cellSize)) + 1);
+	tilesX = (gridW + tileCells - 1) / tileCells;
+	tilesY = (gridH + tileCells - 1) / tileCells;
+
+	uniform = this->settings.maxDistance == this->settings.minDistance;
+	std::vector<std::pair<int, int>> offsets;
+	for(int dy = -2; dy <= 2; ++dy)
+	{
+		for(int dx = -2; dx <= 2; ++dx)
+		{
+			// the corners of the 5x5 block are at least minDistance away
+			if(std::abs(dx) == 2 && std::abs(dy) == 2) continue;
+			offsets.emplace_back(dx * dx + dy * dy, dy * gridW + dx);
+		}
+	}
+	std::stable_sort(offsets.begin(), offsets.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b)
+		{
+			return a.first < b.first;
+		});
+	for(auto& offset : offsets) neighbourOffsets.push_back(offset.second);
+
+	const float tau = 6.28318530718f;
+	unsigned attempts = std::max(1u, this->settings.attempts);
+	for(unsigned i = 0; i < attempts; ++i)
+	{
+		directions.push_back(std::cos(tau * i / attempts));
+		directions.push_back(std::sin(tau * i / attempts));
+	}
+}
+
+bool Sampler::fitsUniform(float x, float y) const
+{
+	int cx = cellX(x), cy = cellY(y);
+	float radiusSq = settings.minDistance * settings.minDistance;
+
+	// away from the grid edges all offsets are valid, near them fall back to the clamped loop
+	if(cx < 2 || cy < 2 || cx >= gridW - 2 || cy >= gridH - 2) return fits(x, y, settings.minDistance);
+
+	const float* center = &grid[(size_t(cy) * gridW + cx) * 2];
+	for(int offset : neighbourOffsets)
+	{
+		const float* cell = center + offset * 2;
+		float dx = cell[0] - x, dy = cell[1] - y;
+		if(dx * dx + dy * dy < radiusSq) return false;
+	}
+	return true;
+}
+
+bool Sampler::fits(float x, float y, float radius) const
+{
+	if(x < 0.f || y < 0.f || x > settings.width || y > settings.depth) return false;
+
+	int reach = int(std::ceil(radius / cellSize));
+	int cx = cellX(x), cy = cellY(y);
+	int minX = std::max(cx - reach, 0), maxX = std::min(cx + reach, gridW - 1);
+	int minY = std::max(cy - reach, 0), maxY = std::min(cy + reach, gridH - 1);
+	float radiusSq = radius * radius;
+
+	for(int iy = minY; iy <= maxY; ++iy)
+	{
+		const float* cell = &grid[(size_t(iy) * gridW + minX) * 2];
+		for(int ix = minX; ix <= maxX; ++ix, cell += 2)
+		{
+			// NaN compares false, so empty cells never reject
+			float dx = cell[0] - x, dy = cell[1] - y;
+			if(dx * dx + dy * dy < radiusSq) return false;
+		}
+	}
+	return true;
+}
+
+void Sampler::insert(float x, float y, std::vector<float>& out)
+{
+	float* cell = &grid[(size_t(cellY(y)) * gridW + cellX(x)) * 2];
+	cell[0] = x;
+	cell[1] = y;
+	out.push_back(x);
+	out.push_back(y);
+}
+
+void Sampler::sampleBorder(std::vector<float>& out)
+{
+	// walk along the edges counterclockwise, stepping by the local distance
+	const float corners[5][2] = { { 0.f, 0.f }, { settings.width, 0.f }, { settings.width, settings.depth },
+		{ 0.f, settings.depth }, { 0.f, 0.f } };
+
+	// the corners come first, a walk ending just short of one would otherwise crowd it out
+	for(int corner = 0; corner < 4; ++corner)
+	{
+		float x = corners[corner][0], y = corners[corner][1];
+		if(fits(x, y, settings.minDistance)) insert(x, y, out);
+	}
+
+	for(int edge = 0; edge < 4; ++edge)
+	{
+		float ax = corners[edge][0], ay = corners[edge][1];
+		float bx = corners[edge + 1][0], by = corners[edge + 1][1];
+		float length = std::hypot(bx - ax, by - ay);
+
+		for(float t = radiusAt(ax, ay); t < length; )
+		{
+			float x = ax + (bx - ax) * t / length, y = ay + (by - ay) * t / length;
+			float radius = radiusAt(x, y);
+			if(fits(x, y, radius)) insert(x, y, out);
+			t += radius;
+		}
+	}
+}
+
+void Sampler::sampleTile(int tileX, int tileY, std::vector<float>& out)
+{
+	const int cellMinX = tileX * tileCells, cellMaxX = std::min(cellMinX + tileCells, gridW);
+	const int cellMinY = tileY * tileCells, cellMaxY = std::min(cellMinY + tileCells, gridH);
+	const float tau = 6.28318530718f;
+	const unsigned attempts = directions.size() / 2;
+
+	// every tile has its own generator, so the result doesn't depend on which thread runs it
+	std::seed_seq seq{ settings.seed, unsigned(tileX), unsigned(tileY) };
+	std::mt19937 gen(seq);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	std::vector<float> active;
+
+	// Candidates must land in this tile, so growing from one point can leave gaps along
+	// the tile edges. Every still empty cell gets a throw of its own to start from.
+	for(int cy = cellMinY; cy < cellMaxY; ++cy)
+	{
+		for(int cx = cellMinX; cx < cellMaxX; ++cx)
+		{
+			if(!std::isnan(grid[(size_t(cy) * gridW + cx) * 2])) continue;
+
+			float x = (cx + unit(gen)) * cellSize, y = (cy + unit(gen)) * cellSize;
+			if(!fitsHere(x, y)) continue;
+
+			insert(x, y, out);
+			active.push_back(x);
+			active.push_back(y);
+
+			while(!active.empty())
+			{
+				size_t pick = std::uniform_int_distribution<size_t>(0, active.size() / 2 - 1)(gen);
+				float ax = active[pick * 2], ay = active[pick * 2 + 1];
+				float radius = radiusAt(ax, ay);
+
+				// candidates just outside the disk of the active point, evenly around it from a
+				// random start angle. Denser than uniformly picking in the annulus and needs fewer tries
+				float angle = unit(gen) * tau;
+				float rotCos = std::cos(angle) * radius * 1.0001f, rotSin = std::sin(angle) * radius * 1.0001f;
+				bool found = false;
+				for(unsigned attempt = 0; attempt < attempts; ++attempt)
+				{
+					float dirX = directions[attempt * 2], dirY = directions[attempt * 2 + 1];
+					float candX = ax + dirX * rotCos - dirY * rotSin, candY = ay + dirX * rotSin + dirY * rotCos;
+
+					if(candX < 0.f || candY < 0.f || candX >= settings.width || candY >= settings.depth) continue;
+					int candCellX = cellX(candX), candCellY = cellY(candY);
+					if(candCellX < cellMinX || candCellX >= cellMaxX || candCellY < cellMinY || candCellY >= cellMaxY) continue;
+
+					if(fitsHere(candX, candY))
+					{
+						insert(candX, candY, out);
+						active.push_back(candX);
+						active.push_back(candY);
+						found = true;
+						break;
+					}
+				}
+
+				if(!found)
+				{
+					active[pick * 2] = active[active.size() - 2];
+					active[pick * 2 + 1] = active[active.size() - 1];
+					active.resize(active.size() - 2);
+				}
+			}
+		}
+	}
+}
+
+std::vector<float> Sampler::run()
+{
+	std::vector<float> points;
+	if(settings.border) sampleBorder(points);
+
+	std::vector<std::vector<float>> tilePoints(size_t(tilesX) * tilesY);
+
+	unsigned numThreads = settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+
+	for(int phase = 0; phase < 4; ++phase)
+	{
+		std::vector<int> tiles;
+		for(int ty = phase / 2; ty < tilesY; ty += 2)
+		{
+			for(int tx = phase % 2; tx < tilesX; tx += 2) tiles.push_back(ty * tilesX + tx);
+		}
+
+		std::atomic<size_t> next(0);
+		auto work = [&]
+		{
+			for(size_t i = next++; i < tiles.size(); i = next++)
+			{
+				sampleTile(tiles[i] % tilesX, tiles[i] / tilesX, tilePoints[tiles[i]]);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(unsigned t = 1; t < std::min<size_t>(numThreads, tiles.size()); ++t) threads.emplace_back(work);
+		work();
+		for(auto& thread : threads) thread.join();
+	}
+
+	size_t total = points.size();
+	for(auto& tile : tilePoints) total += tile.size();
+	points.reserve(total);
+	for(auto& tile : tilePoints) points.insert(points.end(), tile.begin(), tile.end());
+
+	// center the patch on the origin
+	for(size_t i = 0; i < points.size(); i += 2)
+	{
+		points[i] -= settings.width / 2.f;
+		points[i + 1] -= settings.depth / 2.f;
+	}
+	return points;
+}
+
+}
+
+std::vector<float> poissonDiskPoints(const PoissonDiskSettings& settings)
+{
+	if(settings.minDistance <= 0.f || settings.width <= 0.f || settings.depth <= 0.f) return {};
+	return Sampler(settings).run();
+}
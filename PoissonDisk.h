@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Grayscale map of where points should be dense, sampled over the generated patch.
+// The image is laid out as seen from the default camera: its top edge at +z and its
+// left edge at +x.
+class ImportanceMap
+{
+public:
+	// loads the luminance of a PNG, returns a lodepng error code
+	unsigned load(const std::string& path);
+
+	// importance in [0, 1] at normalized image coordinates, bilinearly filtered
+	float at(float u, float v) const;
+
+	bool empty() const { return values.empty(); }
+
+	unsigned width = 0, height = 0;
+	std::vector<float> values;
+};
+
+struct PoissonDiskSettings
+{
+	// size of the patch on the x/z plane, centered on the origin
+	float width = 16.f;
+	float depth = 16.f;
+
+	// no two points are closer than this where the importance is 1 (or everywhere without a map)
+	float minDistance = .25f;
+	// the distance where the importance is 0, ignored without an importance map
+	float maxDistance = 1.f;
+	const ImportanceMap* importance = nullptr;
+
+	// candidates tried around each point before it's considered surrounded
+	unsigned attempts = 16;
+
+	// places points along the edges first so a triangulation fills the rectangle
+	bool border = true;
+
+	// 0 uses all cores. The result doesn't depend on it.
+	unsigned threads = 0;
+
+	unsigned seed = 1;
+};
+
+// Bridson's Poisson disk sampling, blue noise: points are spread evenly without the regularity of
+// a grid. Returns x, y pairs. Deterministic per seed.
+std::vector<float> poissonDiskPoints(const PoissonDiskSettings& settings);
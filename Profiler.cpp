@@ -0,0 +1,118 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+
+// past this many events a trace stops growing, about 50 MB of JSON
+const size_t maxTraceEvents = 500000;
+
+}
+
+double Profiler::now()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Profiler::add(const char* name, bool gpu, double start, double duration)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto phase = std::find_if(totals.begin(), totals.end(), [&](const Totals& totals)
+		{
+			return totals.gpu == gpu && !std::strcmp(totals.name, name);
+		});
+	if(phase == totals.end())
+	{
+		totals.push_back({ name, gpu });
+		phase = totals.end() - 1;
+	}
+	phase->sum += duration;
+
+	if(isTracing && events.size() < maxTraceEvents)
+	{
+		unsigned thread = 0;
+		if(!gpu) thread = threads.emplace(std::this_thread::get_id(), unsigned(threads.size() + 1)).first->second;
+		events.push_back({ name, gpu, start, duration, thread });
+	}
+}
+
+void Profiler::endFrame()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if(++framesSummed < framesPerAverage) return;
+	for(Totals& phase : totals)
+	{
+		phase.average = phase.sum / 1000. / framesSummed;
+		phase.sum = 0.;
+	}
+	framesSummed = 0;
+}
+
+std::vector<Profiler::Phase> Profiler::phases() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<Phase> phases;
+	for(const Totals& phase : totals) phases.push_back({ phase.name, phase.gpu, phase.average });
+	return phases;
+}
+
+void Profiler::startTrace()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	isTracing = true;
+	events.clear();
+	threads.clear();
+}
+
+void Profiler::stopTrace()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	isTracing = false;
+}
+
+bool Profiler::writeTrace(const std::string& path)
+{
+	std::vector<Event> trace;
+	std::map<std::thread::id, unsigned> traceThreads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isTracing = false;
+		trace.swap(events);
+		traceThreads.swap(threads);
+	}
+
+	std::ofstream file(path);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+	for(const auto& thread : traceThreads)
+	{
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.second << ",\"args\":{\"name\":\""
+			<< "thread " << thread.second << "\"}}";
+	}
+
+	file.precision(3);
+	file << std::fixed;
+	for(const Event& event : trace)
+	{
+		file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"ts\":"
+			<< event.start << ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":" << event.thread << "}";
+	}
+	file << "\n]}\n";
+
+	if(!file)
+	{
+		std::cout << "Failed to save " << path << std::endl;
+		return false;
+	}
+	if(trace.size() == maxTraceEvents) std::cout << "The trace was cut short at " << maxTraceEvents << " events" << std::endl;
+	return true;
+}
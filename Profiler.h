@@ -0,0 +1,83 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where the time of a frame goes. Scopes on the CPU and timer queries on the GPU report the phases
+// they measured. The HUD shows how long each phase took per frame, averaged over the last frames.
+// Between startTrace and writeTrace every event is also kept, and written as Chrome trace events for
+// chrome://tracing or Perfetto. Events can come from any thread.
+class Profiler
+{
+public:
+	// microseconds on the steady clock, the time base of every event
+	static double now();
+
+	// name must outlive the profiler, a string literal
+	void add(const char* name, bool gpu, double start, double duration);
+
+	// closes the frame, the averages move on every framesPerAverage frames
+	void endFrame();
+
+	struct Phase
+	{
+		const char* name;
+		bool gpu;
+		double milliseconds;
+	};
+	// milliseconds per frame of each phase, in the order they first showed up
+	std::vector<Phase> phases() const;
+
+	void startTrace();
+	void stopTrace();
+	bool tracing() const { return isTracing; }
+	// Writes what was traced, stopping the trace first if it still runs. Returns false and prints why
+	// if the file can't be written.
+	bool writeTrace(const std::string& path);
+
+	unsigned framesPerAverage = 30;
+
+private:
+	struct Event
+	{
+		const char* name;
+		bool gpu;
+		double start, duration;
+		unsigned thread;
+	};
+
+	struct Totals
+	{
+		const char* name;
+		bool gpu;
+		double sum = 0., average = 0.;
+	};
+
+	mutable std::mutex mutex;
+	std::vector<Totals> totals;
+	unsigned framesSummed = 0;
+
+	bool isTracing = false;
+	std::vector<Event> events;
+	// small numbers for the threads seen, 0 is the GPU
+	std::map<std::thread::id, unsigned> threads;
+};
+
+// Times the block it lives in as a CPU phase.
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, const char* name) : profiler(profiler), name(name), start(Profiler::now()) {}
+	~ProfileScope() { profiler.add(name, false, start, Profiler::now() - start); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	Profiler& profiler;
+	const char* name;
+	double start;
+};
@@ -0,0 +1,69 @@
+#include "ProgramCache.h"
+
+#include "Cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+// bump when the file layout changes
+const uint32_t programCacheVersion = 1;
+const char programCacheMagic[8] = { 'W', 'G', 'P', 'R', 'O', 'G', '\r', '\n' };
+
+}
+
+std::string programCacheTag(const std::vector<std::string>& sources, const std::string& vendor, const std::string& renderer,
+                            const std::string& version)
+{
+	// lengths first, so no two lists of sources run together into the same tag
+	std::ostringstream tag;
+	tag << vendor << '\n' << renderer << '\n' << version << '\n';
+	for(const std::string& source : sources) tag << source.size() << '\n' << source;
+	return tag.str();
+}
+
+bool loadProgramBinary(const std::string& tag, ProgramBinary& binary)
+{
+	std::string path = cachePath("programs", tag, ".program");
+	if(path.empty()) return false;
+
+	std::ifstream file(path, std::ios::binary);
+	if(!file) return false;
+
+	char magic[sizeof(programCacheMagic)];
+	uint32_t version = 0;
+	std::vector<char> fileTag;
+	if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, programCacheMagic, sizeof(magic)) != 0) return false;
+	if(!file.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != programCacheVersion) return false;
+	if(!readArray(file, fileTag) || std::string(fileTag.begin(), fileTag.end()) != tag) return false;
+
+	ProgramBinary loaded;
+	if(!file.read(reinterpret_cast<char*>(&loaded.format), sizeof(loaded.format)) || !readArray(file, loaded.data)
+		|| loaded.data.empty())
+	{
+		return false;
+	}
+
+	binary = std::move(loaded);
+	return true;
+}
+
+bool saveProgramBinary(const std::string& tag, const ProgramBinary& binary)
+{
+	std::string path = cachePath("programs", tag, ".program");
+	if(path.empty()) return false;
+
+	std::ofstream file(path, std::ios::binary);
+	if(!file) return false;
+
+	file.write(programCacheMagic, sizeof(programCacheMagic));
+	file.write(reinterpret_cast<const char*>(&programCacheVersion), sizeof(programCacheVersion));
+	writeArray(file, std::vector<char>(tag.begin(), tag.end()));
+	file.write(reinterpret_cast<const char*>(&binary.format), sizeof(binary.format));
+	writeArray(file, binary.data);
+
+	return bool(file);
+}
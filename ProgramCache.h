@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A linked shader program as the driver hands it out through glGetProgramBinary.
+struct ProgramBinary
+{
+	uint32_t format = 0;
+	std::vector<char> data;
+};
+
+// What a program binary is good for: the sources it was built from and the driver that built it,
+// from GL_VENDOR, GL_RENDERER and GL_VERSION. Any change to them makes for another tag.
+std::string programCacheTag(const std::vector<std::string>& sources, const std::string& vendor, const std::string& renderer,
+                            const std::string& version);
+
+// Binaries on disk, next to the prepared meshes. Loading fails if there's none for the tag, or it was
+// written by another version. A driver may still reject what it once wrote, glProgramBinary says so.
+bool loadProgramBinary(const std::string& tag, ProgramBinary& binary);
+bool saveProgramBinary(const std::string& tag, const ProgramBinary& binary);
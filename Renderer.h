@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <array>
+#include <vector>
+
+struct RenderStyle
+{
+	// width of the triangle edges in pixels, -1 draws none
+	float lineSize = 1.f;
+	std::array<float, 3> lineColor = {{ 0.f, 0.f, 0.f }};
+	// the window clears to black
+	std::array<float, 3> background = {{ 0.f, 0.f, 0.f }};
+};
+
+// Draws meshes into images in memory, with no window involved: faces in flat colors with a depth
+// test, then their edges on top.
+class Renderer
+{
+public:
+	virtual ~Renderer() = default;
+
+	// Renders width x height top-down 8 bit RGB pixels into rgb. modelViewProjection is column major,
+	// as glm stores it. Every face takes the color of its last vertex out of vertexColors.
+	virtual void render(const Mesh& mesh, const std::vector<std::array<float, 3>>& vertexColors, const float* modelViewProjection,
+	                    const RenderStyle& style, unsigned width, unsigned height, unsigned char* rgb) = 0;
+};
@@ -0,0 +1,20 @@
+#include "Scene.h"
+
+#include "Palette.h"
+
+std::vector<std::array<float, 3>> Scene::paletteColors(size_t vertices) const
+{
+	return pickPaletteColors(palette, vertices, seed);
+}
+
+std::vector<std::array<float, 3>> Scene::vertexColors(const Mesh& mesh) const
+{
+	if(!mesh.faceColors.empty()) return provokingVertexColors(mesh);
+	return paletteColors(mesh.positions.size() / 3);
+}
+
+void renderScene(Renderer& renderer, const Mesh& mesh, const Scene& scene, unsigned width, unsigned height, unsigned char* rgb)
+{
+	glm::mat4 MVPMat = scene.camera.viewProjection((float)width / height);
+	renderer.render(mesh, scene.vertexColors(mesh), &MVPMat[0][0], scene.style, width, height, rgb);
+}
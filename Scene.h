@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Camera.h"
+#include "Mesh.h"
+#include "Renderer.h"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// What a wallpaper looks like apart from its mesh. The window edits one through its widgets,
+// every batch job carries one, and anything without a window can render a mesh with it.
+struct Scene
+{
+	std::vector<std::array<float, 3>> palette;
+	// which palette picks the vertices get, the window starts at 1 and Regenerate Random Colors adds one
+	unsigned seed = 1;
+
+	Camera camera;
+	RenderStyle style;
+
+	// the palette's picks for seed, one per vertex
+	std::vector<std::array<float, 3>> paletteColors(size_t vertices) const;
+	// the mesh's own face colors if it has them, the palette's picks otherwise
+	std::vector<std::array<float, 3>> vertexColors(const Mesh& mesh) const;
+};
+
+// Draws a mesh in world space as the scene's camera sees it, width x height top-down 8 bit RGB
+// pixels into rgb.
+void renderScene(Renderer& renderer, const Mesh& mesh, const Scene& scene, unsigned width, unsigned height, unsigned char* rgb);
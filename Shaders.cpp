@@ -0,0 +1,58 @@
+#include "Shaders.h"
+
+namespace
+{
+
+const char* vertexSource =
+	"layout(location = 0) in vec3 vertLocationIn;\n"
+	"layout(location = 1) in vec3 vertColors;\n"
+	"uniform mat4 MVP;\n"
+	"\n"
+	"#ifndef LINE_COLOR\n"
+	"flat out vec3 color;\n"
+	"#endif\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	gl_Position = MVP * vec4(vertLocationIn, 1.f);\n"
+	"	\n"
+	"#ifndef LINE_COLOR\n"
+	"	color = vertColors;\n"
+	"#endif\n"
+	"}\n";
+
+const char* fragmentSource =
+	"out vec3 fragColor;\n"
+	"\n"
+	"#ifdef LINE_COLOR\n"
+	"uniform vec3 lineColor;\n"
+	"#else\n"
+	"flat in vec3 color;\n"
+	"#endif\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"#ifdef LINE_COLOR\n"
+	"	fragColor = lineColor;\n"
+	"#else\n"
+	"	fragColor = color;\n"
+	"#endif\n"
+	"}\n";
+
+// #version has to come first, the features' defines go right after it
+std::string header(unsigned features)
+{
+	std::string defines = "#version 330 core\n";
+	if(features & shaderLineColor) defines += "#define LINE_COLOR\n";
+	return defines;
+}
+
+}
+
+ShaderSources shaderSources(unsigned features)
+{
+	ShaderSources sources;
+	sources.vertex = header(features) + vertexSource;
+	sources.fragment = header(features) + fragmentSource;
+	return sources;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// What a variant of the window's shaders is built with. Every feature is a #define in front of the
+// sources, so each pass runs a shader made for it instead of branching per fragment.
+enum ShaderFeature : unsigned
+{
+	// every fragment takes the lineColor uniform instead of its face's color, for the edges
+	shaderLineColor = 1u << 0,
+};
+
+struct ShaderSources
+{
+	std::string vertex, fragment;
+};
+
+// the sources of the variant with these features, or'ed together
+ShaderSources shaderSources(unsigned features);
@@ -0,0 +1,473 @@
+#include "Simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+
+const unsigned invalidIndex = std::numeric_limits<unsigned>::max();
+
+// how much more moving a border or color edge costs than moving off the surface
+const double borderWeight = 10.0;
+// prefers short collapses where the error is the same, e.g. anywhere on a flat mesh
+const double lengthWeight = 1e-4;
+
+// a x^2 + b y^2 + c z^2 + 2 ab xy + ... + d^2, the summed squared distance to a set of planes
+struct Quadric
+{
+	double aa = 0, ab = 0, ac = 0, ad = 0, bb = 0, bc = 0, bd = 0, cc = 0, cd = 0, dd = 0;
+
+	void addPlane(double a, double b, double c, double d, double weight)
+	{
+		aa += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+		bb += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+		cc += weight * c * c; cd += weight * c * d;
+		dd += weight * d * d;
+	}
+
+	void add(const Quadric& other)
+	{
+		aa += other.aa; ab += other.ab; ac += other.ac; ad += other.ad;
+		bb += other.bb; bc += other.bc; bd += other.bd;
+		cc += other.cc; cd += other.cd;
+		dd += other.dd;
+	}
+
+	double error(const float* p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		double e = aa * x * x + bb * y * y + cc * z * z + dd
+		           + 2.0 * (ab * x * y + ac * x * z + ad * x + bc * y * z + bd * y + cd * z);
+		return std::max(e, 0.0);
+	}
+};
+
+void cross(const double* u, const double* v, double* out)
+{
+	out[0] = u[1] * v[2] - u[2] * v[1];
+	out[1] = u[2] * v[0] - u[0] * v[2];
+	out[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+// unnormalized normal of the triangle a, b, c, twice its area long
+void triangleNormal(const float* a, const float* b, const float* c, double* normal)
+{
+	double u[3] = { double(b[0]) - a[0], double(b[1]) - a[1], double(b[2]) - a[2] };
+	double v[3] = { double(c[0]) - a[0], double(c[1]) - a[1], double(c[2]) - a[2] };
+	cross(u, v, normal);
+}
+
+double distanceSq(const float* a, const float* b)
+{
+	double dx = double(a[0]) - b[0], dy = double(a[1]) - b[1], dz = double(a[2]) - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+class Simplifier
+{
+public:
+	Simplifier(const Mesh& mesh);
+
+	Mesh run(size_t targetTriangles, const std::atomic<bool>* cancel);
+
+private:
+	void weld();
+	void buildQuadrics();
+	void buildAdjacency();
+	// the cheapest neighbour for v to collapse onto, and its cost
+	unsigned bestTarget(unsigned v, double& cost) const;
+	bool canCollapse(unsigned v, unsigned u) const;
+	// returns the number of triangles removed
+	unsigned collapse(unsigned v, unsigned u);
+
+	const Mesh& mesh;
+
+	// welded positions and the triangles over them
+	std::vector<float> positions;
+	std::vector<unsigned> indices;
+	// the input triangle each triangle came from
+	std::vector<unsigned> origins;
+	std::vector<bool> dead;
+	size_t liveTriangles = 0;
+
+	std::vector<Quadric> quadrics;
+
+	// triangles around each vertex, rebuilt every pass
+	std::vector<unsigned> adjacencyOffsets, adjacency;
+	std::vector<bool> locked;
+};
+
+Simplifier::Simplifier(const Mesh& mesh) : mesh(mesh)
+{
+	weld();
+	buildQuadrics();
+}
+
+void Simplifier::weld()
+{
+	// the flat color layout duplicates vertices, which would look like cuts in the surface
+	struct Key
+	{
+		uint32_t bits[3];
+		bool operator==(const Key& other) const { return std::memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			return (size_t(key.bits[0]) * 73856093u) ^ (size_t(key.bits[1]) * 19349663u) ^ (size_t(key.bits[2]) * 83492791u);
+		}
+	};
+
+	const size_t numVerts = mesh.positions.size() / 3;
+	std::unordered_map<Key, unsigned, KeyHash> unique;
+	unique.reserve(numVerts);
+	std::vector<unsigned> remap(numVerts);
+
+	for(size_t v = 0; v < numVerts; ++v)
+	{
+		Key key;
+		std::memcpy(key.bits, &mesh.positions[v * 3], sizeof(key.bits));
+		auto inserted = unique.emplace(key, unsigned(positions.size() / 3));
+		if(inserted.second) positions.insert(positions.end(), &mesh.positions[v * 3], &mesh.positions[v * 3] + 3);
+		remap[v] = inserted.first->second;
+	}
+
+	const size_t numTriangles = mesh.indices.size() / 3;
+	indices.reserve(mesh.indices.size());
+	for(size_t t = 0; t < numTriangles; ++t)
+	{
+		unsigned a = remap[mesh.indices[t * 3]], b = remap[mesh.indices[t * 3 + 1]], c = remap[mesh.indices[t * 3 + 2]];
+		if(a == b || b == c || a == c) continue;
+		indices.insert(indices.end(), { a, b, c });
+		origins.push_back(unsigned(t));
+	}
+	dead.assign(origins.size(), false);
+	liveTriangles = origins.size();
+}
+
+void Simplifier::buildQuadrics()
+{
+	const size_t numTriangles = origins.size();
+	quadrics.assign(positions.size() / 3, Quadric());
+
+	// the plane of every triangle, weighted by its area
+	std::vector<double> normals(numTriangles * 3);
+	for(size_t t = 0; t < numTriangles; ++t)
+	{
+		const float* p[3] = { &positions[indices[t * 3] * 3], &positions[indices[t * 3 + 1] * 3], &positions[indices[t * 3 + 2] * 3] };
+		double* n = &normals[t * 3];
+		triangleNormal(p[0], p[1], p[2], n);
+
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(length == 0.0) continue;
+		for(int i = 0; i < 3; ++i) n[i] /= length;
+
+		double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+		for(int c = 0; c < 3; ++c) quadrics[indices[t * 3 + c]].addPlane(n[0], n[1], n[2], d, length / 2.0);
+	}
+
+	// edges with one triangle are on the border, edges between two differently colored ones are
+	// seams. Both get a plane through them, perpendicular to their triangle.
+	struct Edge
+	{
+		unsigned low, high, triangle;
+		bool operator<(const Edge& other) const
+		{
+			return low != other.low ? low < other.low : high != other.high ? high < other.high : triangle < other.triangle;
+		}
+	};
+	std::vector<Edge> edges;
+	edges.reserve(numTriangles * 3);
+	for(size_t t = 0; t < numTriangles; ++t)
+	{
+		for(int c = 0; c < 3; ++c)
+		{
+			unsigned a = indices[t * 3 + c], b = indices[t * 3 + (c + 1) % 3];
+			edges.push_back({ std::min(a, b), std::max(a, b), unsigned(t) });
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	const bool colored = mesh.faceColors.size() == mesh.indices.size();
+	auto sameColor = [&](unsigned t0, unsigned t1)
+	{
+		const float* c0 = &mesh.faceColors[origins[t0] * 3];
+		const float* c1 = &mesh.faceColors[origins[t1] * 3];
+		return std::fabs(c0[0] - c1[0]) + std::fabs(c0[1] - c1[1]) + std::fabs(c0[2] - c1[2]) < 1e-3f;
+	};
+
+	auto constrain = [&](unsigned a, unsigned b, unsigned t)
+	{
+		const float* pa = &positions[a * 3];
+		const float* pb = &positions[b * 3];
+		double edge[3] = { double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2] };
+		double n[3];
+		cross(edge, &normals[t * 3], n);
+
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(length == 0.0) return;
+		for(int i = 0; i < 3; ++i) n[i] /= length;
+
+		double d = -(n[0] * pa[0] + n[1] * pa[1] + n[2] * pa[2]);
+		double weight = borderWeight * distanceSq(pa, pb);
+		quadrics[a].addPlane(n[0], n[1], n[2], d, weight);
+		quadrics[b].addPlane(n[0], n[1], n[2], d, weight);
+	};
+
+	for(size_t i = 0; i < edges.size(); )
+	{
+		size_t end = i + 1;
+		while(end < edges.size() && edges[end].low == edges[i].low && edges[end].high == edges[i].high) ++end;
+
+		if(end - i == 1 || (colored && end - i == 2 && !sameColor(edges[i].triangle, edges[i + 1].triangle)))
+		{
+			for(size_t e = i; e < end; ++e) constrain(edges[e].low, edges[e].high, edges[e].triangle);
+		}
+		i = end;
+	}
+}
+
+void Simplifier::buildAdjacency()
+{
+	const size_t numVerts = positions.size() / 3;
+	adjacencyOffsets.assign(numVerts + 1, 0);
+	for(size_t t = 0; t < origins.size(); ++t)
+	{
+		if(dead[t]) continue;
+		for(int c = 0; c < 3; ++c) ++adjacencyOffsets[indices[t * 3 + c] + 1];
+	}
+	for(size_t v = 0; v < numVerts; ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+	adjacency.resize(adjacencyOffsets[numVerts]);
+	std::vector<unsigned> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for(size_t t = 0; t < origins.size(); ++t)
+	{
+		if(dead[t]) continue;
+		for(int c = 0; c < 3; ++c) adjacency[fill[indices[t * 3 + c]]++] = unsigned(t);
+	}
+}
+
+unsigned Simplifier::bestTarget(unsigned v, double& cost) const
+{
+	unsigned best = invalidIndex;
+	cost = std::numeric_limits<double>::max();
+
+	for(unsigned i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+	{
+		const unsigned* corners = &indices[adjacency[i] * 3];
+		for(int c = 0; c < 3; ++c)
+		{
+			unsigned u = corners[c];
+			if(u == v) continue;
+
+			const float* target = &positions[u * 3];
+			double candidate = quadrics[v].error(target) + lengthWeight * distanceSq(&positions[v * 3], target);
+			if(candidate < cost)
+			{
+				cost = candidate;
+				best = u;
+			}
+		}
+	}
+	return best;
+}
+
+bool Simplifier::canCollapse(unsigned v, unsigned u) const
+{
+	// the vertices next to both v and u must be exactly the far corners of the triangles on the
+	// edge v-u, otherwise the collapse glues two parts of the surface together
+	unsigned shared = 0, edgeTriangles = 0;
+	for(unsigned i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+	{
+		const unsigned* corners = &indices[adjacency[i] * 3];
+		if(corners[0] == u || corners[1] == u || corners[2] == u) ++edgeTriangles;
+	}
+
+	// neighbours of v, each once
+	unsigned ring[64];
+	unsigned ringSize = 0;
+	for(unsigned i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+	{
+		const unsigned* corners = &indices[adjacency[i] * 3];
+		for(int c = 0; c < 3; ++c)
+		{
+			unsigned w = corners[c];
+			if(w == v || w == u || std::find(ring, ring + ringSize, w) != ring + ringSize) continue;
+			if(ringSize == 64) return false;
+			ring[ringSize++] = w;
+		}
+	}
+	for(unsigned r = 0; r < ringSize; ++r)
+	{
+		bool nextToU = false;
+		for(unsigned i = adjacencyOffsets[u]; i < adjacencyOffsets[u + 1] && !nextToU; ++i)
+		{
+			const unsigned* corners = &indices[adjacency[i] * 3];
+			nextToU = corners[0] == ring[r] || corners[1] == ring[r] || corners[2] == ring[r];
+		}
+		if(nextToU) ++shared;
+	}
+	if(shared != edgeTriangles) return false;
+
+	// no triangle that stays may turn over or collapse to a line
+	for(unsigned i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+	{
+		const unsigned* corners = &indices[adjacency[i] * 3];
+		if(corners[0] == u || corners[1] == u || corners[2] == u) continue;
+
+		const float* before[3];
+		const float* after[3];
+		for(int c = 0; c < 3; ++c)
+		{
+			before[c] = &positions[corners[c] * 3];
+			after[c] = &positions[(corners[c] == v ? u : corners[c]) * 3];
+		}
+
+		double n0[3], n1[3];
+		triangleNormal(before[0], before[1], before[2], n0);
+		triangleNormal(after[0], after[1], after[2], n1);
+		double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+		double length0 = std::sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+		double length1 = std::sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+		if(dot <= .25 * length0 * length1) return false;
+	}
+	return true;
+}
+
+unsigned Simplifier::collapse(unsigned v, unsigned u)
+{
+	unsigned removed = 0;
+	for(unsigned i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+	{
+		unsigned t = adjacency[i];
+		unsigned* corners = &indices[t * 3];
+		if(corners[0] == u || corners[1] == u || corners[2] == u)
+		{
+			dead[t] = true;
+			++removed;
+			continue;
+		}
+		for(int c = 0; c < 3; ++c)
+		{
+			if(corners[c] == v) corners[c] = u;
+		}
+	}
+	quadrics[u].add(quadrics[v]);
+	liveTriangles -= removed;
+	return removed;
+}
+
+Mesh Simplifier::run(size_t targetTriangles, const std::atomic<bool>* cancel)
+{
+	const size_t numVerts = positions.size() / 3;
+
+	struct Candidate
+	{
+		double cost;
+		unsigned v, u;
+		bool operator<(const Candidate& other) const { return cost < other.cost; }
+	};
+	std::vector<Candidate> candidates;
+
+	// every pass collapses the cheapest edges whose neighbourhoods don't overlap, so the checks
+	// made against the pass's adjacency stay valid
+	while(liveTriangles > targetTriangles && !(cancel && *cancel))
+	{
+		buildAdjacency();
+
+		candidates.clear();
+		for(unsigned v = 0; v < numVerts; ++v)
+		{
+			if(adjacencyOffsets[v] == adjacencyOffsets[v + 1]) continue;
+			double cost;
+			unsigned u = bestTarget(v, cost);
+			if(u != invalidIndex) candidates.push_back({ cost, v, u });
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		if(candidates.empty()) break;
+
+		// each collapse removes about two triangles. Candidates much costlier than the last one
+		// needed wait for the next pass, where cheaper ones may have come up.
+		size_t goal = std::min((liveTriangles - targetTriangles) / 2, candidates.size() - 1);
+		double costLimit = candidates[goal].cost * 1.5 + std::numeric_limits<double>::min();
+
+		locked.assign(numVerts, false);
+		size_t collapsed = 0;
+		for(const Candidate& candidate : candidates)
+		{
+			if(liveTriangles <= targetTriangles || candidate.cost > costLimit) break;
+			if(locked[candidate.v] || locked[candidate.u] || !canCollapse(candidate.v, candidate.u)) continue;
+
+			// lock the neighbourhood, its triangles change
+			for(unsigned i = adjacencyOffsets[candidate.v]; i < adjacencyOffsets[candidate.v + 1]; ++i)
+			{
+				for(int c = 0; c < 3; ++c) locked[indices[adjacency[i] * 3 + c]] = true;
+			}
+			collapse(candidate.v, candidate.u);
+			++collapsed;
+		}
+
+		if(collapsed == 0) break;
+	}
+
+	// keep the vertices still in use, in the order they're first used
+	Mesh out;
+	std::vector<unsigned> remap(numVerts, invalidIndex);
+	const bool colored = mesh.faceColors.size() == mesh.indices.size();
+	const bool hasIds = mesh.faceIds.size() * 3 == mesh.indices.size();
+
+	for(size_t t = 0; t < origins.size(); ++t)
+	{
+		if(dead[t]) continue;
+		for(int c = 0; c < 3; ++c)
+		{
+			unsigned& index = remap[indices[t * 3 + c]];
+			if(index == invalidIndex)
+			{
+				index = unsigned(out.positions.size() / 3);
+				out.positions.insert(out.positions.end(), &positions[indices[t * 3 + c] * 3], &positions[indices[t * 3 + c] * 3] + 3);
+			}
+			out.indices.push_back(index);
+		}
+
+		unsigned origin = origins[t];
+		out.faceIds.push_back(hasIds ? mesh.faceIds[origin] : origin);
+		if(colored) out.faceColors.insert(out.faceColors.end(), &mesh.faceColors[origin * 3], &mesh.faceColors[origin * 3] + 3);
+	}
+	return out;
+}
+
+}
+
+Mesh simplifyMesh(const Mesh& mesh, size_t targetTriangles, const std::atomic<bool>* cancel)
+{
+	return Simplifier(mesh).run(targetTriangles, cancel);
+}
+
+std::vector<Mesh> buildLodChain(const Mesh& mesh, size_t minTriangles, const std::atomic<bool>& cancel)
+{
+	std::vector<Mesh> levels;
+	const Mesh* previous = &mesh;
+
+	while(!cancel && previous->indices.size() / 3 / 4 >= minTriangles)
+	{
+		size_t previousTriangles = previous->indices.size() / 3;
+		Mesh level = simplifyMesh(*previous, previousTriangles / 4, &cancel);
+		if(cancel) break;
+
+		// the error allows no more, further levels wouldn't get smaller either
+		if(level.indices.size() / 3 > previousTriangles * 3 / 4) break;
+
+		levels.push_back(std::move(level));
+		previous = &levels.back();
+	}
+	return levels;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Quadric error simplification (Garland and Heckbert) by half-edge collapses: a vertex moves onto
+// one of its neighbours, so the result only uses positions of the original mesh. Collapses that
+// would fold a triangle over or pinch the surface are skipped.
+// The border of the mesh and the edges between faces of different face colors are held in place
+// by extra quadrics, so outlines and color regions survive.
+// Returns a mesh of about targetTriangles triangles, more if no collapse is left that keeps the
+// surface intact. Its faceIds name the triangle each one stands for: mesh's own faceIds if it has
+// them, otherwise its triangle indices. Face colors are carried along, clusters and the flat color
+// layout aren't. Setting cancel stops it between passes.
+Mesh simplifyMesh(const Mesh& mesh, size_t targetTriangles, const std::atomic<bool>* cancel = nullptr);
+
+// Levels of detail for mesh, each with a quarter of the triangles of the one before, down to
+// about minTriangles. The mesh itself isn't included. Stops early, with the levels built so far,
+// when cancel is set.
+std::vector<Mesh> buildLodChain(const Mesh& mesh, size_t minTriangles, const std::atomic<bool>& cancel);
@@ -0,0 +1,387 @@
+#include "SoftwareRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+
+const unsigned bandRows = 32;
+const size_t setupChunk = 16384;
+
+// positions are snapped to 1/256 of a pixel, like GL's 8 bits of subpixel precision
+const float subpixels = 256.f;
+
+// triangles are clipped this many half-screens out, so snapped positions stay well within 32 bits
+const float guardBand = 4.f;
+
+// edges are drawn where they are this close behind the surface, so they don't fight with their own faces
+const float lineDepthBias = 1e-5f;
+
+template<typename Work>
+void parallelChunks(size_t count, size_t chunk, unsigned numThreads, const Work& work)
+{
+	std::atomic<size_t> next(0);
+	auto run = [&]
+	{
+		for(size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk))
+		{
+			work(begin, std::min(begin + chunk, count));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	size_t chunks = (count + chunk - 1) / chunk;
+	for(unsigned t = 1; t < std::min<size_t>(numThreads, chunks); ++t) threads.emplace_back(run);
+	run();
+	for(auto& thread : threads) thread.join();
+}
+
+unsigned char toByte(float value)
+{
+	return (unsigned char)std::lround(std::min(std::max(value, 0.f), 1.f) * 255.f);
+}
+
+// a corner of a polygon being clipped, edge tells if the edge to the next corner is one of the mesh's
+struct ClipVertex
+{
+	float position[4];
+	bool edge;
+};
+
+// distance to the clip planes in clip space: near, then the guard band on x and y
+float planeDistance(const float* p, int plane)
+{
+	switch(plane)
+	{
+	case 0: return p[2] + p[3];
+	case 1: return guardBand * p[3] + p[0];
+	case 2: return guardBand * p[3] - p[0];
+	case 3: return guardBand * p[3] + p[1];
+	default: return guardBand * p[3] - p[1];
+	}
+}
+
+// Sutherland-Hodgman against one plane. A triangle clipped against five planes has at most 8 corners.
+unsigned clipPolygon(const ClipVertex* in, unsigned count, int plane, ClipVertex* out)
+{
+	unsigned outCount = 0;
+	for(unsigned i = 0; i < count; ++i)
+	{
+		const ClipVertex& a = in[i];
+		const ClipVertex& b = in[(i + 1) % count];
+		float da = planeDistance(a.position, plane), db = planeDistance(b.position, plane);
+
+		if(da >= 0.f) out[outCount++] = a;
+		if((da >= 0.f) != (db >= 0.f))
+		{
+			ClipVertex cut;
+			float t = da / (da - db);
+			for(int c = 0; c < 4; ++c) cut.position[c] = a.position[c] + (b.position[c] - a.position[c]) * t;
+			// leaving the plane, the next edge runs along it; entering, it's the rest of a's edge
+			cut.edge = da < 0.f && a.edge;
+			out[outCount++] = cut;
+		}
+	}
+	return outCount;
+}
+
+}
+
+SoftwareRenderer::SoftwareRenderer(unsigned threads)
+	: numThreads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+void SoftwareRenderer::render(const Mesh& mesh, const std::vector<std::array<float, 3>>& vertexColors, const float* modelViewProjection,
+                              const RenderStyle& style, unsigned width, unsigned height, unsigned char* rgb)
+{
+	this->width = width;
+	this->height = height;
+	if(width == 0 || height == 0) return;
+
+	// vertices to clip space
+	const float* m = modelViewProjection;
+	size_t numVerts = mesh.positions.size() / 3;
+	clipPositions.resize(numVerts * 4);
+	parallelChunks(numVerts, setupChunk, numThreads, [&](size_t begin, size_t end)
+	{
+		for(size_t v = begin; v < end; ++v)
+		{
+			const float* p = &mesh.positions[v * 3];
+			float* out = &clipPositions[v * 4];
+			for(int row = 0; row < 4; ++row)
+			{
+				out[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+			}
+		}
+	});
+
+	setupTriangles(mesh, vertexColors, style.lineSize);
+
+	depth.resize(size_t(width) * height);
+	parallelChunks(bands.size(), 1, numThreads, [&](size_t begin, size_t end)
+	{
+		for(size_t band = begin; band < end; ++band) drawBand(unsigned(band), style, rgb);
+	});
+}
+
+void SoftwareRenderer::setupTriangles(const Mesh& mesh, const std::vector<std::array<float, 3>>& vertexColors, float lineSize)
+{
+	size_t numTriangles = mesh.indices.size() / 3;
+	size_t numChunks = (numTriangles + setupChunk - 1) / setupChunk;
+	std::vector<std::vector<Triangle>> chunkTriangles(numChunks);
+
+	parallelChunks(numTriangles, setupChunk, numThreads, [&](size_t begin, size_t end)
+	{
+		std::vector<Triangle>& out = chunkTriangles[begin / setupChunk];
+		ClipVertex polygon[2][8];
+
+		for(size_t t = begin; t < end; ++t)
+		{
+			const unsigned int* corners = &mesh.indices[t * 3];
+
+			// fully inside: no clipping at all, which is almost every triangle
+			unsigned count = 3;
+			bool inside = true;
+			for(unsigned c = 0; c < 3; ++c)
+			{
+				const float* p = &clipPositions[corners[c] * 4];
+				std::copy(p, p + 4, polygon[0][c].position);
+				polygon[0][c].edge = true;
+				for(int plane = 0; plane < 5; ++plane) inside = inside && planeDistance(p, plane) >= 0.f;
+			}
+
+			int current = 0;
+			if(!inside)
+			{
+				for(int plane = 0; plane < 5 && count >= 3; ++plane)
+				{
+					count = clipPolygon(polygon[current], count, plane, polygon[1 - current]);
+					current = 1 - current;
+				}
+				if(count < 3) continue;
+			}
+
+			const std::array<float, 3>& color = vertexColors[corners[2]];
+
+			// fan out of the first corner, only the outline keeps its edges
+			for(unsigned k = 1; k + 1 < count; ++k)
+			{
+				const ClipVertex* fan[3] = { &polygon[current][0], &polygon[current][k], &polygon[current][k + 1] };
+
+				Triangle triangle;
+				for(int c = 0; c < 3; ++c)
+				{
+					const float* p = fan[c]->position;
+					float invW = 1.f / p[3];
+					triangle.x[c] = std::round((p[0] * invW * .5f + .5f) * width * subpixels) / subpixels;
+					triangle.y[c] = std::round((.5f - p[1] * invW * .5f) * height * subpixels) / subpixels;
+					triangle.z[c] = p[2] * invW * .5f + .5f;
+				}
+				for(int c = 0; c < 3; ++c) triangle.color[c] = toByte(color[c]);
+
+				triangle.edges = 0;
+				if(k == 1 && fan[0]->edge) triangle.edges |= 1;
+				if(fan[1]->edge) triangle.edges |= 2;
+				if(k + 2 == count && fan[2]->edge) triangle.edges |= 4;
+
+				out.push_back(triangle);
+			}
+		}
+	});
+
+	// bin into bands in mesh order, so faces at the same depth cover each other the way GL draws them
+	unsigned numBands = (height + bandRows - 1) / bandRows;
+	bands.resize(numBands);
+	for(auto& band : bands) band.clear();
+
+	float pad = lineSize >= 0.f ? std::max(lineSize, 1.f) * .5f + 1.f : 0.f;
+	triangles.clear();
+	for(const auto& chunk : chunkTriangles)
+	{
+		for(const Triangle& triangle : chunk)
+		{
+			float minX = std::min({ triangle.x[0], triangle.x[1], triangle.x[2] }) - pad;
+			float maxX = std::max({ triangle.x[0], triangle.x[1], triangle.x[2] }) + pad;
+			float minY = std::min({ triangle.y[0], triangle.y[1], triangle.y[2] }) - pad;
+			float maxY = std::max({ triangle.y[0], triangle.y[1], triangle.y[2] }) + pad;
+			if(maxX < 0.f || minX > width || maxY < 0.f || minY > height) continue;
+
+			unsigned first = unsigned(std::max(minY, 0.f)) / bandRows;
+			unsigned last = std::min(unsigned(std::min(maxY, float(height))) / bandRows, numBands - 1);
+			for(unsigned band = first; band <= last; ++band) bands[band].push_back(unsigned(triangles.size()));
+			triangles.push_back(triangle);
+		}
+	}
+}
+
+void SoftwareRenderer::drawBand(unsigned band, const RenderStyle& style, unsigned char* rgb)
+{
+	unsigned top = band * bandRows, bottom = std::min(top + bandRows, height);
+
+	unsigned char background[3] = { toByte(style.background[0]), toByte(style.background[1]), toByte(style.background[2]) };
+	for(size_t pixel = size_t(top) * width; pixel < size_t(bottom) * width; ++pixel)
+	{
+		std::copy(background, background + 3, rgb + pixel * 3);
+		depth[pixel] = 1.f;
+	}
+
+	for(unsigned triangle : bands[band]) fillTriangle(triangles[triangle], top, bottom, rgb);
+
+	if(style.lineSize < 0.f) return;
+
+	// GL keeps the last valid width for 0
+	int lineWidth = std::max(1, int(std::lround(style.lineSize)));
+	unsigned char lineColor[3] = { toByte(style.lineColor[0]), toByte(style.lineColor[1]), toByte(style.lineColor[2]) };
+	for(unsigned triangle : bands[band]) drawEdges(triangles[triangle], lineWidth, lineColor, top, bottom, rgb);
+}
+
+void SoftwareRenderer::fillTriangle(const Triangle& triangle, unsigned top, unsigned bottom, unsigned char* rgb)
+{
+	// corners in fixed point, counter clockwise on screen
+	int64_t x[3], y[3];
+	for(int c = 0; c < 3; ++c)
+	{
+		x[c] = int64_t(triangle.x[c] * subpixels);
+		y[c] = int64_t(triangle.y[c] * subpixels);
+	}
+	int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if(area == 0) return;
+	if(area < 0)
+	{
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+	}
+
+	// pixels whose centers are inside the bounding box
+	const int64_t half = int64_t(subpixels) / 2, pixel = int64_t(subpixels);
+	int64_t minX = std::min({ x[0], x[1], x[2] }), maxX = std::max({ x[0], x[1], x[2] });
+	int64_t minY = std::min({ y[0], y[1], y[2] }), maxY = std::max({ y[0], y[1], y[2] });
+	int64_t firstColumn = std::max<int64_t>(0, (int64_t)std::ceil(double(minX - half) / pixel));
+	int64_t lastColumn = std::min<int64_t>(width - 1, (int64_t)std::floor(double(maxX - half) / pixel));
+	int64_t firstRow = std::max<int64_t>(top, (int64_t)std::ceil(double(minY - half) / pixel));
+	int64_t lastRow = std::min<int64_t>(bottom - 1, (int64_t)std::floor(double(maxY - half) / pixel));
+	if(firstColumn > lastColumn || firstRow > lastRow) return;
+
+	// edge functions, positive inside. A pixel center exactly on an edge goes to only one of the two
+	// triangles sharing it, by the direction of the edge
+	int64_t stepX[3], bias[3];
+	for(int e = 0; e < 3; ++e)
+	{
+		int a = e, b = (e + 1) % 3;
+		int64_t dx = x[b] - x[a], dy = y[b] - y[a];
+		stepX[e] = -dy * pixel;
+		bias[e] = dy > 0 || (dy == 0 && dx < 0) ? 0 : -1;
+	}
+	auto edgeAt = [&](int e, int64_t px, int64_t py)
+	{
+		int a = e, b = (e + 1) % 3;
+		return (x[b] - x[a]) * (py - y[a]) - (y[b] - y[a]) * (px - x[a]) + bias[e];
+	};
+
+	// depth as a plane over the screen
+	float x0 = triangle.x[0], y0 = triangle.y[0], z0 = triangle.z[0];
+	float dx1 = triangle.x[1] - x0, dy1 = triangle.y[1] - y0, dz1 = triangle.z[1] - z0;
+	float dx2 = triangle.x[2] - x0, dy2 = triangle.y[2] - y0, dz2 = triangle.z[2] - z0;
+	float det = dx1 * dy2 - dy1 * dx2;
+	float dzdx = (dz1 * dy2 - dy1 * dz2) / det;
+	float dzdy = (dx1 * dz2 - dz1 * dx2) / det;
+
+	int64_t startX = firstColumn * pixel + half;
+	for(int64_t row = firstRow; row <= lastRow; ++row)
+	{
+		int64_t centerY = row * pixel + half;
+		int64_t e0 = edgeAt(0, startX, centerY), e1 = edgeAt(1, startX, centerY), e2 = edgeAt(2, startX, centerY);
+		float z = z0 + dzdx * (firstColumn + .5f - x0) + dzdy * (row + .5f - y0);
+
+		size_t index = size_t(row) * width + firstColumn;
+		for(int64_t column = firstColumn; column <= lastColumn; ++column, ++index)
+		{
+			if((e0 | e1 | e2) >= 0 && z < depth[index])
+			{
+				depth[index] = z;
+				std::copy(triangle.color, triangle.color + 3, rgb + index * 3);
+			}
+			e0 += stepX[0];
+			e1 += stepX[1];
+			e2 += stepX[2];
+			z += dzdx;
+		}
+	}
+}
+
+void SoftwareRenderer::drawEdges(const Triangle& triangle, int lineWidth, const unsigned char* color, unsigned top, unsigned bottom, unsigned char* rgb)
+{
+	float half = lineWidth * .5f;
+
+	auto plot = [&](int64_t column, int64_t row, float z)
+	{
+		size_t index = size_t(row) * width + column;
+		if(z <= depth[index] + lineDepthBias)
+		{
+			depth[index] = std::min(depth[index], z);
+			std::copy(color, color + 3, rgb + index * 3);
+		}
+	};
+
+	for(int e = 0; e < 3; ++e)
+	{
+		if(!(triangle.edges & (1 << e))) continue;
+
+		float x0 = triangle.x[e], y0 = triangle.y[e], z0 = triangle.z[e];
+		float x1 = triangle.x[(e + 1) % 3], y1 = triangle.y[(e + 1) % 3], z1 = triangle.z[(e + 1) % 3];
+
+		// step along the major axis one pixel center at a time and cover lineWidth pixels across it
+		bool xMajor = std::abs(x1 - x0) >= std::abs(y1 - y0);
+		if(!xMajor)
+		{
+			std::swap(x0, y0);
+			std::swap(x1, y1);
+		}
+		if(x0 == x1) continue;
+		if(x0 > x1)
+		{
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+			std::swap(z0, z1);
+		}
+
+		// along the major axis, the columns (or rows) with centers on the line
+		float majorSize = xMajor ? width : height;
+		float first = std::max(std::ceil(x0 - .5f), 0.f), end = std::min(std::ceil(x1 - .5f), majorSize);
+		float slope = (y1 - y0) / (x1 - x0), depthSlope = (z1 - z0) / (x1 - x0);
+		
+		// only the part of the line that reaches into the band
+		if(!xMajor)
+		{
+			first = std::max(first, float(top));
+			end = std::min(end, float(bottom));
+		}
+		else if(slope != 0.f)
+		{
+			float enter = x0 + (top - half - 1.f - y0) / slope, leave = x0 + (bottom + half + 1.f - y0) / slope;
+			if(enter > leave) std::swap(enter, leave);
+			first = std::max(first, std::floor(enter));
+			end = std::min(end, std::ceil(leave) + 1.f);
+		}
+
+		for(float major = first; major < end; ++major)
+		{
+			float t = major + .5f - x0;
+			float minor = y0 + slope * t, z = z0 + depthSlope * t;
+			int64_t from = (int64_t)std::floor(minor - half + .5f), to = from + lineWidth;
+
+			if(xMajor)
+			{
+				for(int64_t row = std::max<int64_t>(from, top); row < std::min<int64_t>(to, bottom); ++row) plot(int64_t(major), row, z);
+			}
+			else
+			{
+				for(int64_t column = std::max<int64_t>(from, 0); column < std::min<int64_t>(to, width); ++column) plot(column, int64_t(major), z);
+			}
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Renderer.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Draws meshes on the CPU the way the window does, for rendering without a GPU or a window: faces
+// in flat colors with a depth test, then their edges on top. There's no multisampling.
+// The image is cut into bands of rows that the threads draw independently, each band only looks at
+// the triangles binned into it. The buffers are kept between renders, reuse one renderer for a
+// series of images.
+class SoftwareRenderer : public Renderer
+{
+public:
+	// 0 uses all cores
+	explicit SoftwareRenderer(unsigned threads = 0);
+
+	void render(const Mesh& mesh, const std::vector<std::array<float, 3>>& vertexColors, const float* modelViewProjection,
+	            const RenderStyle& style, unsigned width, unsigned height, unsigned char* rgb) override;
+
+private:
+	// in pixels, y down, z is depth in [0, 1]
+	struct Triangle
+	{
+		float x[3], y[3], z[3];
+		unsigned char color[3];
+		// bit i set: the edge from corner i to the next is an edge of the mesh, not one made by clipping
+		unsigned char edges;
+	};
+
+	void setupTriangles(const Mesh& mesh, const std::vector<std::array<float, 3>>& vertexColors, float lineSize);
+	void drawBand(unsigned band, const RenderStyle& style, unsigned char* rgb);
+	void fillTriangle(const Triangle& triangle, unsigned top, unsigned bottom, unsigned char* rgb);
+	void drawEdges(const Triangle& triangle, int lineWidth, const unsigned char* color, unsigned top, unsigned bottom, unsigned char* rgb);
+
+	unsigned numThreads;
+	unsigned width = 0, height = 0;
+
+	// x, y, z, w per vertex
+	std::vector<float> clipPositions;
+	std::vector<Triangle> triangles;
+	// triangles overlapping each band of rows
+	std::vector<std::vector<unsigned>> bands;
+	std::vector<float> depth;
+};
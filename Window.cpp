@@ -1,4 +1,7 @@
 #include "Window.h"
+
+#include "Palette.h"
+
 #include <QColorDialog>
 #include <QFileDialog>
 
@@ -15,7 +18,7 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 	sizeLabel.setText(QStringLiteral("Line Size:"));
 	connect(&sizeSlider, &QSlider::valueChanged, [this]
 		{
-			widget.lineSize = sizeSlider.value();
+			widget.scene.style.lineSize = sizeSlider.value();
 		}
 	);
 	
@@ -37,6 +40,7 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 					
 					item->setBackgroundColor(selectedColor);
 					
+					updatePalette();
 					widget.markForColorRefresh();
 				}
 			);
@@ -56,6 +60,7 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 					allColors.addItem(item);
 					item->setBackgroundColor(selectedColor);
 					
+					updatePalette();
 					widget.markForRegeneration();
 				}
 			);
@@ -70,6 +75,7 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 			{
 				delete elem;
 				
+				updatePalette();
 				widget.markForRegeneration();
 			}
 		}
@@ -97,6 +103,33 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 		}
 	);
 	
+	lowPolyImage.setText("Low-Poly From Image");
+	connect(&lowPolyImage, &QPushButton::clicked, [this]
+		{
+			QFileDialog* dialog = new QFileDialog;
+			
+			dialog->setAcceptMode(QFileDialog::AcceptOpen);
+			dialog->setFileMode(QFileDialog::ExistingFile);
+			dialog->setNameFilter("*.png");
+			dialog->setViewMode(QFileDialog::ViewMode::Detail);
+			
+			dialog->open();
+			
+			connect(dialog, &QFileDialog::fileSelected, [this](const QString& file)
+				{
+					widget.markForImageLoad(file);
+				}
+			);
+		}
+	);
+	
+	generatedMesh.setText("Generated Mesh");
+	connect(&generatedMesh, &QPushButton::clicked, [this]
+		{
+			widget.markForGeneratedMesh();
+		}
+	);
+	
 	lineColorChange.setText("Set Line Color");
 	connect(&lineColorChange, &QPushButton::clicked, [this]
 		{
@@ -105,7 +138,7 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 			
 			connect(dialog, &QColorDialog::currentColorChanged, [this, dialog](const QColor& selectedColor)
 				{
-					widget.lineColor = selectedColor;
+					widget.scene.style.lineColor = fromRGB(selectedColor.red(), selectedColor.green(), selectedColor.blue());
 					
 					QPalette pal;
 					pal.setColor(QPalette::Background, selectedColor);
@@ -116,6 +149,106 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 	);
 	lineColor.setAutoFillBackground(true);
 	
+	recordCamera.setText("Record Camera");
+	connect(&recordCamera, &QPushButton::clicked, [this]
+		{
+			if(!widget.isRecording())
+			{
+				widget.startRecording();
+				recordCamera.setText("Stop Recording");
+				return;
+			}
+			
+			widget.stopRecording();
+			recordCamera.setText("Record Camera");
+			
+			QFileDialog* dialog = new QFileDialog;
+			
+			dialog->setAcceptMode(QFileDialog::AcceptSave);
+			dialog->setFilter(QDir::Files | QDir::Writable);
+			dialog->setNameFilter("*.track");
+			dialog->setViewMode(QFileDialog::ViewMode::Detail);
+			
+			dialog->open();
+			
+			connect(dialog, &QFileDialog::fileSelected, [this](const QString& file)
+				{
+					widget.saveRecording(file);
+				}
+			);
+		}
+	);
+	
+	replayCamera.setText("Replay Camera");
+	connect(&replayCamera, &QPushButton::clicked, [this]
+		{
+			QFileDialog* dialog = new QFileDialog;
+			
+			dialog->setAcceptMode(QFileDialog::AcceptOpen);
+			dialog->setFileMode(QFileDialog::ExistingFile);
+			dialog->setNameFilter("*.track");
+			dialog->setViewMode(QFileDialog::ViewMode::Detail);
+			
+			dialog->open();
+			
+			connect(dialog, &QFileDialog::fileSelected, [this](const QString& file)
+				{
+					widget.markForReplay(file);
+				}
+			);
+		}
+	);
+	
+	saveFrameTimes.setText("Save Frame Times");
+	connect(&saveFrameTimes, &QPushButton::clicked, [this]
+		{
+			QFileDialog* dialog = new QFileDialog;
+			
+			dialog->setAcceptMode(QFileDialog::AcceptSave);
+			dialog->setFilter(QDir::Files | QDir::Writable);
+			dialog->setNameFilter("*.csv");
+			dialog->setViewMode(QFileDialog::ViewMode::Detail);
+			
+			dialog->open();
+			
+			connect(dialog, &QFileDialog::fileSelected, [this](const QString& file)
+				{
+					widget.saveFrameStats(file);
+				}
+			);
+		}
+	);
+	
+	recordTrace.setText("Record Trace");
+	connect(&recordTrace, &QPushButton::clicked, [this]
+		{
+			if(!widget.isTracing())
+			{
+				widget.startTrace();
+				recordTrace.setText("Stop Trace");
+				return;
+			}
+			
+			widget.stopTrace();
+			recordTrace.setText("Record Trace");
+			
+			QFileDialog* dialog = new QFileDialog;
+			
+			dialog->setAcceptMode(QFileDialog::AcceptSave);
+			dialog->setFilter(QDir::Files | QDir::Writable);
+			dialog->setNameFilter("*.json");
+			dialog->setViewMode(QFileDialog::ViewMode::Detail);
+			
+			dialog->open();
+			
+			connect(dialog, &QFileDialog::fileSelected, [this](const QString& file)
+				{
+					widget.saveTrace(file);
+				}
+			);
+		}
+	);
+	
 	
 	layout.addWidget(&widget, 0, 0, 10, 8);
 	
@@ -140,8 +273,24 @@ Window::Window ( QWidget* parent, Qt::WindowFlags flags ) : QMainWindow ( parent
 	layout.addWidget(&lineColorChange, 11, 8);
 	layout.addWidget(&lineColor, 11, 9);
 	
-	layout.addWidget(&regenerateColors, 12, 0, 1, 5);
-	layout.addWidget(&save, 12, 5, 1, 5);
+	layout.addWidget(&regenerateColors, 12, 0, 1, 4);
+	layout.addWidget(&lowPolyImage, 12, 4, 1, 3);
+	layout.addWidget(&save, 12, 7, 1, 3);
+	
+	layout.addWidget(&recordCamera, 13, 0, 1, 4);
+	layout.addWidget(&replayCamera, 13, 4, 1, 3);
+	layout.addWidget(&saveFrameTimes, 13, 7, 1, 3);
+	
+	layout.addWidget(&recordTrace, 14, 0, 1, 4);
+	layout.addWidget(&generatedMesh, 14, 4, 1, 3);
 }
 
-
+void Window::updatePalette()
+{
+	widget.scene.palette.clear();
+	for(int itemID = 0; itemID < allColors.count(); ++itemID)
+	{
+		QColor color = allColors.item(itemID)->backgroundColor();
+		widget.scene.palette.push_back(fromRGB(color.red(), color.green(), color.blue()));
+	}
+}
@@ -35,8 +35,18 @@ public:
 	
 	
 	QPushButton regenerateColors;
+	QPushButton lowPolyImage;
+	QPushButton generatedMesh;
 	QPushButton save;
 	
+	QPushButton recordCamera;
+	QPushButton replayCamera;
+	QPushButton saveFrameTimes;
+	QPushButton recordTrace;
+	
 	GLWidget widget;
 	
+private:
+	// the widget draws the colors in allColors
+	void updatePalette();
 };
\ No newline at end of file
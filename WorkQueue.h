@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Hands work from one stage of a pipeline to the next. pop blocks until there is something, and
+// returns false once the queue is closed and empty.
+template<typename T>
+class WorkQueue
+{
+public:
+	void push(T item)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			items.push_back(std::move(item));
+		}
+		ready.notify_one();
+	}
+
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [this] { return !items.empty() || closed; });
+		if(items.empty()) return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		return true;
+	}
+
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		ready.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<T> items;
+	bool closed = false;
+};
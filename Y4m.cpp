@@ -0,0 +1,123 @@
+#include "Y4m.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+
+// BT.709 for 8 bit limited range, luma to 16-235 and chroma to 16-240, in 1/65536
+const int yR = 11966, yG = 40254, yB = 4064;
+const int uR = -6596, uG = -22189, uB = 28784;
+const int vR = 28784, vG = -26145, vB = -2639;
+
+unsigned char toLuma(int r, int g, int b)
+{
+	return (unsigned char)(16 + ((yR * r + yG * g + yB * b + 32768) >> 16));
+}
+
+// from the sum of four pixels
+unsigned char toChroma(int r, int g, int b, int cR, int cG, int cB)
+{
+	return (unsigned char)(128 + ((cR * r + cG * g + cB * b + 131072) >> 18));
+}
+
+// Y plane, then U, then V
+void rgbToYuv420(std::vector<unsigned char>& yuv, const unsigned char* rgb, unsigned width, unsigned height)
+{
+	unsigned chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	size_t lumaSize = size_t(width) * height, chromaSize = size_t(chromaWidth) * chromaHeight;
+	yuv.resize(lumaSize + chromaSize * 2);
+	unsigned char* Y = yuv.data();
+	unsigned char* U = Y + lumaSize;
+	unsigned char* V = U + chromaSize;
+
+	const size_t stride = size_t(width) * 3;
+	for(unsigned cy = 0; cy < chromaHeight; ++cy)
+	{
+		// odd sizes repeat the last row and column
+		const unsigned char* rows[2] = { rgb + 2 * cy * stride, rgb + std::min(2 * cy + 1, height - 1) * stride };
+		unsigned char* lumaRows[2] = { Y + size_t(2 * cy) * width, Y + size_t(std::min(2 * cy + 1, height - 1)) * width };
+
+		for(unsigned cx = 0; cx < chromaWidth; ++cx)
+		{
+			unsigned xs[2] = { 2 * cx, std::min(2 * cx + 1, width - 1) };
+			int r = 0, g = 0, b = 0;
+			for(int j = 0; j < 2; ++j)
+			{
+				for(int i = 0; i < 2; ++i)
+				{
+					const unsigned char* pixel = rows[j] + xs[i] * 3;
+					lumaRows[j][xs[i]] = toLuma(pixel[0], pixel[1], pixel[2]);
+					r += pixel[0];
+					g += pixel[1];
+					b += pixel[2];
+				}
+			}
+			U[size_t(cy) * chromaWidth + cx] = toChroma(r, g, b, uR, uG, uB);
+			V[size_t(cy) * chromaWidth + cx] = toChroma(r, g, b, vR, vG, vB);
+		}
+	}
+}
+
+}
+
+Y4mWriter::Y4mWriter(const std::string& path, unsigned width, unsigned height, unsigned fps)
+	: file(path == "-" ? stdout : std::fopen(path.c_str(), "wb")), width(width), height(height)
+{
+	if(file) std::fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=LIMITED\n", width, height, std::max(fps, 1u));
+	else failed = true;
+
+	for(auto& buffer : buffers) freeBuffers.push(&buffer);
+	writer = std::thread([this] { write(); });
+}
+
+Y4mWriter::~Y4mWriter()
+{
+	finish();
+}
+
+void Y4mWriter::addFrame(const unsigned char* rgb)
+{
+	std::vector<unsigned char>* buffer = nullptr;
+	freeBuffers.pop(buffer);
+	buffer->assign(rgb, rgb + size_t(width) * height * 3);
+	filled.push(buffer);
+}
+
+bool Y4mWriter::finish()
+{
+	if(finished) return !failed;
+	finished = true;
+
+	filled.close();
+	writer.join();
+
+	if(file && file != stdout && std::fclose(file)) failed = true;
+	if(file == stdout && std::fflush(file)) failed = true;
+	return !failed;
+}
+
+void Y4mWriter::write()
+{
+	std::vector<unsigned char> yuv;
+	std::vector<unsigned char>* buffer = nullptr;
+	while(filled.pop(buffer))
+	{
+		auto start = std::chrono::steady_clock::now();
+		if(!failed)
+		{
+			rgbToYuv420(yuv, buffer->data(), width, height);
+			failed = std::fputs("FRAME\n", file) < 0 || std::fwrite(yuv.data(), 1, yuv.size(), file) != yuv.size();
+		}
+		writeTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		freeBuffers.push(buffer);
+	}
+}
+
+bool isVideoPath(const std::string& path)
+{
+	return path == "-" || (path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0);
+}
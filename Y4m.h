@@ -0,0 +1,49 @@
+#pragma once
+
+#include "WorkQueue.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams raw video in the YUV4MPEG2 format most encoders read, ffmpeg -i - or x264 --demuxer y4m.
+// Frames are converted to BT.709 limited range 4:2:0 with the chroma centered between pixels
+// (C420jpeg). Each frame is copied into one of two buffers, a thread converts and writes it while
+// the caller draws the next one.
+class Y4mWriter
+{
+public:
+	// Writes to the file at path, or to stdout for "-". Frames are width x height top-down 8 bit RGB.
+	Y4mWriter(const std::string& path, unsigned width, unsigned height, unsigned fps);
+	// finishes the stream if finish wasn't called
+	~Y4mWriter();
+
+	// Copies the frame, blocks while the writer is still busy with the one before last.
+	void addFrame(const unsigned char* rgb);
+
+	// Waits for every frame to be written and closes the file. Returns false if anything couldn't be
+	// written, a closed pipe included.
+	bool finish();
+
+	// time the writer spent converting and writing
+	double writeSeconds() const { return writeTime; }
+
+private:
+	void write();
+
+	std::FILE* file;
+	unsigned width, height;
+
+	std::vector<unsigned char> buffers[2];
+	WorkQueue<std::vector<unsigned char>*> freeBuffers, filled;
+	std::thread writer;
+	bool finished = false;
+
+	// only touched by the writer until it's joined
+	bool failed = false;
+	double writeTime = 0.;
+};
+
+// True for paths Y4mWriter is meant for: ending in .y4m, or "-" for stdout.
+bool isVideoPath(const std::string& path);
@@ -0,0 +1,221 @@
+// Microbenchmarks for the parts of making a wallpaper, from loading a mesh to the saved PNG.
+// Every input is fixed: the corpus in bench/corpus, meshes and colors from constant seeds, so runs
+// compare across commits. Run through the bench target for JSON results:
+//
+//   cmake --build . --target bench        (writes bench.json in the build directory)
+
+#include "MeshGen.h"
+#include "Palette.h"
+#include "Scene.h"
+#include "SoftwareRenderer.h"
+#include "lodepng.h"
+#include "tiny_obj_loader.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const std::string sourceDir = WALLPAPER_GEN_SOURCE_DIR;
+
+// a fixed eight color palette
+const std::vector<std::array<float, 3>> palette = {
+	fromHex(0x1d2b53ff), fromHex(0x7e2553ff), fromHex(0x008751ff), fromHex(0xab5236ff),
+	fromHex(0x5f574fff), fromHex(0xff004dff), fromHex(0xffa300ff), fromHex(0x29adffff),
+};
+
+// generated once per spacing, the default .25 is what the window starts with. A map, so adding a
+// spacing doesn't move the meshes handed out before
+const Mesh& benchMesh(float spacing)
+{
+	static std::map<float, Mesh> meshes;
+	auto found = meshes.find(spacing);
+	if(found != meshes.end()) return found->second;
+
+	MeshGenSettings settings;
+	settings.spacing = spacing;
+	return meshes.emplace(spacing, generateLowPolyMesh(settings)).first->second;
+}
+
+// the spacing of the mesh, in thousandths as benchmark arguments are integers
+float spacingArg(int64_t thousandths)
+{
+	return thousandths / 1000.f;
+}
+
+// the default camera and lines, seed 1
+Scene benchScene()
+{
+	Scene scene;
+	scene.palette = palette;
+	return scene;
+}
+
+// a 1080p wallpaper, what the PNG benchmarks compress
+const std::vector<unsigned char>& benchImage()
+{
+	static std::vector<unsigned char> rgb;
+	if(rgb.empty())
+	{
+		SoftwareRenderer renderer(1);
+		rgb.resize(1920 * 1080 * 3);
+		renderScene(renderer, benchMesh(.25f), benchScene(), 1920, 1080, rgb.data());
+	}
+	return rgb;
+}
+
+void BM_LoadObj(benchmark::State& state, const std::string& path)
+{
+	for(auto _ : state)
+	{
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string error;
+		if(!tinyobj::LoadObj(shapes, materials, error, path.c_str(), (sourceDir + "/").c_str()))
+		{
+			state.SkipWithError(error.c_str());
+			break;
+		}
+		benchmark::DoNotOptimize(shapes.data());
+	}
+}
+BENCHMARK_CAPTURE(BM_LoadObj, thing, sourceDir + "/thing.obj");
+BENCHMARK_CAPTURE(BM_LoadObj, terrain, sourceDir + "/bench/corpus/terrain.obj");
+
+void BM_GenerateMesh(benchmark::State& state)
+{
+	MeshGenSettings settings;
+	settings.spacing = spacingArg(state.range(0));
+	for(auto _ : state) benchmark::DoNotOptimize(generateLowPolyMesh(settings).indices.data());
+}
+BENCHMARK(BM_GenerateMesh)->Arg(250)->Arg(100)->Unit(benchmark::kMillisecond);
+
+// what Regenerate Random Colors does, one pick per vertex
+void BM_PickPaletteColors(benchmark::State& state)
+{
+	size_t count = state.range(0);
+	unsigned seed = 1;
+	for(auto _ : state) benchmark::DoNotOptimize(pickPaletteColors(palette, count, seed++).data());
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_PickPaletteColors)->Arg(10000)->Arg(1000000);
+
+// width, height, mesh spacing in thousandths, threads (0 for all cores)
+void BM_Rasterize(benchmark::State& state)
+{
+	unsigned width = state.range(0), height = state.range(1);
+	const Mesh& mesh = benchMesh(spacingArg(state.range(2)));
+	Scene scene = benchScene();
+	std::vector<std::array<float, 3>> colors = scene.vertexColors(mesh);
+	glm::mat4 MVPMat = scene.camera.viewProjection((float)width / height);
+
+	SoftwareRenderer renderer(state.range(3));
+	std::vector<unsigned char> rgb(size_t(width) * height * 3);
+	for(auto _ : state)
+	{
+		renderer.render(mesh, colors, &MVPMat[0][0], scene.style, width, height, rgb.data());
+		benchmark::DoNotOptimize(rgb.data());
+	}
+	state.SetItemsProcessed(state.iterations() * (mesh.indices.size() / 3));
+}
+BENCHMARK(BM_Rasterize)
+	->Args({ 1920, 1080, 250, 1 })->Args({ 3840, 2160, 250, 1 })->Args({ 3840, 2160, 50, 1 })->Args({ 3840, 2160, 50, 0 })
+	->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_Crc32(benchmark::State& state)
+{
+	const std::vector<unsigned char>& rgb = benchImage();
+	for(auto _ : state) benchmark::DoNotOptimize(lodepng_crc32(rgb.data(), rgb.size()));
+	state.SetBytesProcessed(state.iterations() * rgb.size());
+}
+BENCHMARK(BM_Crc32)->Unit(benchmark::kMillisecond);
+
+void BM_Deflate(benchmark::State& state)
+{
+	const std::vector<unsigned char>& rgb = benchImage();
+	for(auto _ : state)
+	{
+		std::vector<unsigned char> compressed;
+		lodepng::compress(compressed, rgb);
+		benchmark::DoNotOptimize(compressed.data());
+	}
+	state.SetBytesProcessed(state.iterations() * rgb.size());
+}
+BENCHMARK(BM_Deflate)->Unit(benchmark::kMillisecond);
+
+// Stored deflate blocks leave little more than choosing and applying the filters, and the CRC.
+// The argument is the filter strategy.
+void BM_PngFilter(benchmark::State& state)
+{
+	const std::vector<unsigned char>& rgb = benchImage();
+	lodepng::State png;
+	png.info_raw.colortype = LCT_RGB;
+	png.info_png.color.colortype = LCT_RGB;
+	png.encoder.auto_convert = 0;
+	png.encoder.zlibsettings.btype = 0;
+	png.encoder.filter_strategy = LodePNGFilterStrategy(state.range(0));
+	for(auto _ : state)
+	{
+		std::vector<unsigned char> encoded;
+		lodepng::encode(encoded, rgb.data(), 1920, 1080, png);
+		benchmark::DoNotOptimize(encoded.data());
+	}
+	state.SetBytesProcessed(state.iterations() * rgb.size());
+}
+BENCHMARK(BM_PngFilter)->Arg(LFS_ZERO)->Arg(LFS_MINSUM)->Arg(LFS_ENTROPY)->Unit(benchmark::kMillisecond);
+
+void BM_PngEncode(benchmark::State& state)
+{
+	const std::vector<unsigned char>& rgb = benchImage();
+	lodepng::EncoderContext context;
+	for(auto _ : state)
+	{
+		const unsigned char* png = nullptr;
+		size_t pngSize = 0;
+		context.encode(png, pngSize, rgb.data(), 1920, 1080, LCT_RGB, 8);
+		benchmark::DoNotOptimize(png);
+	}
+	state.SetBytesProcessed(state.iterations() * rgb.size());
+}
+BENCHMARK(BM_PngEncode)->Unit(benchmark::kMillisecond);
+
+// A whole wallpaper without a window: colors, render on all cores, encode and write the file.
+// width, height
+void BM_RenderAndSave(benchmark::State& state)
+{
+	unsigned width = state.range(0), height = state.range(1);
+	const Mesh& mesh = benchMesh(.25f);
+	const std::string path = "wallpaper-gen-bench.png";
+
+	Scene scene = benchScene();
+	SoftwareRenderer renderer;
+	lodepng::EncoderContext context;
+	std::vector<unsigned char> rgb(size_t(width) * height * 3);
+	for(auto _ : state)
+	{
+		renderScene(renderer, mesh, scene, width, height, rgb.data());
+		++scene.seed;
+
+		const unsigned char* png = nullptr;
+		size_t pngSize = 0;
+		unsigned error = context.encode(png, pngSize, rgb.data(), width, height, LCT_RGB, 8);
+		if(!error) error = lodepng_save_file(png, pngSize, path.c_str());
+		if(error)
+		{
+			state.SkipWithError(lodepng_error_text(error));
+			break;
+		}
+	}
+	std::remove(path.c_str());
+}
+BENCHMARK(BM_RenderAndSave)->Args({ 1920, 1080 })->Args({ 2560, 1440 })->Args({ 3840, 2160 })
+	->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
@@ -63,19 +63,121 @@ lodepng source code. Don't forget to remove "static" if you copypaste them
 from here.*/
 
 #ifdef LODEPNG_COMPILE_ALLOCATORS
+
+/*
+While a LodePNGEncoderContext runs a job, the allocators below serve memory from its arena
+instead of malloc: allocating bumps a pointer, freeing only gives memory back when it's the
+last block, and the whole arena is reset at the start of the next job. What doesn't fit
+comes from malloc as usual and is counted, so that the next job gets an arena large enough.
+The arena is per thread, contexts on different threads don't see each other's.
+*/
+typedef struct LodePNGArena
+{
+  unsigned char* data;
+  size_t capacity;
+  size_t top; /*amount of bytes in use*/
+  size_t peak; /*highest top of the current job*/
+  size_t overflow; /*bytes of the current job that came from malloc because the arena was full*/
+} LodePNGArena;
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define LODEPNG_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define LODEPNG_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define LODEPNG_THREAD_LOCAL __thread
+#else
+#define LODEPNG_THREAD_LOCAL /*no thread local storage: use encoder contexts from one thread only*/
+#endif
+
+static LODEPNG_THREAD_LOCAL LodePNGArena* lodepng_current_arena = 0;
+
+/*every block starts with a header holding its size, it also keeps the blocks aligned*/
+#define ARENA_HEADER 16u
+#define ARENA_ROUND(size) (((size) + (ARENA_HEADER - 1u)) & ~(size_t)(ARENA_HEADER - 1u))
+
+static int lodepng_arena_owns(const LodePNGArena* arena, const void* ptr)
+{
+  const unsigned char* p = (const unsigned char*)ptr;
+  return arena->data && p >= arena->data && p < arena->data + arena->capacity;
+}
+
+/*returns 0 if it doesn't fit*/
+static void* lodepng_arena_alloc(LodePNGArena* arena, size_t size)
+{
+  unsigned char* block;
+  size_t need;
+  if(size > arena->capacity) return 0;
+  need = ARENA_HEADER + ARENA_ROUND(size);
+  if(need > arena->capacity - arena->top) return 0;
+  block = arena->data + arena->top;
+  *(size_t*)block = size;
+  arena->top += need;
+  if(arena->top > arena->peak) arena->peak = arena->top;
+  return block + ARENA_HEADER;
+}
+
+static int lodepng_arena_is_last(const LodePNGArena* arena, const unsigned char* block)
+{
+  return block + ARENA_HEADER + ARENA_ROUND(*(const size_t*)block) == arena->data + arena->top;
+}
+
+static void lodepng_arena_free(LodePNGArena* arena, void* ptr)
+{
+  unsigned char* block = (unsigned char*)ptr - ARENA_HEADER;
+  if(lodepng_arena_is_last(arena, block)) arena->top = (size_t)(block - arena->data);
+}
+
 static void* lodepng_malloc(size_t size)
 {
+  LodePNGArena* arena = lodepng_current_arena;
+  if(arena)
+  {
+    void* result = lodepng_arena_alloc(arena, size);
+    if(result) return result;
+    arena->overflow += ARENA_HEADER + ARENA_ROUND(size);
+  }
   return malloc(size);
 }
 
-static void* lodepng_realloc(void* ptr, size_t new_size)
+static void lodepng_free(void* ptr)
 {
-  return realloc(ptr, new_size);
+  LodePNGArena* arena = lodepng_current_arena;
+  if(arena && lodepng_arena_owns(arena, ptr)) lodepng_arena_free(arena, ptr);
+  else free(ptr);
 }
 
-static void lodepng_free(void* ptr)
+static void* lodepng_realloc(void* ptr, size_t new_size)
 {
-  free(ptr);
+  LodePNGArena* arena = lodepng_current_arena;
+  if(arena && !ptr) return lodepng_malloc(new_size); /*vectors start out from a null pointer*/
+  if(arena && lodepng_arena_owns(arena, ptr))
+  {
+    unsigned char* block = (unsigned char*)ptr - ARENA_HEADER;
+    size_t old_size = *(size_t*)block;
+    void* result;
+    if(lodepng_arena_is_last(arena, block))
+    {
+      /*the last block grows or shrinks in place*/
+      size_t start = (size_t)(block - arena->data);
+      if(new_size <= arena->capacity && ARENA_HEADER + ARENA_ROUND(new_size) <= arena->capacity - start)
+      {
+        *(size_t*)block = new_size;
+        arena->top = start + ARENA_HEADER + ARENA_ROUND(new_size);
+        if(arena->top > arena->peak) arena->peak = arena->top;
+        return ptr;
+      }
+    }
+    else if(new_size <= old_size) return ptr;
+
+    result = lodepng_malloc(new_size);
+    if(!result) return 0;
+    memcpy(result, ptr, old_size < new_size ? old_size : new_size);
+    lodepng_arena_free(arena, ptr);
+    return result;
+  }
+  if(arena) arena->overflow += ARENA_HEADER + ARENA_ROUND(new_size);
+  return realloc(ptr, new_size);
 }
 #else /*LODEPNG_COMPILE_ALLOCATORS*/
 void* lodepng_malloc(size_t size);
@@ -434,25 +536,81 @@ static void addBitsToStreamReversed(size_t* bitpointer, ucvector* bitstream, uns
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-#define READBIT(bitpointer, bitstream) ((bitstream[bitpointer >> 3] >> (bitpointer & 0x7)) & (unsigned char)1)
+/*
+Bit reader for the inflater. Keeps up to 64 bits of the input in a buffer that is topped up
+a whole word at a time, so that reading a Huffman symbol is a table lookup and a shift instead
+of a loop over single bits. Beyond the end of the input zeros are shifted in, bitreader_overrun
+tells whether any of those got consumed.
+*/
+typedef struct BitReader
+{
+  const unsigned char* data;
+  size_t size; /*size of data in bytes*/
+  size_t pos; /*next byte to load into the buffer, goes past size once zeros are shifted in*/
+  unsigned long long buffer; /*the bits not consumed yet, the next one is the lsb*/
+  unsigned bits; /*amount of valid bits in buffer*/
+} BitReader;
 
-static unsigned char readBitFromStream(size_t* bitpointer, const unsigned char* bitstream)
+static void bitreader_init(BitReader* reader, const unsigned char* data, size_t size)
 {
-  unsigned char result = (unsigned char)(READBIT(*bitpointer, bitstream));
-  ++(*bitpointer);
-  return result;
+  reader->data = data;
+  reader->size = size;
+  reader->pos = 0;
+  reader->buffer = 0;
+  reader->bits = 0;
 }
 
-static unsigned readBitsFromStream(size_t* bitpointer, const unsigned char* bitstream, size_t nbits)
+/*makes sure that at least 56 bits are available in the buffer*/
+static void bitreader_refill(BitReader* reader)
 {
-  unsigned result = 0, i;
-  for(i = 0; i != nbits; ++i)
+  if(reader->pos + 8 <= reader->size)
+  {
+    /*load 8 bytes at once but only count the whole bytes that fit. The bits of the partially
+    fitting bytes are or-ed in again at the same position by the next refill, which is harmless*/
+    const unsigned char* p = reader->data + reader->pos;
+    unsigned long long word = (unsigned long long)p[0] | ((unsigned long long)p[1] << 8u)
+                           | ((unsigned long long)p[2] << 16u) | ((unsigned long long)p[3] << 24u)
+                           | ((unsigned long long)p[4] << 32u) | ((unsigned long long)p[5] << 40u)
+                           | ((unsigned long long)p[6] << 48u) | ((unsigned long long)p[7] << 56u);
+    reader->buffer |= word << reader->bits;
+    reader->pos += (63u - reader->bits) >> 3u;
+    reader->bits |= 56u;
+  }
+  else
   {
-    result += ((unsigned)READBIT(*bitpointer, bitstream)) << i;
-    ++(*bitpointer);
+    while(reader->bits <= 56)
+    {
+      if(reader->pos < reader->size) reader->buffer |= (unsigned long long)reader->data[reader->pos] << reader->bits;
+      ++reader->pos;
+      reader->bits += 8;
+    }
   }
+}
+
+/*returns the next nbits bits without consuming them, nbits must be at most 31 and available*/
+static unsigned bitreader_peek(const BitReader* reader, unsigned nbits)
+{
+  return (unsigned)reader->buffer & ((1u << nbits) - 1u);
+}
+
+static void bitreader_skip(BitReader* reader, unsigned nbits)
+{
+  reader->buffer >>= nbits;
+  reader->bits -= nbits;
+}
+
+static unsigned bitreader_read(BitReader* reader, unsigned nbits)
+{
+  unsigned result = bitreader_peek(reader, nbits);
+  bitreader_skip(reader, nbits);
   return result;
 }
+
+/*returns 1 if bits past the end of the input were consumed*/
+static int bitreader_overrun(const BitReader* reader)
+{
+  return reader->pos > reader->size && (reader->pos - reader->size) * 8 > reader->bits;
+}
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -495,16 +653,26 @@ static const unsigned CLCL_ORDER[NUM_CODE_LENGTH_CODES]
 
 /* ////////////////////////////////////////////////////////////////////////// */
 
+/*amount of bits resolved by the first level of the decoding table*/
+#define FIRSTBITS 9u
+
+/*marks decoding table entries that no code maps to*/
+#define INVALIDSYMBOL 65535u
+
 /*
 Huffman tree struct, containing multiple representations of the tree
 */
 typedef struct HuffmanTree
 {
-  unsigned* tree2d;
   unsigned* tree1d;
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+  /*decoding table, indexed by the next FIRSTBITS bits of input. Entries with a length of at
+  most FIRSTBITS hold the symbol directly. Longer codes share a second level subtable, the
+  first level entry then holds the longest length in it and the offset of that subtable*/
+  unsigned char* table_len; /*code length, or for subtable links the longest length*/
+  unsigned short* table_value; /*symbol, or for subtable links the offset of the subtable*/
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -522,74 +690,127 @@ static void HuffmanTree_draw(HuffmanTree* tree)
 
 static void HuffmanTree_init(HuffmanTree* tree)
 {
-  tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table_len = 0;
+  tree->table_value = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
 {
-  lodepng_free(tree->tree2d);
   lodepng_free(tree->tree1d);
   lodepng_free(tree->lengths);
+  lodepng_free(tree->table_len);
+  lodepng_free(tree->table_value);
+}
+
+static unsigned reverseBits(unsigned bits, unsigned num)
+{
+  unsigned i, result = 0;
+  for(i = 0; i < num; ++i) result |= ((bits >> (num - i - 1u)) & 1u) << i;
+  return result;
 }
 
-/*the tree representation used by the decoder. return value is error*/
-static unsigned HuffmanTree_make2DTree(HuffmanTree* tree)
+/*
+the decoding table used by the decoder. return value is error. Deflate stores the codes
+starting from their msb in the lsb side of the bytes, so the table is indexed by the bit
+reversed codes.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
 {
-  unsigned nodefilled = 0; /*up to which node it is filled*/
-  unsigned treepos = 0; /*position in the tree (1 of the numcodes columns)*/
-  unsigned n, i;
+  static const unsigned headsize = 1u << FIRSTBITS;
+  static const unsigned mask = (1u << FIRSTBITS) - 1u;
+  size_t i, pointer, size; /*total table size*/
+  unsigned* maxlens = (unsigned*)lodepng_malloc(headsize * sizeof(unsigned));
+  if(!maxlens) return 83; /*alloc fail*/
 
-  tree->tree2d = (unsigned*)lodepng_malloc(tree->numcodes * 2 * sizeof(unsigned));
-  if(!tree->tree2d) return 83; /*alloc fail*/
+  /*compute the longest code that starts with each possible first level index*/
+  for(i = 0; i < headsize; ++i) maxlens[i] = 0;
+  for(i = 0; i < tree->numcodes; ++i)
+  {
+    unsigned l = tree->lengths[i], index;
+    if(l <= FIRSTBITS) continue;
+    /*the first FIRSTBITS bits of the code, reversed*/
+    index = reverseBits(tree->tree1d[i] >> (l - FIRSTBITS), FIRSTBITS);
+    if(l > maxlens[index]) maxlens[index] = l;
+  }
+  size = headsize;
+  for(i = 0; i < headsize; ++i)
+  {
+    unsigned l = maxlens[i];
+    if(l > FIRSTBITS) size += (size_t)1u << (l - FIRSTBITS);
+  }
+  tree->table_len = (unsigned char*)lodepng_malloc(size * sizeof(*tree->table_len));
+  tree->table_value = (unsigned short*)lodepng_malloc(size * sizeof(*tree->table_value));
+  if(!tree->table_len || !tree->table_value)
+  {
+    lodepng_free(maxlens);
+    return 83; /*alloc fail*/
+  }
+  /*16 means not filled in yet, no code is that long*/
+  for(i = 0; i < size; ++i) tree->table_len[i] = 16;
 
-  /*
-  convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means
-  uninited, a value >= numcodes is an address to another bit, a value < numcodes
-  is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as
-  many columns as codes - 1.
-  A good huffman tree has N * 2 - 1 nodes, of which N - 1 are internal nodes.
-  Here, the internal nodes are stored (what their 0 and 1 option point to).
-  There is only memory for such good tree currently, if there are more nodes
-  (due to too long length codes), error 55 will happen
-  */
-  for(n = 0; n < tree->numcodes * 2; ++n)
+  /*link the first level entries to their subtables*/
+  pointer = headsize;
+  for(i = 0; i < headsize; ++i)
   {
-    tree->tree2d[n] = 32767; /*32767 here means the tree2d isn't filled there yet*/
+    unsigned l = maxlens[i];
+    if(l <= FIRSTBITS) continue;
+    tree->table_len[i] = (unsigned char)l;
+    tree->table_value[i] = (unsigned short)pointer;
+    pointer += (size_t)1u << (l - FIRSTBITS);
   }
+  lodepng_free(maxlens);
 
-  for(n = 0; n < tree->numcodes; ++n) /*the codes*/
+  /*fill in the symbols: every index whose low bits equal a reversed code decodes to it*/
+  for(i = 0; i < tree->numcodes; ++i)
   {
-    for(i = 0; i != tree->lengths[n]; ++i) /*the bits for this code*/
+    unsigned l = tree->lengths[i];
+    unsigned reverse, j, num;
+    if(l == 0) continue;
+    reverse = reverseBits(tree->tree1d[i], l);
+
+    if(l <= FIRSTBITS)
     {
-      unsigned char bit = (unsigned char)((tree->tree1d[n] >> (tree->lengths[n] - i - 1)) & 1);
-      /*oversubscribed, see comment in lodepng_error_text*/
-      if(treepos > 2147483647 || treepos + 2 > tree->numcodes) return 55;
-      if(tree->tree2d[2 * treepos + bit] == 32767) /*not yet filled in*/
+      num = 1u << (FIRSTBITS - l);
+      for(j = 0; j < num; ++j)
       {
-        if(i + 1 == tree->lengths[n]) /*last bit*/
-        {
-          tree->tree2d[2 * treepos + bit] = n; /*put the current code in it*/
-          treepos = 0;
-        }
-        else
-        {
-          /*put address of the next step in here, first that address has to be found of course
-          (it's just nodefilled + 1)...*/
-          ++nodefilled;
-          /*addresses encoded with numcodes added to it*/
-          tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;
-          treepos = nodefilled;
-        }
+        unsigned index = reverse | (j << l);
+        /*oversubscribed, see comment in lodepng_error_text*/
+        if(tree->table_len[index] != 16) return 55;
+        tree->table_len[index] = (unsigned char)l;
+        tree->table_value[index] = (unsigned short)i;
+      }
+    }
+    else
+    {
+      unsigned index = reverse & mask;
+      unsigned maxlen = tree->table_len[index];
+      unsigned tablelen = maxlen - FIRSTBITS;
+      unsigned start = tree->table_value[index];
+      unsigned reverse2 = reverse >> FIRSTBITS;
+      num = 1u << (tablelen - (l - FIRSTBITS));
+      for(j = 0; j < num; ++j)
+      {
+        size_t index2 = start + (reverse2 | (j << (l - FIRSTBITS)));
+        if(tree->table_len[index2] != 16) return 55; /*oversubscribed*/
+        tree->table_len[index2] = (unsigned char)l;
+        tree->table_value[index2] = (unsigned short)i;
       }
-      else treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
     }
   }
 
-  for(n = 0; n < tree->numcodes * 2; ++n)
+  /*
+  Entries no code maps to can remain in incomplete trees, for example the distance tree of
+  a block with at most one distance code. Reaching them while decoding is an error.
+  */
+  for(i = 0; i < size; ++i)
   {
-    if(tree->tree2d[n] == 32767) tree->tree2d[n] = 0; /*remove possible remaining 32767's*/
+    if(tree->table_len[i] == 16)
+    {
+      tree->table_len[i] = (i < headsize) ? 1 : (FIRSTBITS + 1);
+      tree->table_value[i] = INVALIDSYMBOL;
+    }
   }
 
   return 0;
@@ -636,8 +857,7 @@ static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree)
   uivector_cleanup(&blcount);
   uivector_cleanup(&nextcode);
 
-  if(!error) return HuffmanTree_make2DTree(tree);
-  else return error;
+  return error;
 }
 
 /*
@@ -648,13 +868,15 @@ return value is error.
 static unsigned HuffmanTree_makeFromLengths(HuffmanTree* tree, const unsigned* bitlen,
                                             size_t numcodes, unsigned maxbitlen)
 {
-  unsigned i;
+  unsigned i, error;
   tree->lengths = (unsigned*)lodepng_malloc(numcodes * sizeof(unsigned));
   if(!tree->lengths) return 83; /*alloc fail*/
   for(i = 0; i != numcodes; ++i) tree->lengths[i] = bitlen[i];
   tree->numcodes = (unsigned)numcodes; /*number of symbols*/
   tree->maxbitlen = maxbitlen;
-  return HuffmanTree_makeFromLengths2(tree);
+  error = HuffmanTree_makeFromLengths2(tree);
+  if(!error) error = HuffmanTree_makeTable(tree);
+  return error;
 }
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -719,14 +941,43 @@ static BPMNode* bpmnode_create(BPMLists* lists, int weight, unsigned index, BPMN
   return result;
 }
 
-static int bpmnode_compare(const void* a, const void* b)
+/*orders by weight, equal weights by descending index*/
+static int bpmnode_less(const BPMNode* a, const BPMNode* b)
 {
-  int wa = ((const BPMNode*)a)->weight;
-  int wb = ((const BPMNode*)b)->weight;
-  if(wa < wb) return -1;
-  if(wa > wb) return 1;
-  /*make the qsort a stable sort*/
-  return ((const BPMNode*)a)->index < ((const BPMNode*)b)->index ? 1 : -1;
+  if(a->weight != b->weight) return a->weight < b->weight;
+  return a->index > b->index;
+}
+
+/*
+sort the leaves with lowest weight first. Bottom-up merge sort instead of qsort, whose
+temporary memory would bypass lodepng_malloc. Returns error code.
+*/
+static unsigned bpmnode_sort(BPMNode* leaves, size_t num)
+{
+  BPMNode* mem = (BPMNode*)lodepng_malloc(sizeof(*leaves) * num);
+  size_t width, counter = 0;
+  if(!mem) return 83; /*alloc fail*/
+  for(width = 1; width < num; width *= 2)
+  {
+    BPMNode* a = (counter & 1) ? mem : leaves;
+    BPMNode* b = (counter & 1) ? leaves : mem;
+    size_t p;
+    for(p = 0; p < num; p += 2 * width)
+    {
+      size_t q = (p + width > num) ? num : (p + width);
+      size_t r = (p + 2 * width > num) ? num : (p + 2 * width);
+      size_t i = p, j = q, k;
+      for(k = p; k < r; ++k)
+      {
+        if(i < q && (j >= r || !bpmnode_less(&a[j], &a[i]))) b[k] = a[i++];
+        else b[k] = a[j++];
+      }
+    }
+    ++counter;
+  }
+  if(counter & 1) memcpy(leaves, mem, sizeof(*leaves) * num);
+  lodepng_free(mem);
+  return 0;
 }
 
 /*Boundary Package Merge step, numpresent is the amount of leaves, and c is the current chain.*/
@@ -806,7 +1057,11 @@ unsigned lodepng_huffman_code_lengths(unsigned* lengths, const unsigned* frequen
     BPMLists lists;
     BPMNode* node;
 
-    qsort(leaves, numpresent, sizeof(BPMNode), bpmnode_compare);
+    if(bpmnode_sort(leaves, numpresent))
+    {
+      lodepng_free(leaves);
+      return 83; /*alloc fail*/
+    }
 
     lists.listsize = maxbitlen;
     lists.memsize = 2 * maxbitlen * (maxbitlen + 1);
@@ -916,26 +1171,26 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree)
 #ifdef LODEPNG_COMPILE_DECODER
 
 /*
-returns the code, or (unsigned)(-1) if error happened
-inbitlength is the length of the complete buffer, in bits (so its byte length times 8)
+returns the symbol, or INVALIDSYMBOL for bits that no code maps to. The reader must hold
+at least 15 bits, the longest code length.
 */
-static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
-                                    const HuffmanTree* codetree, size_t inbitlength)
+static unsigned huffmanDecodeSymbol(BitReader* reader, const HuffmanTree* codetree)
 {
-  unsigned treepos = 0, ct;
-  for(;;)
+  unsigned code = bitreader_peek(reader, FIRSTBITS);
+  unsigned l = codetree->table_len[code];
+  unsigned value = codetree->table_value[code];
+  if(l <= FIRSTBITS)
   {
-    if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
-    /*
-    decode the symbol from the tree. The "readBitFromStream" code is inlined in
-    the expression below because this is the biggest bottleneck while decoding
-    */
-    ct = codetree->tree2d[(treepos << 1) + READBIT(*bp, in)];
-    ++(*bp);
-    if(ct < codetree->numcodes) return ct; /*the symbol is decoded, return it*/
-    else treepos = ct - codetree->numcodes; /*symbol not yet decoded, instead move tree position*/
-
-    if(treepos >= codetree->numcodes) return (unsigned)(-1); /*error: it appeared outside the codetree*/
+    bitreader_skip(reader, l);
+    return value;
+  }
+  else
+  {
+    /*second level: value is the offset of the subtable, l the longest code length in it*/
+    bitreader_skip(reader, FIRSTBITS);
+    value += bitreader_peek(reader, l - FIRSTBITS);
+    bitreader_skip(reader, codetree->table_len[value] - FIRSTBITS);
+    return codetree->table_value[value];
   }
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
@@ -955,13 +1210,11 @@ static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
-                                      const unsigned char* in, size_t* bp, size_t inlength)
+static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d, BitReader* reader)
 {
   /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated*/
   unsigned error = 0;
   unsigned n, HLIT, HDIST, HCLEN, i;
-  size_t inbitlength = inlength * 8;
 
   /*see comments in deflateDynamic for explanation of the context and these variables, it is analogous*/
   unsigned* bitlen_ll = 0; /*lit,len code lengths*/
@@ -970,16 +1223,15 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   unsigned* bitlen_cl = 0;
   HuffmanTree tree_cl; /*the code tree for code length codes (the huffman tree for compressed huffman trees)*/
 
-  if((*bp) + 14 > (inlength << 3)) return 49; /*error: the bit pointer is or will go past the memory*/
-
+  bitreader_refill(reader);
   /*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already*/
-  HLIT =  readBitsFromStream(bp, in, 5) + 257;
+  HLIT =  bitreader_read(reader, 5) + 257;
   /*number of distance codes. Unlike the spec, the value 1 is added to it here already*/
-  HDIST = readBitsFromStream(bp, in, 5) + 1;
+  HDIST = bitreader_read(reader, 5) + 1;
   /*number of code length codes. Unlike the spec, the value 4 is added to it here already*/
-  HCLEN = readBitsFromStream(bp, in, 4) + 4;
+  HCLEN = bitreader_read(reader, 4) + 4;
 
-  if((*bp) + HCLEN * 3 > (inlength << 3)) return 50; /*error: the bit pointer is or will go past the memory*/
+  if(bitreader_overrun(reader)) return 49; /*error: the bit pointer is or will go past the memory*/
 
   HuffmanTree_init(&tree_cl);
 
@@ -990,11 +1242,15 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     bitlen_cl = (unsigned*)lodepng_malloc(NUM_CODE_LENGTH_CODES * sizeof(unsigned));
     if(!bitlen_cl) ERROR_BREAK(83 /*alloc fail*/);
 
+    bitreader_refill(reader);
     for(i = 0; i != NUM_CODE_LENGTH_CODES; ++i)
     {
-      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBitsFromStream(bp, in, 3);
+      /*19 codes of 3 bits don't fit in one refill*/
+      if(i == 16) bitreader_refill(reader);
+      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = bitreader_read(reader, 3);
       else bitlen_cl[CLCL_ORDER[i]] = 0; /*if not, it must stay 0*/
     }
+    if(bitreader_overrun(reader)) ERROR_BREAK(50); /*error: the bit pointer is or will go past the memory*/
 
     error = HuffmanTree_makeFromLengths(&tree_cl, bitlen_cl, NUM_CODE_LENGTH_CODES, 7);
     if(error) break;
@@ -1010,7 +1266,10 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     i = 0;
     while(i < HLIT + HDIST)
     {
-      unsigned code = huffmanDecodeSymbol(in, bp, &tree_cl, inbitlength);
+      unsigned code;
+      bitreader_refill(reader); /*enough for a code length code and its repeat bits*/
+      code = huffmanDecodeSymbol(reader, &tree_cl);
+      if(bitreader_overrun(reader)) ERROR_BREAK(10); /*error: end of input memory reached*/
       if(code <= 15) /*a length code*/
       {
         if(i < HLIT) bitlen_ll[i] = code;
@@ -1024,8 +1283,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
         if(i == 0) ERROR_BREAK(54); /*can't repeat previous if i is 0*/
 
-        if((*bp + 2) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 2);
+        replength += bitreader_read(reader, 2);
+        if(bitreader_overrun(reader)) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
 
         if(i < HLIT + 1) value = bitlen_ll[i - 1];
         else value = bitlen_d[i - HLIT - 1];
@@ -1041,8 +1300,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 17) /*repeat "0" 3-10 times*/
       {
         unsigned replength = 3; /*read in the bits that indicate repeat length*/
-        if((*bp + 3) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 3);
+        replength += bitreader_read(reader, 3);
+        if(bitreader_overrun(reader)) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n)
@@ -1057,8 +1316,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 18) /*repeat "0" 11-138 times*/
       {
         unsigned replength = 11; /*read in the bits that indicate repeat length*/
-        if((*bp + 7) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 7);
+        replength += bitreader_read(reader, 7);
+        if(bitreader_overrun(reader)) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n)
@@ -1070,14 +1329,10 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
           ++i;
         }
       }
-      else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+      else /*if(code == INVALIDSYMBOL)*/
       {
-        if(code == (unsigned)(-1))
-        {
-          /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-          (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inbitlength ? 10 : 11;
-        }
+        /*bits that no code of an incomplete tree maps to*/
+        if(code == INVALIDSYMBOL) error = 11;
         else error = 16; /*unexisting code, this can never happen*/
         break;
       }
@@ -1102,94 +1357,142 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   return error;
 }
 
+/*
+Optional receiver of the inflated data. With a sink, the inflater passes finished output on
+in pieces and only keeps the last INFLATE_WINDOW bytes in memory, which is the furthest an
+LZ77 distance can reach back. Memory then stays bounded however large the output is.
+*/
+typedef struct InflateSink
+{
+  unsigned (*consume)(void* user, const unsigned char* data, size_t size); /*returns error code*/
+  void* user;
+} InflateSink;
+
+#define INFLATE_WINDOW 32768
+/*amount of output beyond the window that is gathered before passing it to the sink*/
+#define INFLATE_SINK_CHUNK 262144
+
+/*passes all output except the last keep bytes to the sink*/
+static unsigned inflateSinkFlush(InflateSink* sink, ucvector* out, size_t* pos, size_t keep)
+{
+  size_t amount;
+  unsigned error;
+  if(*pos <= keep) return 0;
+  amount = *pos - keep;
+  error = sink->consume(sink->user, out->data, amount);
+  if(error) return error;
+  memmove(out->data, out->data + amount, keep);
+  *pos = keep;
+  out->size = keep;
+  return 0;
+}
+
+/*room kept free in the output for one symbol: the longest match, plus the overhang of the
+last 8 byte copy of a match*/
+#define INFLATE_OUT_MARGIN (258 + 8)
+
 /*inflate a block with dynamic of fixed Huffman tree*/
-static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-                                    size_t* pos, size_t inlength, unsigned btype)
+static unsigned inflateHuffmanBlock(ucvector* out, BitReader* reader, size_t* pos, unsigned btype, InflateSink* sink)
 {
   unsigned error = 0;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
-  size_t inbitlength = inlength * 8;
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
 
   if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
-  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
+  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/
   {
+    unsigned code_ll;
+    unsigned char* data;
+
+    /*grows the buffer in large steps, out->size is only brought up to date when leaving the loop*/
+    if(!ucvector_reserve(out, (*pos) + INFLATE_OUT_MARGIN)) ERROR_BREAK(83 /*alloc fail*/);
+    data = out->data;
+
+    /*one refill has enough bits for the longest length code, distance code and their extra bits*/
+    bitreader_refill(reader);
+
     /*code_ll is literal, length or end code*/
-    unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
+    code_ll = huffmanDecodeSymbol(reader, &tree_ll);
     if(code_ll <= 255) /*literal symbol*/
     {
-      /*ucvector_push_back would do the same, but for some reason the two lines below run 10% faster*/
-      if(!ucvector_resize(out, (*pos) + 1)) ERROR_BREAK(83 /*alloc fail*/);
-      out->data[*pos] = (unsigned char)code_ll;
-      ++(*pos);
+      data[(*pos)++] = (unsigned char)code_ll;
+      if(bitreader_overrun(reader)) ERROR_BREAK(10); /*error: end of input memory reached without endcode*/
     }
     else if(code_ll >= FIRST_LENGTH_CODE_INDEX && code_ll <= LAST_LENGTH_CODE_INDEX) /*length code*/
     {
       unsigned code_d, distance;
-      unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
-      size_t start, forward, backward, length;
+      size_t start, backward, length;
 
-      /*part 1: get length base*/
+      /*part 1: get length base and the extra bits of the length*/
       length = LENGTHBASE[code_ll - FIRST_LENGTH_CODE_INDEX];
+      length += bitreader_read(reader, LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX]);
 
-      /*part 2: get extra bits and add the value of that to length*/
-      numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
-      if((*bp + numextrabits_l) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
-
-      /*part 3: get distance code*/
-      code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
+      /*part 2: get distance code*/
+      code_d = huffmanDecodeSymbol(reader, &tree_d);
       if(code_d > 29)
       {
-        if(code_ll == (unsigned)(-1)) /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
-        {
-          /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-          (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inlength * 8 ? 10 : 11;
-        }
+        if(bitreader_overrun(reader)) error = 10; /*error: end of input memory reached without endcode*/
+        else if(code_d == INVALIDSYMBOL) error = 11; /*error: bits that no distance code maps to*/
         else error = 18; /*error: invalid distance code (30-31 are never used)*/
         break;
       }
-      distance = DISTANCEBASE[code_d];
 
-      /*part 4: get extra bits from distance*/
-      numextrabits_d = DISTANCEEXTRA[code_d];
-      if((*bp + numextrabits_d) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      distance += readBitsFromStream(bp, in, numextrabits_d);
+      /*part 3: get distance base and the extra bits of the distance*/
+      distance = DISTANCEBASE[code_d];
+      distance += bitreader_read(reader, DISTANCEEXTRA[code_d]);
+      if(bitreader_overrun(reader)) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
-      /*part 5: fill in all the out[n] values based on the length and dist*/
+      /*part 4: fill in all the out[n] values based on the length and dist*/
       start = (*pos);
       if(distance > start) ERROR_BREAK(52); /*too long backward distance*/
       backward = start - distance;
 
-      if(!ucvector_resize(out, (*pos) + length)) ERROR_BREAK(83 /*alloc fail*/);
-      if (distance < length) {
-        for(forward = 0; forward < length; ++forward)
+      if(distance >= 8)
+      {
+        /*copy 8 bytes at a time. With a distance of at least 8 each copied word lies entirely
+        before its destination, also when the match overlaps itself. The last copy can write up
+        to 7 bytes past the match, which the margin reserved above has room for*/
+        size_t forward;
+        for(forward = 0; forward < length; forward += 8)
         {
-          out->data[(*pos)++] = out->data[backward++];
+          memcpy(data + start + forward, data + backward + forward, 8);
         }
-      } else {
-        memcpy(out->data + *pos, out->data + backward, length);
-        *pos += length;
       }
+      else if(distance == 1)
+      {
+        memset(data + start, data[backward], length); /*run of a single byte*/
+      }
+      else
+      {
+        size_t forward;
+        for(forward = 0; forward < length; ++forward) data[start + forward] = data[backward + forward];
+      }
+      *pos += length;
     }
     else if(code_ll == 256)
     {
+      if(bitreader_overrun(reader)) error = 10; /*the end code came from beyond the input*/
       break; /*end code, break the loop*/
     }
-    else /*if(code == (unsigned)(-1))*/ /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+    else /*if(code_ll == INVALIDSYMBOL)*/
     {
-      /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
-      (10=no endcode, 11=wrong jump outside of tree)*/
-      error = ((*bp) > inlength * 8) ? 10 : 11;
+      /*return error code 10 or 11 depending on the situation (10=no endcode, 11=bits that no code maps to)*/
+      error = bitreader_overrun(reader) ? 10 : 11;
       break;
     }
+
+    if(sink && *pos >= INFLATE_WINDOW + INFLATE_SINK_CHUNK)
+    {
+      out->size = *pos;
+      error = inflateSinkFlush(sink, out, pos, INFLATE_WINDOW);
+    }
   }
+  out->size = *pos;
 
   HuffmanTree_cleanup(&tree_ll);
   HuffmanTree_cleanup(&tree_d);
@@ -1197,14 +1500,17 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
+static unsigned inflateNoCompression(ucvector* out, BitReader* reader, size_t* pos)
 {
   size_t p;
-  unsigned LEN, NLEN, n, error = 0;
+  unsigned LEN, NLEN, error = 0;
+  const unsigned char* in = reader->data;
+  size_t inlength = reader->size;
 
-  /*go to first boundary of byte*/
-  while(((*bp) & 0x7) != 0) ++(*bp);
-  p = (*bp) / 8; /*byte position*/
+  /*go to first boundary of byte, the reader then holds only whole bytes*/
+  bitreader_skip(reader, reader->bits & 7u);
+  if(bitreader_overrun(reader)) return 52; /*error, bit pointer will jump past memory*/
+  p = reader->pos - reader->bits / 8; /*byte position*/
 
   /*read LEN (2 bytes) and NLEN (2 bytes)*/
   if(p + 4 >= inlength) return 52; /*error, bit pointer will jump past memory*/
@@ -1218,37 +1524,44 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
 
   /*read the literal data: LEN bytes are now stored in the out buffer*/
   if(p + LEN > inlength) return 23; /*error: reading outside of in buffer*/
-  for(n = 0; n < LEN; ++n) out->data[(*pos)++] = in[p++];
+  memcpy(out->data + *pos, in + p, LEN);
+  *pos += LEN;
+  p += LEN;
 
-  (*bp) = p * 8;
+  /*continue reading after the stored bytes with an empty buffer*/
+  reader->pos = p;
+  reader->buffer = 0;
+  reader->bits = 0;
 
   return error;
 }
 
 static unsigned lodepng_inflatev(ucvector* out,
                                  const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings)
+                                 const LodePNGDecompressSettings* settings, InflateSink* sink)
 {
-  /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
-  size_t bp = 0;
+  BitReader reader;
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
   unsigned error = 0;
 
   (void)settings;
 
+  bitreader_init(&reader, in, insize);
+
   while(!BFINAL)
   {
     unsigned BTYPE;
-    if(bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
-    BFINAL = readBitFromStream(&bp, in);
-    BTYPE = 1u * readBitFromStream(&bp, in);
-    BTYPE += 2u * readBitFromStream(&bp, in);
+    bitreader_refill(&reader);
+    BFINAL = bitreader_read(&reader, 1);
+    BTYPE = bitreader_read(&reader, 2);
+    if(bitreader_overrun(&reader)) return 52; /*error, bit pointer will jump past memory*/
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-    else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, &reader, &pos); /*no compression*/
+    else error = inflateHuffmanBlock(out, &reader, &pos, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
+    if(!error && sink) error = inflateSinkFlush(sink, out, &pos, BFINAL ? 0 : INFLATE_WINDOW);
     if(error) return error;
   }
 
@@ -1262,7 +1575,7 @@ unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
   unsigned error;
   ucvector v;
   ucvector_init_buffer(&v, *out, *outsize);
-  error = lodepng_inflatev(&v, in, insize, settings);
+  error = lodepng_inflatev(&v, in, insize, settings, 0);
   *out = v.data;
   *outsize = v.size;
   return error;
@@ -2102,10 +2415,8 @@ static unsigned adler32(const unsigned char* data, unsigned len)
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings)
+static unsigned zlib_check_header(const unsigned char* in, size_t insize)
 {
-  unsigned error = 0;
   unsigned CM, CINFO, FDICT;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -2134,6 +2445,15 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
     return 26;
   }
 
+  return 0;
+}
+
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings)
+{
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
+
   error = inflate(out, outsize, in + 2, insize - 2, settings);
   if(error) return error;
 
@@ -2160,6 +2480,67 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
   }
 }
 
+
+/*the sink used by zlib_decompress_stream, checksums the data on its way to the real consumer*/
+typedef struct ZlibStreamSink
+{
+  unsigned (*consume)(void* user, const unsigned char* data, size_t size);
+  void* user;
+  unsigned adler;
+} ZlibStreamSink;
+
+static unsigned zlibStreamConsume(void* user, const unsigned char* data, size_t size)
+{
+  ZlibStreamSink* zsink = (ZlibStreamSink*)user;
+  zsink->adler = update_adler32(zsink->adler, data, (unsigned)size);
+  return zsink->consume(zsink->user, data, size);
+}
+
+/*
+Decompresses zlib data and hands the result to consume in pieces instead of building one buffer.
+With a custom zlib or inflate function, the data is decompressed in full first and given in one piece.
+*/
+static unsigned zlib_decompress_stream(const unsigned char* in, size_t insize,
+                                       const LodePNGDecompressSettings* settings,
+                                       unsigned (*consume)(void*, const unsigned char*, size_t), void* user)
+{
+  unsigned error = 0;
+  ZlibStreamSink zsink;
+  InflateSink sink;
+  ucvector window;
+
+  if(settings->custom_zlib || settings->custom_inflate)
+  {
+    unsigned char* buffer = 0;
+    size_t buffersize = 0;
+    error = zlib_decompress(&buffer, &buffersize, in, insize, settings);
+    if(!error) error = consume(user, buffer, buffersize);
+    lodepng_free(buffer);
+    return error;
+  }
+
+  error = zlib_check_header(in, insize);
+  if(error) return error;
+
+  zsink.consume = consume;
+  zsink.user = user;
+  zsink.adler = 1;
+  sink.consume = zlibStreamConsume;
+  sink.user = &zsink;
+
+  ucvector_init(&window);
+  error = lodepng_inflatev(&window, in + 2, insize - 2, settings, &sink);
+  ucvector_cleanup(&window);
+  if(error) return error;
+
+  if(!settings->ignore_adler32 && zsink.adler != lodepng_read32bitInt(&in[insize - 4]))
+  {
+    return 58; /*error, adler checksum not correct, data must be corrupted*/
+  }
+
+  return 0; /*no error*/
+}
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -2230,6 +2611,19 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
   if(!settings->custom_zlib) return 87; /*no custom zlib function provided */
   return settings->custom_zlib(out, outsize, in, insize, settings);
 }
+
+/*without the built in inflate, the custom zlib function has to produce everything at once*/
+static unsigned zlib_decompress_stream(const unsigned char* in, size_t insize,
+                                       const LodePNGDecompressSettings* settings,
+                                       unsigned (*consume)(void*, const unsigned char*, size_t), void* user)
+{
+  unsigned char* buffer = 0;
+  size_t buffersize = 0;
+  unsigned error = zlib_decompress(&buffer, &buffersize, in, insize, settings);
+  if(!error) error = consume(user, buffer, buffersize);
+  lodepng_free(buffer);
+  return error;
+}
 #endif /*LODEPNG_COMPILE_DECODER*/
 #ifdef LODEPNG_COMPILE_ENCODER
 static unsigned zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
@@ -4447,17 +4841,16 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*
+reads the header and all chunks of a PNG into state->info_png, and concatenates the data of
+the IDAT chunks into idat, which must be initialized. return value is in state->error
+*/
+static void readChunks(ucvector* idat, unsigned* w, unsigned* h, LodePNGState* state,
+                       const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
   size_t i;
-  ucvector idat; /*the data from idat chunks*/
-  ucvector scanlines;
-  size_t predict;
   size_t numpixels;
 
   /*for unknown chunk order*/
@@ -4466,9 +4859,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
 
@@ -4480,7 +4870,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   bytes with 16-bit RGBA, the rest is room for filter bytes.*/
   if(numpixels > 268435455) CERROR_RETURN(state->error, 92);
 
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4508,9 +4897,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT"))
     {
-      size_t oldsize = idat.size;
-      if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i != chunkLength; ++i) idat.data[oldsize + i] = data[i];
+      size_t oldsize = idat->size;
+      if(!ucvector_resize(idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+      for(i = 0; i != chunkLength; ++i) idat->data[oldsize + i] = data[i];
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4603,6 +4992,27 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  ucvector idat; /*the data from idat chunks*/
+  ucvector scanlines;
+  size_t predict;
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  ucvector_init(&idat);
+  readChunks(&idat, w, h, state, in, insize);
+  if(state->error)
+  {
+    ucvector_cleanup(&idat);
+    return;
+  }
 
   ucvector_init(&scanlines);
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
@@ -4691,46 +5101,305 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
-unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
-                               size_t insize, LodePNGColorType colortype, unsigned bitdepth)
-{
-  unsigned error;
-  LodePNGState state;
-  lodepng_state_init(&state);
-  state.info_raw.colortype = colortype;
-  state.info_raw.bitdepth = bitdepth;
-  error = lodepng_decode(out, w, h, &state, in, insize);
-  lodepng_state_cleanup(&state);
-  return error;
-}
-
-unsigned lodepng_decode32(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in, size_t insize)
+/*state of lodepng_decode_rows while the inflated scanlines come in*/
+typedef struct RowDecoder
 {
-  return lodepng_decode_memory(out, w, h, in, insize, LCT_RGBA, 8);
+  LodePNGState* state;
+  LodePNGRowCallback callback;
+  void* user;
+  unsigned w, h, bpp;
+  unsigned interlaced;
+  unsigned passw[7], passh[7];
+  unsigned pass; /*current pass, 7 when all scanlines were received. Always 0 without interlacing.*/
+  unsigned passy; /*row within the current pass*/
+  size_t linebytes; /*bytes per scanline of the current pass, without the filter type byte*/
+  size_t bytewidth;
+  size_t filled; /*bytes of scanline received so far*/
+  ucvector scanline; /*filter type byte and filtered bytes of the incoming scanline*/
+  ucvector recon, precon; /*the unfiltered current and previous scanline of the pass*/
+  ucvector passes[5]; /*unfiltered Adam7 passes 1-5, which only hold pixels of even rows*/
+  ucvector row; /*an assembled image row in the color of the PNG*/
+  ucvector converted; /*the same row in the color of info_raw*/
+  unsigned convert;
+} RowDecoder;
+
+/*converts the row if needed and gives it to the user*/
+static unsigned rowDecoderEmit(RowDecoder* decoder, unsigned y, const unsigned char* row)
+{
+  if(decoder->convert)
+  {
+    unsigned error = lodepng_convert(decoder->converted.data, row, &decoder->state->info_raw,
+                                     &decoder->state->info_png.color, decoder->w, 1);
+    if(error) return error;
+    row = decoder->converted.data;
+  }
+  return decoder->callback(decoder->user, y, row) ? 97 : 0;
 }
 
-unsigned lodepng_decode24(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in, size_t insize)
+/*
+Builds even image row y out of the buffered Adam7 passes 1-5 plus pass6, the current row of
+pass 6 (or null if pass 6 is empty), and emits it.
+*/
+static unsigned rowDecoderEmitEvenRow(RowDecoder* decoder, unsigned y, const unsigned char* pass6)
 {
-  return lodepng_decode_memory(out, w, h, in, insize, LCT_RGB, 8);
-}
+  unsigned i, x, b;
+  unsigned char* out = decoder->row.data;
 
-#ifdef LODEPNG_COMPILE_DISK
-unsigned lodepng_decode_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename,
-                             LodePNGColorType colortype, unsigned bitdepth)
-{
-  unsigned char* buffer;
-  size_t buffersize;
-  unsigned error;
-  error = lodepng_load_file(&buffer, &buffersize, filename);
-  if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
-  lodepng_free(buffer);
-  return error;
-}
+  /*the bit setter below only ors bits in*/
+  for(x = 0; x != decoder->row.size; ++x) out[x] = 0;
 
-unsigned lodepng_decode32_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename)
-{
-  return lodepng_decode_file(out, w, h, filename, LCT_RGBA, 8);
-}
+  for(i = 0; i != 6; ++i)
+  {
+    const unsigned char* in;
+    if(decoder->passw[i] == 0 || y < ADAM7_IY[i] || (y - ADAM7_IY[i]) % ADAM7_DY[i] != 0) continue;
+    if(i == 5)
+    {
+      if(!pass6) continue;
+      in = pass6;
+    }
+    else
+    {
+      size_t passlinebytes = (decoder->passw[i] * decoder->bpp + 7) / 8;
+      in = &decoder->passes[i].data[((y - ADAM7_IY[i]) / ADAM7_DY[i]) * passlinebytes];
+    }
+
+    if(decoder->bpp >= 8)
+    {
+      size_t bytewidth = decoder->bpp / 8;
+      for(x = 0; x != decoder->passw[i]; ++x)
+      {
+        size_t pixeloutstart = (ADAM7_IX[i] + x * ADAM7_DX[i]) * bytewidth;
+        for(b = 0; b != bytewidth; ++b) out[pixeloutstart + b] = in[x * bytewidth + b];
+      }
+    }
+    else
+    {
+      for(x = 0; x != decoder->passw[i]; ++x)
+      {
+        size_t ibp = x * decoder->bpp;
+        size_t obp = (ADAM7_IX[i] + x * ADAM7_DX[i]) * decoder->bpp;
+        for(b = 0; b != decoder->bpp; ++b)
+        {
+          unsigned char bit = readBitFromReversedStream(&ibp, in);
+          setBitOfReversedStream0(&obp, out, bit);
+        }
+      }
+    }
+  }
+
+  return rowDecoderEmit(decoder, y, out);
+}
+
+/*moves on to the next pass that has pixels, emitting the even rows if pass 6 turns out to be empty*/
+static unsigned rowDecoderNextPass(RowDecoder* decoder)
+{
+  unsigned error = 0;
+  do
+  {
+    ++decoder->pass;
+    if(decoder->interlaced && decoder->pass == 6 && decoder->passw[5] == 0)
+    {
+      unsigned y;
+      for(y = 0; y < decoder->h && !error; y += 2) error = rowDecoderEmitEvenRow(decoder, y, 0);
+    }
+  }
+  while(!error && decoder->pass < 7 && (decoder->passw[decoder->pass] == 0 || decoder->passh[decoder->pass] == 0));
+
+  decoder->passy = 0;
+  if(decoder->pass < 7) decoder->linebytes = (decoder->passw[decoder->pass] * decoder->bpp + 7) / 8;
+  return error;
+}
+
+static unsigned rowDecoderFinishScanline(RowDecoder* decoder)
+{
+  unsigned error;
+  unsigned char* recon = decoder->recon.data;
+  const unsigned char* precon = decoder->passy ? decoder->precon.data : 0;
+  unsigned pass = decoder->pass;
+
+  error = unfilterScanline(recon, &decoder->scanline.data[1], precon, decoder->bytewidth,
+                           decoder->scanline.data[0], decoder->linebytes);
+  if(error) return error;
+
+  if(!decoder->interlaced) error = rowDecoderEmit(decoder, decoder->passy, recon);
+  else if(pass < 5)
+  {
+    size_t i;
+    unsigned char* out = &decoder->passes[pass].data[decoder->passy * decoder->linebytes];
+    for(i = 0; i != decoder->linebytes; ++i) out[i] = recon[i];
+  }
+  else if(pass == 5) error = rowDecoderEmitEvenRow(decoder, decoder->passy * 2, recon);
+  else /*pass 7 holds complete odd rows*/ error = rowDecoderEmit(decoder, decoder->passy * 2 + 1, recon);
+  if(error) return error;
+
+  /*the current scanline becomes the previous one*/
+  decoder->recon.data = decoder->precon.data;
+  decoder->precon.data = recon;
+
+  if(++decoder->passy == decoder->passh[pass])
+  {
+    if(!decoder->interlaced) decoder->pass = 7;
+    else error = rowDecoderNextPass(decoder);
+  }
+  return error;
+}
+
+/*receives the inflated IDAT data, in pieces of any size*/
+static unsigned rowDecoderConsume(void* user, const unsigned char* data, size_t size)
+{
+  RowDecoder* decoder = (RowDecoder*)user;
+  while(size)
+  {
+    size_t amount = 1 + decoder->linebytes - decoder->filled;
+    if(decoder->pass == 7) return 91; /*more data than the image has scanlines*/
+    if(amount > size) amount = size;
+    memcpy(&decoder->scanline.data[decoder->filled], data, amount);
+    decoder->filled += amount;
+    data += amount;
+    size -= amount;
+
+    if(decoder->filled == 1 + decoder->linebytes)
+    {
+      unsigned error = rowDecoderFinishScanline(decoder);
+      if(error) return error;
+      decoder->filled = 0;
+    }
+  }
+  return 0;
+}
+
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback callback, void* user)
+{
+  RowDecoder decoder;
+  ucvector idat;
+  unsigned i;
+  size_t maxlinebytes;
+
+  ucvector_init(&idat);
+  readChunks(&idat, w, h, state, in, insize);
+  if(state->error)
+  {
+    ucvector_cleanup(&idat);
+    return state->error;
+  }
+
+  decoder.state = state;
+  decoder.callback = callback;
+  decoder.user = user;
+  decoder.w = *w;
+  decoder.h = *h;
+  decoder.bpp = lodepng_get_bpp(&state->info_png.color);
+  decoder.interlaced = state->info_png.interlace_method != 0;
+  decoder.bytewidth = (decoder.bpp + 7) / 8;
+  decoder.filled = 0;
+  ucvector_init(&decoder.scanline);
+  ucvector_init(&decoder.recon);
+  ucvector_init(&decoder.precon);
+  for(i = 0; i != 5; ++i) ucvector_init(&decoder.passes[i]);
+  ucvector_init(&decoder.row);
+  ucvector_init(&decoder.converted);
+
+  decoder.convert = state->decoder.color_convert &&
+                    !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color);
+  if(!state->decoder.color_convert) state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+  /*the same conversions lodepng_decode supports*/
+  else if(decoder.convert && !(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+          && !(state->info_raw.bitdepth == 8)) state->error = 56;
+
+  while(!state->error) /*while only executed once, to break on error*/
+  {
+    if(decoder.bpp == 0) CERROR_BREAK(state->error, 31); /*invalid colortype*/
+    maxlinebytes = ((size_t)decoder.w * decoder.bpp + 7) / 8;
+    if(!decoder.interlaced)
+    {
+      decoder.passw[0] = decoder.w;
+      decoder.passh[0] = decoder.h;
+      decoder.pass = 0;
+      decoder.passy = 0;
+      decoder.linebytes = maxlinebytes;
+    }
+    else
+    {
+      size_t filter_passstart[8], padded_passstart[8], passstart[8];
+      Adam7_getpassvalues(decoder.passw, decoder.passh, filter_passstart, padded_passstart, passstart,
+                          decoder.w, decoder.h, decoder.bpp);
+      for(i = 0; i != 5; ++i)
+      {
+        size_t size = padded_passstart[i + 1] - padded_passstart[i];
+        if(!ucvector_resize(&decoder.passes[i], size)) CERROR_BREAK(state->error, 83); /*alloc fail*/
+      }
+      if(state->error) break;
+      decoder.pass = (unsigned)(-1);
+      state->error = rowDecoderNextPass(&decoder);
+      if(state->error) break;
+    }
+
+    if(!ucvector_resize(&decoder.scanline, 1 + maxlinebytes) || !ucvector_resize(&decoder.recon, maxlinebytes)
+       || !ucvector_resize(&decoder.precon, maxlinebytes) || !ucvector_resize(&decoder.row, maxlinebytes)
+       || !ucvector_resize(&decoder.converted, lodepng_get_raw_size(decoder.w, 1, &state->info_raw)))
+    {
+      CERROR_BREAK(state->error, 83); /*alloc fail*/
+    }
+
+    state->error = zlib_decompress_stream(idat.data, idat.size, &state->decoder.zlibsettings,
+                                          rowDecoderConsume, &decoder);
+    /*all scanlines must have arrived, and nothing more*/
+    if(!state->error && (decoder.pass != 7 || decoder.filled != 0)) state->error = 91;
+    break;
+  }
+
+  ucvector_cleanup(&idat);
+  ucvector_cleanup(&decoder.scanline);
+  ucvector_cleanup(&decoder.recon);
+  ucvector_cleanup(&decoder.precon);
+  for(i = 0; i != 5; ++i) ucvector_cleanup(&decoder.passes[i]);
+  ucvector_cleanup(&decoder.row);
+  ucvector_cleanup(&decoder.converted);
+  return state->error;
+}
+
+unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
+                               size_t insize, LodePNGColorType colortype, unsigned bitdepth)
+{
+  unsigned error;
+  LodePNGState state;
+  lodepng_state_init(&state);
+  state.info_raw.colortype = colortype;
+  state.info_raw.bitdepth = bitdepth;
+  error = lodepng_decode(out, w, h, &state, in, insize);
+  lodepng_state_cleanup(&state);
+  return error;
+}
+
+unsigned lodepng_decode32(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in, size_t insize)
+{
+  return lodepng_decode_memory(out, w, h, in, insize, LCT_RGBA, 8);
+}
+
+unsigned lodepng_decode24(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in, size_t insize)
+{
+  return lodepng_decode_memory(out, w, h, in, insize, LCT_RGB, 8);
+}
+
+#ifdef LODEPNG_COMPILE_DISK
+unsigned lodepng_decode_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename,
+                             LodePNGColorType colortype, unsigned bitdepth)
+{
+  unsigned char* buffer;
+  size_t buffersize;
+  unsigned error;
+  error = lodepng_load_file(&buffer, &buffersize, filename);
+  if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
+  lodepng_free(buffer);
+  return error;
+}
+
+unsigned lodepng_decode32_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename)
+{
+  return lodepng_decode_file(out, w, h, filename, LCT_RGBA, 8);
+}
 
 unsigned lodepng_decode24_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename)
 {
@@ -5132,6 +5801,86 @@ static float flog2(float f)
   return result + 1.442695f * (f * f * f / 3 - 3 * f * f / 2 + 3 * f - 1.83333f);
 }
 
+/*
+Filters one scanline with the adaptive heuristic of strategy (LFS_MINSUM or LFS_ENTROPY) and
+returns the chosen filter type. out receives the linebytes filtered bytes, without the filter
+type byte. attempt must point to 5 buffers of at least linebytes bytes each.
+*/
+static unsigned char filterScanlineAdaptive(unsigned char* out, const unsigned char* scanline,
+                                            const unsigned char* prevline, size_t linebytes, size_t bytewidth,
+                                            LodePNGFilterStrategy strategy, unsigned char* attempt[5])
+{
+  size_t x;
+  unsigned char type, bestType = 0;
+
+  if(strategy == LFS_MINSUM)
+  {
+    size_t sum[5];
+    size_t smallest = 0;
+
+    /*try the 5 filter types*/
+    for(type = 0; type != 5; ++type)
+    {
+      filterScanline(attempt[type], scanline, prevline, linebytes, bytewidth, type);
+
+      /*calculate the sum of the result*/
+      sum[type] = 0;
+      if(type == 0)
+      {
+        for(x = 0; x != linebytes; ++x) sum[type] += (unsigned char)(attempt[type][x]);
+      }
+      else
+      {
+        for(x = 0; x != linebytes; ++x)
+        {
+          /*For differences, each byte should be treated as signed, values above 127 are negative
+          (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
+          This means filtertype 0 is almost never chosen, but that is justified.*/
+          unsigned char s = attempt[type][x];
+          sum[type] += s < 128 ? s : (255U - s);
+        }
+      }
+
+      /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+      if(type == 0 || sum[type] < smallest)
+      {
+        bestType = type;
+        smallest = sum[type];
+      }
+    }
+  }
+  else /*LFS_ENTROPY*/
+  {
+    float sum[5];
+    float smallest = 0;
+    unsigned count[256];
+
+    /*try the 5 filter types*/
+    for(type = 0; type != 5; ++type)
+    {
+      filterScanline(attempt[type], scanline, prevline, linebytes, bytewidth, type);
+      for(x = 0; x != 256; ++x) count[x] = 0;
+      for(x = 0; x != linebytes; ++x) ++count[attempt[type][x]];
+      ++count[type]; /*the filter type itself is part of the scanline*/
+      sum[type] = 0;
+      for(x = 0; x != 256; ++x)
+      {
+        float p = count[x] / (float)(linebytes + 1);
+        sum[type] += count[x] == 0 ? 0 : flog2(1 / p) * p;
+      }
+      /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+      if(type == 0 || sum[type] < smallest)
+      {
+        bestType = type;
+        smallest = sum[type];
+      }
+    }
+  }
+
+  for(x = 0; x != linebytes; ++x) out[x] = attempt[bestType][x];
+  return bestType;
+}
+
 static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
                        const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
 {
@@ -5180,107 +5929,27 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       prevline = &in[inindex];
     }
   }
-  else if(strategy == LFS_MINSUM)
+  else if(strategy == LFS_MINSUM || strategy == LFS_ENTROPY)
   {
     /*adaptive filtering*/
-    size_t sum[5];
     ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
-    size_t smallest = 0;
-    unsigned char type, bestType = 0;
-
-    for(type = 0; type != 5; ++type)
-    {
-      ucvector_init(&attempt[type]);
-      if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
-    }
-
-    if(!error)
-    {
-      for(y = 0; y != h; ++y)
-      {
-        /*try the 5 filter types*/
-        for(type = 0; type != 5; ++type)
-        {
-          filterScanline(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
-
-          /*calculate the sum of the result*/
-          sum[type] = 0;
-          if(type == 0)
-          {
-            for(x = 0; x != linebytes; ++x) sum[type] += (unsigned char)(attempt[type].data[x]);
-          }
-          else
-          {
-            for(x = 0; x != linebytes; ++x)
-            {
-              /*For differences, each byte should be treated as signed, values above 127 are negative
-              (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-              This means filtertype 0 is almost never chosen, but that is justified.*/
-              unsigned char s = attempt[type].data[x];
-              sum[type] += s < 128 ? s : (255U - s);
-            }
-          }
-
-          /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-          if(type == 0 || sum[type] < smallest)
-          {
-            bestType = type;
-            smallest = sum[type];
-          }
-        }
-
-        prevline = &in[y * linebytes];
-
-        /*now fill the out values*/
-        out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
-      }
-    }
-
-    for(type = 0; type != 5; ++type) ucvector_cleanup(&attempt[type]);
-  }
-  else if(strategy == LFS_ENTROPY)
-  {
-    float sum[5];
-    ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
-    float smallest = 0;
-    unsigned type, bestType = 0;
-    unsigned count[256];
+    unsigned char* attemptdata[5];
+    unsigned char type;
 
     for(type = 0; type != 5; ++type)
     {
       ucvector_init(&attempt[type]);
       if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
+      attemptdata[type] = attempt[type].data;
     }
 
     for(y = 0; y != h; ++y)
     {
-      /*try the 5 filter types*/
-      for(type = 0; type != 5; ++type)
-      {
-        filterScanline(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
-        for(x = 0; x != 256; ++x) count[x] = 0;
-        for(x = 0; x != linebytes; ++x) ++count[attempt[type].data[x]];
-        ++count[type]; /*the filter type itself is part of the scanline*/
-        sum[type] = 0;
-        for(x = 0; x != 256; ++x)
-        {
-          float p = count[x] / (float)(linebytes + 1);
-          sum[type] += count[x] == 0 ? 0 : flog2(1 / p) * p;
-        }
-        /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-        if(type == 0 || sum[type] < smallest)
-        {
-          bestType = type;
-          smallest = sum[type];
-        }
-      }
-
+      size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
+      /*the first byte of a scanline will be the filter type*/
+      out[outindex] = filterScanlineAdaptive(&out[outindex + 1], &in[y * linebytes], prevline,
+                                             linebytes, bytewidth, strategy, attemptdata);
       prevline = &in[y * linebytes];
-
-      /*now fill the out values*/
-      out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-      for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
     }
 
     for(type = 0; type != 5; ++type) ucvector_cleanup(&attempt[type]);
@@ -5805,6 +6474,396 @@ unsigned lodepng_encode24_file(const char* filename, const unsigned char* image,
 }
 #endif /*LODEPNG_COMPILE_DISK*/
 
+#ifdef LODEPNG_COMPILE_ZLIB
+
+/*the streaming encoder writes an IDAT chunk once this much zlib data is buffered*/
+#define STREAM_IDAT_SIZE 65536
+
+struct LodePNGStreamEncoder
+{
+  LodePNGStreamWriteFunc write;
+  void* user;
+  FILE* file; /*only set when the encoder opened the file itself, closed in lodepng_stream_encoder_free*/
+
+  unsigned w, h;
+  unsigned y; /*amount of rows received so far*/
+  LodePNGColorMode color;
+  LodePNGEncoderSettings settings;
+  LodePNGFilterStrategy strategy;
+  size_t linebytes, bytewidth;
+
+  ucvector prevline; /*previous unfiltered scanline, empty before the first row*/
+  ucvector attempt[5]; /*scratch lines for the adaptive filter heuristics*/
+
+  /*Filtered scanlines waiting to be deflated, plus up to one window of already deflated history
+  for LZ77 back references. Its first byte is always at a multiple of the window size in the
+  stream, so the circular positions in the hash stay valid when the front is dropped.*/
+  ucvector window;
+  size_t start; /*index in window of the first byte not deflated yet*/
+  size_t blocksize;
+  Hash hash;
+
+  ucvector bits; /*deflate output, holds at most one partial byte between blocks*/
+  size_t bp; /*bit pointer in bits*/
+  unsigned adler;
+
+  ucvector idat; /*zlib data not yet written out as an IDAT chunk*/
+  ucvector chunk;
+
+  unsigned error;
+  unsigned finished;
+};
+
+static unsigned streamEmit(LodePNGStreamEncoder* encoder, const unsigned char* data, size_t size)
+{
+  if(encoder->write(encoder->user, data, size)) return 96; /*writer reported failure*/
+  return 0;
+}
+
+static unsigned streamFlushIdat(LodePNGStreamEncoder* encoder, unsigned all)
+{
+  if(encoder->idat.size == 0 || (!all && encoder->idat.size < STREAM_IDAT_SIZE)) return 0;
+  encoder->chunk.size = 0;
+  CERROR_TRY_RETURN(addChunk(&encoder->chunk, "IDAT", encoder->idat.data, encoder->idat.size));
+  encoder->idat.size = 0;
+  return streamEmit(encoder, encoder->chunk.data, encoder->chunk.size);
+}
+
+/*deflates everything from start to the end of the window as one block*/
+static unsigned streamDeflateBlock(LodePNGStreamEncoder* encoder, unsigned final)
+{
+  unsigned error = 0;
+  size_t i, nbytes;
+  size_t windowsize = encoder->settings.zlibsettings.windowsize;
+  const LodePNGCompressSettings* zlibsettings = &encoder->settings.zlibsettings;
+
+  /*an empty final block is cheapest as a fixed block holding only the end code*/
+  if(zlibsettings->btype == 1 || encoder->start == encoder->window.size)
+  {
+    error = deflateFixed(&encoder->bits, &encoder->bp, &encoder->hash, encoder->window.data,
+                         encoder->start, encoder->window.size, zlibsettings, final);
+  }
+  else
+  {
+    error = deflateDynamic(&encoder->bits, &encoder->bp, &encoder->hash, encoder->window.data,
+                           encoder->start, encoder->window.size, zlibsettings, final);
+  }
+  if(error) return error;
+  encoder->start = encoder->window.size;
+
+  /*move the complete bytes to the IDAT buffer, keep a trailing partial byte unless this was the last block*/
+  nbytes = final ? encoder->bits.size : encoder->bp / 8;
+  for(i = 0; i != nbytes; ++i)
+  {
+    if(!ucvector_push_back(&encoder->idat, encoder->bits.data[i])) return 83; /*alloc fail*/
+  }
+  if(nbytes < encoder->bits.size) encoder->bits.data[0] = encoder->bits.data[nbytes];
+  encoder->bits.size -= nbytes;
+  encoder->bp -= nbytes * 8;
+  if(final) encoder->bp = 0;
+
+  /*drop history that can no longer be referenced, in whole windows*/
+  if(encoder->start > windowsize)
+  {
+    size_t drop = ((encoder->start - windowsize) / windowsize) * windowsize;
+    if(drop)
+    {
+      memmove(encoder->window.data, encoder->window.data + drop, encoder->window.size - drop);
+      encoder->window.size -= drop;
+      encoder->start -= drop;
+    }
+  }
+
+  return streamFlushIdat(encoder, 0);
+}
+
+static unsigned streamBegin(LodePNGStreamEncoder** out, unsigned w, unsigned h, const LodePNGState* state,
+                            LodePNGStreamWriteFunc write, void* user, FILE* file)
+{
+  LodePNGStreamEncoder* encoder;
+  const LodePNGColorMode* color = &state->info_png.color;
+  unsigned bpp, i;
+  unsigned error = 0;
+  size_t totalsize;
+  ucvector header;
+
+  *out = 0;
+  if(w == 0 || h == 0) return 93;
+  error = checkColorValidity(color->colortype, color->bitdepth);
+  if(error) return error;
+  if(state->encoder.zlibsettings.btype > 2) return 61;
+  /*Adam7 needs the whole image before the first pass is complete*/
+  if(state->info_png.interlace_method != 0 || state->encoder.zlibsettings.btype == 0) return 94;
+  if(color->colortype == LCT_PALETTE && (color->palettesize == 0 || color->palettesize > 256)) return 68;
+
+  encoder = (LodePNGStreamEncoder*)lodepng_malloc(sizeof(LodePNGStreamEncoder));
+  if(!encoder) return 83; /*alloc fail*/
+
+  encoder->write = write;
+  encoder->user = user;
+  encoder->file = file;
+  encoder->w = w;
+  encoder->h = h;
+  encoder->y = 0;
+  encoder->error = 0;
+  encoder->finished = 0;
+  encoder->settings = state->encoder;
+  encoder->settings.zlibsettings.custom_zlib = 0;
+  encoder->settings.zlibsettings.custom_deflate = 0;
+  lodepng_color_mode_init(&encoder->color);
+  ucvector_init(&encoder->prevline);
+  for(i = 0; i != 5; ++i) ucvector_init(&encoder->attempt[i]);
+  ucvector_init(&encoder->window);
+  ucvector_init(&encoder->bits);
+  ucvector_init(&encoder->idat);
+  ucvector_init(&encoder->chunk);
+  encoder->start = 0;
+  encoder->bp = 0;
+  encoder->adler = 1;
+  *out = encoder;
+
+  error = hash_init(&encoder->hash, encoder->settings.zlibsettings.windowsize);
+  if(error) return error;
+  error = lodepng_color_mode_copy(&encoder->color, color);
+  if(error) return error;
+
+  bpp = lodepng_get_bpp(color);
+  encoder->linebytes = ((size_t)w * bpp + 7) / 8;
+  encoder->bytewidth = (bpp + 7) / 8;
+
+  encoder->strategy = encoder->settings.filter_strategy;
+  if(encoder->settings.filter_palette_zero &&
+     (color->colortype == LCT_PALETTE || color->bitdepth < 8)) encoder->strategy = LFS_ZERO;
+  /*brute force needs to deflate every attempt, the sum heuristic is the closest per-row choice*/
+  if(encoder->strategy == LFS_BRUTE_FORCE) encoder->strategy = LFS_MINSUM;
+  if(encoder->strategy == LFS_PREDEFINED && !encoder->settings.predefined_filters) return 88;
+  if(encoder->strategy > LFS_PREDEFINED) return 88;
+
+  for(i = 0; i != 5; ++i)
+  {
+    if(!ucvector_resize(&encoder->attempt[i], encoder->linebytes)) return 83; /*alloc fail*/
+  }
+
+  /*same block size heuristic as lodepng_deflatev, based on the final size of the filtered image*/
+  totalsize = (size_t)h * (encoder->linebytes + 1);
+  encoder->blocksize = totalsize / 8 + 8;
+  if(encoder->blocksize < 65536) encoder->blocksize = 65536;
+  if(encoder->blocksize > 262144) encoder->blocksize = 262144;
+
+  /*everything before the first IDAT chunk*/
+  ucvector_init(&header);
+  writeSignature(&header);
+  error = addChunk_IHDR(&header, w, h, color->colortype, color->bitdepth, 0);
+  if(!error && color->colortype == LCT_PALETTE)
+  {
+    error = addChunk_PLTE(&header, color);
+    if(!error && getPaletteTranslucency(color->palette, color->palettesize) != 0)
+    {
+      error = addChunk_tRNS(&header, color);
+    }
+  }
+  if(!error && (color->colortype == LCT_GREY || color->colortype == LCT_RGB) && color->key_defined)
+  {
+    error = addChunk_tRNS(&header, color);
+  }
+  if(!error) error = streamEmit(encoder, header.data, header.size);
+  ucvector_cleanup(&header);
+  if(error) return error;
+
+  /*zlib header, the same as lodepng_zlib_compress writes*/
+  if(!ucvector_push_back(&encoder->idat, 0x78)) return 83; /*alloc fail*/
+  if(!ucvector_push_back(&encoder->idat, 0x01)) return 83; /*alloc fail*/
+
+  return 0;
+}
+
+unsigned lodepng_stream_encoder_begin(LodePNGStreamEncoder** encoder, unsigned w, unsigned h,
+                                      const LodePNGState* state, LodePNGStreamWriteFunc write, void* user)
+{
+  return streamBegin(encoder, w, h, state, write, user, 0);
+}
+
+unsigned lodepng_stream_encoder_write_rows(LodePNGStreamEncoder* encoder, const unsigned char* rows,
+                                           unsigned numrows)
+{
+  unsigned i;
+  if(encoder->error) return encoder->error;
+
+  for(i = 0; i != numrows; ++i)
+  {
+    const unsigned char* scanline = &rows[i * encoder->linebytes];
+    const unsigned char* prevline = encoder->prevline.size ? encoder->prevline.data : 0;
+    size_t index = encoder->window.size;
+    unsigned char* out;
+
+    if(encoder->finished || encoder->y == encoder->h) CERROR_BREAK(encoder->error, 95);
+    if(!ucvector_resize(&encoder->window, index + 1 + encoder->linebytes)) CERROR_BREAK(encoder->error, 83);
+    out = &encoder->window.data[index];
+
+    if(encoder->strategy == LFS_MINSUM || encoder->strategy == LFS_ENTROPY)
+    {
+      unsigned char* attempt[5];
+      unsigned type;
+      for(type = 0; type != 5; ++type) attempt[type] = encoder->attempt[type].data;
+      out[0] = filterScanlineAdaptive(&out[1], scanline, prevline, encoder->linebytes, encoder->bytewidth,
+                                      encoder->strategy, attempt);
+    }
+    else
+    {
+      out[0] = encoder->strategy == LFS_PREDEFINED ? encoder->settings.predefined_filters[encoder->y] : 0;
+      filterScanline(&out[1], scanline, prevline, encoder->linebytes, encoder->bytewidth, out[0]);
+    }
+
+    encoder->adler = update_adler32(encoder->adler, out, (unsigned)(1 + encoder->linebytes));
+
+    if(!ucvector_resize(&encoder->prevline, encoder->linebytes)) CERROR_BREAK(encoder->error, 83);
+    memcpy(encoder->prevline.data, scanline, encoder->linebytes);
+    ++encoder->y;
+
+    if(encoder->window.size - encoder->start >= encoder->blocksize)
+    {
+      encoder->error = streamDeflateBlock(encoder, 0);
+      if(encoder->error) break;
+    }
+  }
+
+  return encoder->error;
+}
+
+unsigned lodepng_stream_encoder_finish(LodePNGStreamEncoder* encoder)
+{
+  unsigned char trailer[4];
+  if(encoder->error) return encoder->error;
+  if(encoder->finished || encoder->y != encoder->h) CERROR_RETURN_ERROR(encoder->error, 95);
+  encoder->finished = 1;
+
+  encoder->error = streamDeflateBlock(encoder, 1);
+  if(encoder->error) return encoder->error;
+
+  lodepng_set32bitInt(trailer, encoder->adler);
+  if(!ucvector_push_back(&encoder->idat, trailer[0]) || !ucvector_push_back(&encoder->idat, trailer[1]) ||
+     !ucvector_push_back(&encoder->idat, trailer[2]) || !ucvector_push_back(&encoder->idat, trailer[3]))
+  {
+    CERROR_RETURN_ERROR(encoder->error, 83); /*alloc fail*/
+  }
+  encoder->error = streamFlushIdat(encoder, 1);
+  if(encoder->error) return encoder->error;
+
+  encoder->chunk.size = 0;
+  encoder->error = addChunk_IEND(&encoder->chunk);
+  if(!encoder->error) encoder->error = streamEmit(encoder, encoder->chunk.data, encoder->chunk.size);
+#ifdef LODEPNG_COMPILE_DISK
+  if(!encoder->error && encoder->file && fflush(encoder->file) != 0) encoder->error = 96;
+#endif /*LODEPNG_COMPILE_DISK*/
+
+  return encoder->error;
+}
+
+void lodepng_stream_encoder_free(LodePNGStreamEncoder* encoder)
+{
+  unsigned i;
+  if(!encoder) return;
+  hash_cleanup(&encoder->hash);
+  lodepng_color_mode_cleanup(&encoder->color);
+  ucvector_cleanup(&encoder->prevline);
+  for(i = 0; i != 5; ++i) ucvector_cleanup(&encoder->attempt[i]);
+  ucvector_cleanup(&encoder->window);
+  ucvector_cleanup(&encoder->bits);
+  ucvector_cleanup(&encoder->idat);
+  ucvector_cleanup(&encoder->chunk);
+#ifdef LODEPNG_COMPILE_DISK
+  if(encoder->file) fclose(encoder->file);
+#endif /*LODEPNG_COMPILE_DISK*/
+  lodepng_free(encoder);
+}
+
+#ifdef LODEPNG_COMPILE_DISK
+static unsigned streamWriteFile(void* user, const unsigned char* data, size_t size)
+{
+  return fwrite(data, 1, size, (FILE*)user) != size;
+}
+
+unsigned lodepng_stream_encoder_begin_file(LodePNGStreamEncoder** encoder, unsigned w, unsigned h,
+                                           const LodePNGState* state, const char* filename)
+{
+  unsigned error;
+  FILE* file = fopen(filename, "wb");
+  *encoder = 0;
+  if(!file) return 79;
+  error = streamBegin(encoder, w, h, state, streamWriteFile, file, file);
+  /*if the encoder could not be created, it can't close the file either*/
+  if(!*encoder) fclose(file);
+  return error;
+}
+#endif /*LODEPNG_COMPILE_DISK*/
+
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+struct LodePNGEncoderContext
+{
+  LodePNGArena arena;
+  unsigned char* spilled; /*result of the last job if it didn't fit in the arena*/
+};
+
+LodePNGEncoderContext* lodepng_encoder_context_new(void)
+{
+  LodePNGEncoderContext* context = (LodePNGEncoderContext*)malloc(sizeof(LodePNGEncoderContext));
+  if(!context) return 0;
+  context->arena.data = 0;
+  context->arena.capacity = 0;
+  context->arena.top = context->arena.peak = context->arena.overflow = 0;
+  context->spilled = 0;
+  return context;
+}
+
+void lodepng_encoder_context_free(LodePNGEncoderContext* context)
+{
+  if(!context) return;
+  free(context->arena.data);
+  free(context->spilled);
+  free(context);
+}
+
+size_t lodepng_encoder_context_capacity(const LodePNGEncoderContext* context)
+{
+  return context->arena.capacity;
+}
+
+unsigned lodepng_encoder_context_encode(LodePNGEncoderContext* context,
+                                        const unsigned char** out, size_t* outsize,
+                                        const unsigned char* image, unsigned w, unsigned h,
+                                        LodePNGState* state)
+{
+  LodePNGArena* arena = &context->arena;
+  LodePNGArena* previous = lodepng_current_arena;
+  unsigned char* result = 0;
+  unsigned error;
+  /*an upper bound of what the previous job needed, exact once a job fitted entirely*/
+  size_t wanted = arena->peak + arena->overflow;
+
+  free(context->spilled);
+  context->spilled = 0;
+
+  /*regrow to what the previous job needed, or shrink if the estimate was far too high*/
+  if(wanted > arena->capacity || wanted < arena->capacity / 2)
+  {
+    free(arena->data);
+    arena->data = (unsigned char*)malloc(wanted);
+    arena->capacity = arena->data ? wanted : 0; /*without arena everything comes from malloc*/
+  }
+  arena->top = arena->peak = arena->overflow = 0;
+
+  lodepng_current_arena = arena;
+  error = lodepng_encode(&result, outsize, image, w, h, state);
+  lodepng_current_arena = previous;
+
+  if(result && !lodepng_arena_owns(arena, result)) context->spilled = result;
+  *out = result;
+  return error;
+}
+#endif /*LODEPNG_COMPILE_ALLOCATORS*/
+
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings)
 {
   lodepng_compress_settings_init(&settings->zlibsettings);
@@ -5923,6 +6982,10 @@ const char* lodepng_error_text(unsigned code)
     case 91: return "invalid decompressed idat size";
     case 92: return "too many pixels, not supported";
     case 93: return "zero width or height is invalid";
+    case 94: return "the streaming encoder does not support Adam7 interlacing or uncompressed deflate blocks";
+    case 95: return "the streaming encoder must receive exactly h rows before finishing";
+    case 96: return "failed to write out the encoded stream";
+    case 97: return "the row callback of lodepng_decode_rows requested to stop";
   }
   return "unknown error code";
 }
@@ -6084,6 +7147,12 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
   return decode(out, w, h, state, in.empty() ? 0 : &in[0], in.size());
 }
 
+unsigned decode_rows(unsigned& w, unsigned& h, State& state, const std::vector<unsigned char>& in,
+                     LodePNGRowCallback callback, void* user)
+{
+  return lodepng_decode_rows(&w, &h, &state, in.empty() ? 0 : &in[0], in.size(), callback, user);
+}
+
 #ifdef LODEPNG_COMPILE_DISK
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const std::string& filename,
                 LodePNGColorType colortype, unsigned bitdepth)
@@ -6142,7 +7211,87 @@ unsigned encode(std::vector<unsigned char>& out,
   return encode(out, in.empty() ? 0 : &in[0], w, h, state);
 }
 
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+EncoderContext::EncoderContext() : context(lodepng_encoder_context_new())
+{
+}
+
+EncoderContext::~EncoderContext()
+{
+  lodepng_encoder_context_free(context);
+}
+
+unsigned EncoderContext::encode(const unsigned char*& out, size_t& outsize,
+                                const unsigned char* in, unsigned w, unsigned h, State& state)
+{
+  out = 0;
+  outsize = 0;
+  if(!context) return 83; /*alloc fail*/
+  return lodepng_encoder_context_encode(context, &out, &outsize, in, w, h, &state);
+}
+
+unsigned EncoderContext::encode(const unsigned char*& out, size_t& outsize,
+                                const unsigned char* in, unsigned w, unsigned h,
+                                LodePNGColorType colortype, unsigned bitdepth)
+{
+  State state;
+  state.info_raw.colortype = colortype;
+  state.info_raw.bitdepth = bitdepth;
+  return encode(out, outsize, in, w, h, state);
+}
+
+size_t EncoderContext::capacity() const
+{
+  return context ? lodepng_encoder_context_capacity(context) : 0;
+}
+#endif /*LODEPNG_COMPILE_ALLOCATORS*/
+
 #ifdef LODEPNG_COMPILE_DISK
+#ifdef LODEPNG_COMPILE_ZLIB
+StreamEncoder::StreamEncoder() : encoder(0), error(0)
+{
+}
+
+StreamEncoder::~StreamEncoder()
+{
+  lodepng_stream_encoder_free(encoder);
+}
+
+unsigned StreamEncoder::begin(const std::string& filename, unsigned w, unsigned h,
+                              LodePNGColorType colortype, unsigned bitdepth)
+{
+  State state;
+  state.info_png.color.colortype = colortype;
+  state.info_png.color.bitdepth = bitdepth;
+  return begin(filename, w, h, state);
+}
+
+unsigned StreamEncoder::begin(const std::string& filename, unsigned w, unsigned h, const State& state)
+{
+  lodepng_stream_encoder_free(encoder);
+  encoder = 0;
+  error = lodepng_stream_encoder_begin_file(&encoder, w, h, &state, filename.c_str());
+  return error;
+}
+
+unsigned StreamEncoder::writeRows(const unsigned char* rows, unsigned numrows)
+{
+  if(!error && !encoder) error = 95;
+  if(!error) error = lodepng_stream_encoder_write_rows(encoder, rows, numrows);
+  return error;
+}
+
+unsigned StreamEncoder::finish()
+{
+  if(!error && !encoder) error = 95;
+  if(!error) error = lodepng_stream_encoder_finish(encoder);
+  /*close the file now rather than at destruction*/
+  lodepng_stream_encoder_free(encoder);
+  encoder = 0;
+  return error;
+}
+#endif /* LODEPNG_COMPILE_ZLIB */
+
 unsigned encode(const std::string& filename,
                 const unsigned char* in, unsigned w, unsigned h,
                 LodePNGColorType colortype, unsigned bitdepth)
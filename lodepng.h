@@ -659,6 +659,25 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*
+Receives one decoded row of the image from lodepng_decode_rows. y is the index of the row,
+row holds its w pixels in the color of state->info_raw (or of the PNG when color_convert is
+off). Rows with less than 8 bits per pixel start at a byte boundary. The buffer is only valid
+during the call. Return 0 to continue, anything else stops decoding with error 97.
+*/
+typedef unsigned (*LodePNGRowCallback)(void* user, unsigned y, const unsigned char* row);
+
+/*
+Same as lodepng_decode, but never holds the whole image: the IDAT data is inflated, unfiltered
+and converted scanline by scanline, and every finished row is handed to callback. Besides the
+compressed input, memory stays at a few rows plus the 32K inflate window. Non-interlaced rows
+arrive from top to bottom. For Adam7 images passes 1-5 are buffered (a quarter of the image),
+then the even rows arrive during pass 6 and the odd rows during pass 7.
+*/
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback callback, void* user);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 
@@ -667,6 +686,71 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h,
 unsigned lodepng_encode(unsigned char** out, size_t* outsize,
                         const unsigned char* image, unsigned w, unsigned h,
                         LodePNGState* state);
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*
+Streaming encoder: instead of taking the whole image at once, it takes scanlines as they
+become available, filters and deflates them incrementally, and hands finished PNG data to
+a write function as soon as an IDAT chunk fills up. Memory use is bounded by a few scanlines
+plus the deflate window and block, independent of the image height.
+
+Usage: lodepng_stream_encoder_begin, then lodepng_stream_encoder_write_rows until all h rows
+were given (top to bottom, any amount of rows per call), then lodepng_stream_encoder_finish.
+Always call lodepng_stream_encoder_free on the encoder afterwards, also if begin failed.
+
+Differences with lodepng_encode:
+-the rows must already be in the PNG color mode state->info_png.color, there is no
+ conversion and no auto_convert. For bit depths below 8, each row starts at a byte boundary.
+-no Adam7 interlacing (error 94), and zlibsettings.btype 0 is not supported (error 94).
+-custom_zlib and custom_deflate are ignored, LFS_BRUTE_FORCE behaves as LFS_MINSUM.
+-ancillary chunks (text, time, unknown chunks, ...) are not written.
+*/
+typedef struct LodePNGStreamEncoder LodePNGStreamEncoder;
+
+/*Receives the encoded PNG bytes in order. Must return 0 on success, anything else aborts with error 96.*/
+typedef unsigned (*LodePNGStreamWriteFunc)(void* user, const unsigned char* data, size_t size);
+
+unsigned lodepng_stream_encoder_begin(LodePNGStreamEncoder** encoder, unsigned w, unsigned h,
+                                      const LodePNGState* state, LodePNGStreamWriteFunc write, void* user);
+#ifdef LODEPNG_COMPILE_DISK
+/*Same as lodepng_stream_encoder_begin, but writes to the given file, which is overwritten without warning.*/
+unsigned lodepng_stream_encoder_begin_file(LodePNGStreamEncoder** encoder, unsigned w, unsigned h,
+                                           const LodePNGState* state, const char* filename);
+#endif /*LODEPNG_COMPILE_DISK*/
+/*rows: numrows consecutive scanlines of (w * bpp + 7) / 8 bytes each*/
+unsigned lodepng_stream_encoder_write_rows(LodePNGStreamEncoder* encoder, const unsigned char* rows,
+                                           unsigned numrows);
+/*writes the last deflate block, the remaining IDAT data and the IEND chunk*/
+unsigned lodepng_stream_encoder_finish(LodePNGStreamEncoder* encoder);
+/*frees the encoder and closes the file if it was opened by lodepng_stream_encoder_begin_file*/
+void lodepng_stream_encoder_free(LodePNGStreamEncoder* encoder);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+/*
+Encoder context for encoding many images one after another without malloc churn. During
+lodepng_encoder_context_encode all memory lodepng allocates comes from an arena owned by the
+context, sized after what the previous job needed. Once a job of the same size went through,
+the following ones do no mallocs at all.
+
+The encoded PNG returned in *out belongs to the context: don't free it, it stays valid until
+the next encode with the same context or lodepng_encoder_context_free. The arena is only used
+by the thread that calls encode, one context must not be used by two threads at once.
+Requires the built-in allocators (LODEPNG_COMPILE_ALLOCATORS).
+*/
+typedef struct LodePNGEncoderContext LodePNGEncoderContext;
+
+/*returns 0 if out of memory*/
+LodePNGEncoderContext* lodepng_encoder_context_new(void);
+void lodepng_encoder_context_free(LodePNGEncoderContext* context);
+/*Same as lodepng_encode, but see above for the ownership of *out.*/
+unsigned lodepng_encoder_context_encode(LodePNGEncoderContext* context,
+                                        const unsigned char** out, size_t* outsize,
+                                        const unsigned char* image, unsigned w, unsigned h,
+                                        LodePNGState* state);
+/*size of the arena in bytes, as sized for the last job*/
+size_t lodepng_encoder_context_capacity(const LodePNGEncoderContext* context);
+#endif /*LODEPNG_COMPILE_ALLOCATORS*/
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 /*
@@ -834,6 +918,9 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
                 State& state,
                 const std::vector<unsigned char>& in);
+/* Decodes row by row into callback, see lodepng_decode_rows. */
+unsigned decode_rows(unsigned& w, unsigned& h, State& state, const std::vector<unsigned char>& in,
+                     LodePNGRowCallback callback, void* user);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -844,6 +931,61 @@ unsigned encode(std::vector<unsigned char>& out,
 unsigned encode(std::vector<unsigned char>& out,
                 const std::vector<unsigned char>& in, unsigned w, unsigned h,
                 State& state);
+
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+/*
+Wrapper around LodePNGEncoderContext, for encoding many images in a row with the memory of
+the previous one. out points into the context and stays valid until the next encode.
+*/
+class EncoderContext
+{
+  public:
+    EncoderContext();
+    ~EncoderContext();
+
+    unsigned encode(const unsigned char*& out, size_t& outsize,
+                    const unsigned char* in, unsigned w, unsigned h, State& state);
+    unsigned encode(const unsigned char*& out, size_t& outsize,
+                    const unsigned char* in, unsigned w, unsigned h,
+                    LodePNGColorType colortype = LCT_RGBA, unsigned bitdepth = 8);
+    /*size of the arena in bytes*/
+    size_t capacity() const;
+
+  private:
+    EncoderContext(const EncoderContext&);
+    EncoderContext& operator=(const EncoderContext&);
+
+    LodePNGEncoderContext* context;
+};
+#endif /*LODEPNG_COMPILE_ALLOCATORS*/
+
+#if defined(LODEPNG_COMPILE_ZLIB) && defined(LODEPNG_COMPILE_DISK)
+/*
+Wrapper around the lodepng_stream_encoder functions that writes to a file.
+All functions return a lodepng error code, once an error happened every call returns it.
+*/
+class StreamEncoder
+{
+  public:
+    StreamEncoder();
+    ~StreamEncoder();
+
+    /*rows must be given in colortype and bitdepth, no conversion is done*/
+    unsigned begin(const std::string& filename, unsigned w, unsigned h,
+                   LodePNGColorType colortype = LCT_RGBA, unsigned bitdepth = 8);
+    /*uses state.info_png.color and state.encoder, see lodepng_stream_encoder_begin*/
+    unsigned begin(const std::string& filename, unsigned w, unsigned h, const State& state);
+    unsigned writeRows(const unsigned char* rows, unsigned numrows);
+    unsigned finish();
+
+  private:
+    StreamEncoder(const StreamEncoder&);
+    StreamEncoder& operator=(const StreamEncoder&);
+
+    LodePNGStreamEncoder* encoder;
+    unsigned error;
+};
+#endif /*defined(LODEPNG_COMPILE_ZLIB) && defined(LODEPNG_COMPILE_DISK)*/
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 #ifdef LODEPNG_COMPILE_DISK
@@ -1,11 +1,61 @@
 #include <QApplication>
 
 #include "Window.h"
+#include "Batch.h"
 
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+namespace
+{
+
+// wallpaper-gen --batch jobs.txt [--renderers N] [--render-threads N] [--encode-threads N] [--supersample S]
+int runBatchFile(int argc, char** argv)
+{
+	BatchSettings settings;
+	std::string path;
+	for(int arg = 1; arg < argc; ++arg)
+	{
+		if(!std::strcmp(argv[arg], "--batch") && arg + 1 < argc) path = argv[++arg];
+		else if(!std::strcmp(argv[arg], "--renderers") && arg + 1 < argc) settings.renderers = std::atoi(argv[++arg]);
+		else if(!std::strcmp(argv[arg], "--render-threads") && arg + 1 < argc) settings.renderThreads = std::atoi(argv[++arg]);
+		else if(!std::strcmp(argv[arg], "--encode-threads") && arg + 1 < argc) settings.encodeThreads = std::atoi(argv[++arg]);
+		else if(!std::strcmp(argv[arg], "--supersample") && arg + 1 < argc) settings.supersample = std::atof(argv[++arg]);
+	}
+
+	std::vector<BatchJob> jobs;
+	if(!loadBatchFile(path, jobs)) return 1;
+
+	// video streamed to stdout can't have messages mixed in
+	if(std::any_of(jobs.begin(), jobs.end(), [](const BatchJob& job) { return job.output == "-"; })) std::cout.rdbuf(std::cerr.rdbuf());
+
+	// a reader that goes away should fail the job's writes, not kill the whole batch
+	std::signal(SIGPIPE, SIG_IGN);
+
+	BatchStats stats = runBatch(jobs, settings);
+
+	std::cout << "Rendered " << stats.jobs - stats.failed << " of " << stats.jobs << " wallpapers in " << stats.seconds << "s, "
+		<< stats.jobs / stats.seconds << " jobs/s, from " << stats.renders << " renders" << std::endl;
+	std::cout << "Loading meshes " << stats.loadSeconds << "s, rendering " << stats.renderSeconds << "s, scaling "
+		<< stats.resampleSeconds << "s and encoding " << stats.encodeSeconds << "s over all encoders, writing "
+		<< stats.writeSeconds << "s" << std::endl;
+
+	return stats.failed ? 1 : 0;
+}
+
+}
+
 int main(int argc, char** argv)
 {
+	for(int arg = 1; arg < argc; ++arg)
+	{
+		// no window, and no Qt
+		if(!std::strcmp(argv[arg], "--batch")) return runBatchFile(argc, argv);
+	}
+
 	QApplication app{argc, argv};
 
 	Window w;